@@ -0,0 +1,789 @@
+#ifndef AVL_TREE_BTREE_MAP
+#define AVL_TREE_BTREE_MAP
+
+#include <algorithm>
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define AVL_TREE_BTREE_X86
+#endif
+
+namespace cs540 {
+
+    // Rank of a probe among the first `count` (at most 16) keys of a node, which are sorted and stored in a 64-byte
+    // aligned array of 16: below() counts the keys ordered before the probe, notAbove() the keys not after it. For
+    // 32- and 64-bit integer and floating point keys the whole array is compared at once with AVX2, when the CPU
+    // has it (checked once, at startup, unless the build targets it anyway), and the lanes past `count` are masked
+    // off the result; otherwise, and for any other key type, a loop of comparisons without branches does the count.
+    // Defining AVL_TREE_BTREE_NO_SIMD before the include keeps every key type on that loop.
+    template<typename Key_T>
+    class NodeSearch {
+    public:
+        static constexpr int KEYS = 16;
+
+        static int below(const Key_T *keys, int count, Key_T probe) {
+#ifdef AVL_TREE_BTREE_X86
+            if constexpr (VECTORIZED) {
+                if (AVX2)
+                    return popcount(lessMask(keys, probe, false) & ((1u << count) - 1));
+            }
+#endif
+            int rank = 0;
+            for (int i = 0; i < count; ++i)
+                rank += keys[i] < probe;
+            return rank;
+        }
+
+        static int notAbove(const Key_T *keys, int count, Key_T probe) {
+#ifdef AVL_TREE_BTREE_X86
+            if constexpr (VECTORIZED) {
+                if (AVX2)
+                    return popcount(lessMask(keys, probe, true) & ((1u << count) - 1));
+            }
+#endif
+            int rank = 0;
+            for (int i = 0; i < count; ++i)
+                rank += !(probe < keys[i]);
+            return rank;
+        }
+
+        // Whether the searches run the AVX2 kernel, on this CPU and build
+        static bool simd() {
+#ifdef AVL_TREE_BTREE_X86
+            return VECTORIZED && AVX2;
+#else
+            return false;
+#endif
+        }
+
+    private:
+#ifdef AVL_TREE_BTREE_NO_SIMD
+        static constexpr bool VECTORIZED = false;
+#else
+        static constexpr bool VECTORIZED = (std::is_integral<Key_T>::value || std::is_floating_point<Key_T>::value) &&
+                                           !std::is_same<Key_T, bool>::value &&
+                                           (sizeof(Key_T) == 4 || sizeof(Key_T) == 8) &&
+                                           (!std::is_floating_point<Key_T>::value ||
+                                            std::is_same<Key_T, float>::value || std::is_same<Key_T, double>::value);
+#endif
+
+#ifdef AVL_TREE_BTREE_X86
+        static bool detectAvx2() {
+#ifdef __AVX2__
+            return true;
+#else
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+#endif
+        }
+
+        static inline const bool AVX2 = detectAvx2();
+
+        static int popcount(unsigned mask) {
+            return __builtin_popcount(mask);
+        }
+
+        // Bit i is set when keys[i] is before the probe (or, with `orEqual`, not after it)
+        __attribute__((target("avx2")))
+        static unsigned lessMask(const Key_T *keys, Key_T probe, bool orEqual) {
+            unsigned mask = 0;
+            if constexpr (std::is_same<Key_T, double>::value) {
+                __m256d p = _mm256_set1_pd(probe);
+                for (int i = 0; i < KEYS; i += 4) {
+                    __m256d k = _mm256_load_pd(keys + i);
+                    __m256d hit = orEqual ? _mm256_cmp_pd(k, p, _CMP_LE_OQ) : _mm256_cmp_pd(k, p, _CMP_LT_OQ);
+                    mask |= (unsigned) _mm256_movemask_pd(hit) << i;
+                }
+            } else if constexpr (std::is_same<Key_T, float>::value) {
+                __m256 p = _mm256_set1_ps(probe);
+                for (int i = 0; i < KEYS; i += 8) {
+                    __m256 k = _mm256_load_ps(keys + i);
+                    __m256 hit = orEqual ? _mm256_cmp_ps(k, p, _CMP_LE_OQ) : _mm256_cmp_ps(k, p, _CMP_LT_OQ);
+                    mask |= (unsigned) _mm256_movemask_ps(hit) << i;
+                }
+            } else if constexpr (sizeof(Key_T) == 8) {
+                // Unsigned keys are compared as signed ones with the top bit flipped
+                __m256i flip = _mm256_set1_epi64x(std::is_signed<Key_T>::value ? 0 : INT64_MIN);
+                __m256i p = _mm256_xor_si256(_mm256_set1_epi64x((long long) probe), flip);
+                for (int i = 0; i < KEYS; i += 4) {
+                    __m256i k = _mm256_xor_si256(_mm256_load_si256((const __m256i *) (keys + i)), flip);
+                    __m256i hit = orEqual ? _mm256_cmpgt_epi64(k, p) : _mm256_cmpgt_epi64(p, k);
+                    unsigned bits = (unsigned) _mm256_movemask_pd(_mm256_castsi256_pd(hit));
+                    mask |= (orEqual ? ~bits & 0xfu : bits) << i;
+                }
+            } else {
+                __m256i flip = _mm256_set1_epi32(std::is_signed<Key_T>::value ? 0 : INT32_MIN);
+                __m256i p = _mm256_xor_si256(_mm256_set1_epi32((int) probe), flip);
+                for (int i = 0; i < KEYS; i += 8) {
+                    __m256i k = _mm256_xor_si256(_mm256_load_si256((const __m256i *) (keys + i)), flip);
+                    __m256i hit = orEqual ? _mm256_cmpgt_epi32(k, p) : _mm256_cmpgt_epi32(p, k);
+                    unsigned bits = (unsigned) _mm256_movemask_ps(_mm256_castsi256_ps(hit));
+                    mask |= (orEqual ? ~bits & 0xffu : bits) << i;
+                }
+            }
+            return mask;
+        }
+#endif
+    };
+
+    // An ordered map for arithmetic keys backed by a B+ tree of fat nodes instead of a binary tree: each node holds
+    // up to 16 keys in a cache-line aligned array, searched in one go by NodeSearch, so a lookup touches a node (one
+    // or two lines) per level instead of a line per comparison, and the levels are four times fewer. The entries live
+    // in the leaves, which are chained both ways for ordered iteration. The API follows Map's: the same lookups,
+    // insert/emplace/insert_or_assign reporting whether the key was new, erase(key) throwing std::out_of_range for a
+    // missing key. Unlike Map's, iterators do not survive insert and erase, which move entries between slots.
+    template<typename Key_T, typename Mapped_T>
+    class BTreeMap {
+        static_assert(std::is_arithmetic<Key_T>::value, "BTreeMap needs integer or floating point keys");
+
+    public:
+        typedef Key_T key_type;
+        typedef Mapped_T mapped_type;
+        typedef std::pair<Key_T, Mapped_T> value_type;
+        typedef size_t size_type;
+
+    private:
+        static constexpr int CAPACITY = NodeSearch<Key_T>::KEYS;
+        // Every node but the root keeps at least this many keys
+        static constexpr int MINIMUM = CAPACITY / 2;
+        // Enough for 2^64 entries at the minimum fan-out
+        static constexpr int MAX_DEPTH = 24;
+
+        struct Node {
+            alignas(64) Key_T keys[CAPACITY] = {};
+            int count = 0;
+            bool leaf;
+
+            explicit Node(bool leaf) : leaf(leaf) {}
+        };
+
+        // Separator keys[i] is the smallest key under children[i + 1]
+        struct Inner : Node {
+            Node *children[CAPACITY + 1];
+
+            Inner() : Node(false) {}
+        };
+
+        struct Leaf : Node {
+            Leaf *prev = nullptr, *next = nullptr;
+            alignas(value_type) unsigned char storage[sizeof(value_type) * CAPACITY];
+
+            Leaf() : Node(true) {}
+
+            value_type *entries() {
+                return std::launder(reinterpret_cast<value_type *>(storage));
+            }
+
+            const value_type *entries() const {
+                return std::launder(reinterpret_cast<const value_type *>(storage));
+            }
+        };
+
+        // The inner nodes a descent went through, and which child it took in each
+        struct Path {
+            Inner *nodes[MAX_DEPTH];
+            int indexes[MAX_DEPTH];
+            int depth = 0;
+        };
+
+    public:
+        class ConstIterator;
+
+        class Iterator {
+            friend BTreeMap<Key_T, Mapped_T>;
+        public:
+            typedef std::bidirectional_iterator_tag iterator_category;
+            typedef typename BTreeMap<Key_T, Mapped_T>::value_type value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef value_type *pointer;
+            typedef value_type &reference;
+
+            value_type &operator*() const {
+                return leaf->entries()[slot];
+            }
+
+            value_type *operator->() const {
+                return &leaf->entries()[slot];
+            }
+
+            Iterator &operator++() {
+                if (++slot == leaf->count) {
+                    leaf = leaf->next;
+                    slot = 0;
+                }
+                return *this;
+            }
+
+            Iterator &operator--() {
+                if (!leaf) {
+                    leaf = map->last;
+                    slot = leaf->count;
+                } else if (!slot) {
+                    leaf = leaf->prev;
+                    slot = leaf->count;
+                }
+                --slot;
+                return *this;
+            }
+
+            Iterator operator++(int) {
+                Iterator copy(*this);
+                ++*this;
+                return copy;
+            }
+
+            Iterator operator--(int) {
+                Iterator copy(*this);
+                --*this;
+                return copy;
+            }
+
+            bool operator==(const Iterator &other) const {
+                return leaf == other.leaf && slot == other.slot;
+            }
+
+            bool operator!=(const Iterator &other) const {
+                return !(*this == other);
+            }
+
+        protected:
+            // The end is a null leaf, which -- steps back from to the map's last leaf
+            Iterator(const BTreeMap<Key_T, Mapped_T> *map, Leaf *leaf, int slot) : map(map), leaf(leaf), slot(slot) {}
+
+            const BTreeMap<Key_T, Mapped_T> *map;
+            Leaf *leaf;
+            int slot;
+        };
+
+        class ConstIterator : public Iterator {
+        public:
+            typedef const value_type *pointer;
+            typedef const value_type &reference;
+
+            ConstIterator(const Iterator &it) : Iterator(it) {}
+
+            const value_type &operator*() const {
+                return Iterator::operator*();
+            }
+
+            const value_type *operator->() const {
+                return Iterator::operator->();
+            }
+        };
+
+        typedef std::reverse_iterator<Iterator> ReverseIterator;
+
+        // -- constructing
+        BTreeMap() = default;
+
+        BTreeMap(std::initializer_list<value_type> list) {
+            for (const value_type &value : list)
+                this->insert(value);
+        }
+
+        BTreeMap(const BTreeMap &other);
+
+        BTreeMap(BTreeMap &&other) noexcept : root(other.root), first(other.first), last(other.last), entries(other.entries) {
+            other.root = nullptr;
+            other.first = other.last = nullptr;
+            other.entries = 0;
+        }
+
+        BTreeMap &operator=(BTreeMap other) noexcept {
+            std::swap(root, other.root);
+            std::swap(first, other.first);
+            std::swap(last, other.last);
+            std::swap(entries, other.entries);
+            return *this;
+        }
+
+        ~BTreeMap() {
+            this->clear();
+        }
+
+        // -- size:
+        size_t size() const {
+            return entries;
+        }
+
+        bool empty() const {
+            return !entries;
+        }
+
+        // -- iterators:
+        Iterator begin() {
+            return Iterator(this, first, 0);
+        }
+
+        Iterator end() {
+            return Iterator(this, nullptr, 0);
+        }
+
+        ConstIterator begin() const {
+            return Iterator(this, first, 0);
+        }
+
+        ConstIterator end() const {
+            return Iterator(this, nullptr, 0);
+        }
+
+        ReverseIterator rbegin() {
+            return ReverseIterator(this->end());
+        }
+
+        ReverseIterator rend() {
+            return ReverseIterator(this->begin());
+        }
+
+        // -- lookup:
+        Iterator find(const Key_T &key);
+
+        ConstIterator find(const Key_T &key) const {
+            return const_cast<BTreeMap *>(this)->find(key);
+        }
+
+        bool contains(const Key_T &key) const {
+            return this->find(key) != this->end();
+        }
+
+        size_t count(const Key_T &key) const {
+            return this->contains(key) ? 1 : 0;
+        }
+
+        Mapped_T &at(const Key_T &key);
+
+        const Mapped_T &at(const Key_T &key) const {
+            return const_cast<BTreeMap *>(this)->at(key);
+        }
+
+        Mapped_T &operator[](const Key_T &key) {
+            return this->try_emplace(key).first->second;
+        }
+
+        // First entry not ordered before `key`
+        Iterator lower_bound(const Key_T &key) {
+            return this->bound(key, false);
+        }
+
+        ConstIterator lower_bound(const Key_T &key) const {
+            return const_cast<BTreeMap *>(this)->bound(key, false);
+        }
+
+        // First entry ordered after `key`
+        Iterator upper_bound(const Key_T &key) {
+            return this->bound(key, true);
+        }
+
+        ConstIterator upper_bound(const Key_T &key) const {
+            return const_cast<BTreeMap *>(this)->bound(key, true);
+        }
+
+        std::pair<Iterator, Iterator> equal_range(const Key_T &key) {
+            return {this->lower_bound(key), this->upper_bound(key)};
+        }
+
+        // -- modifiers: these invalidate every iterator
+        std::pair<Iterator, bool> insert(const value_type &value) {
+            return this->try_emplace(value.first, value.second);
+        }
+
+        template<typename... Args>
+        std::pair<Iterator, bool> emplace(Args &&...args) {
+            value_type value(std::forward<Args>(args)...);
+            return this->try_emplace(value.first, std::move(value.second));
+        }
+
+        // Only constructs the value (from `args`) when `key` is absent
+        template<typename... Args>
+        std::pair<Iterator, bool> try_emplace(const Key_T &key, Args &&...args);
+
+        template<typename M>
+        std::pair<Iterator, bool> insert_or_assign(const Key_T &key, M &&mapped) {
+            std::pair<Iterator, bool> inserted = this->try_emplace(key, std::forward<M>(mapped));
+            if (!inserted.second)
+                inserted.first->second = std::forward<M>(mapped);
+            return inserted;
+        }
+
+        void erase(const Key_T &key);
+
+        void erase(Iterator it) {
+            this->erase(it->first);
+        }
+
+        void clear();
+
+        bool operator==(const BTreeMap &other) const;
+
+        bool operator!=(const BTreeMap &other) const {
+            return !(*this == other);
+        }
+
+    private:
+        Node *root = nullptr;
+        Leaf *first = nullptr, *last = nullptr;
+        size_t entries = 0;
+
+        Leaf *descend(const Key_T &key, Path *path) const;
+
+        Iterator bound(const Key_T &key, bool upper);
+
+        void insertAbove(Path &path, Key_T separator, Node *right);
+
+        void rebalance(Path &path, Node *node);
+
+        Node *cloneFrom(const Node *node, Leaf *&previous);
+
+        static void destroy(Node *node);
+
+        // Moves the entry in `from`'s slot `fromSlot` into the empty slot `toSlot` of `to`
+        static void moveEntry(Leaf *to, int toSlot, Leaf *from, int fromSlot) {
+            to->keys[toSlot] = from->keys[fromSlot];
+            new(to->entries() + toSlot) value_type(std::move(from->entries()[fromSlot]));
+            from->entries()[fromSlot].~value_type();
+        }
+    };
+
+    // Copies the nodes in key order, so the leaves are chained as they are made
+    template<typename Key_T, typename Mapped_T>
+    BTreeMap<Key_T, Mapped_T>::BTreeMap(const BTreeMap &other) {
+        if (!other.root)
+            return;
+        Leaf *previous = nullptr;
+        root = this->cloneFrom(other.root, previous);
+        last = previous;
+        entries = other.entries;
+    }
+
+    // `previous` is the last leaf made so far. If a copy throws, every node made for the subtree is freed.
+    template<typename Key_T, typename Mapped_T>
+    typename BTreeMap<Key_T, Mapped_T>::Node *BTreeMap<Key_T, Mapped_T>::cloneFrom(const Node *node, Leaf *&previous) {
+        if (node->leaf) {
+            const Leaf *source = static_cast<const Leaf *>(node);
+            Leaf *leaf = new Leaf();
+            try {
+                for (; leaf->count < source->count; ++leaf->count) {
+                    leaf->keys[leaf->count] = source->keys[leaf->count];
+                    new(leaf->entries() + leaf->count) value_type(source->entries()[leaf->count]);
+                }
+            } catch (...) {
+                destroy(leaf);
+                throw;
+            }
+            leaf->prev = previous;
+            if (previous)
+                previous->next = leaf;
+            else
+                first = leaf;
+            previous = leaf;
+            return leaf;
+        }
+        const Inner *source = static_cast<const Inner *>(node);
+        Inner *inner = new Inner();
+        int made = 0;
+        try {
+            for (; made <= source->count; ++made) {
+                inner->children[made] = this->cloneFrom(source->children[made], previous);
+                if (made < source->count)
+                    inner->keys[made] = source->keys[made];
+            }
+        } catch (...) {
+            for (int i = 0; i < made; ++i)
+                destroy(inner->children[i]);
+            delete inner;
+            throw;
+        }
+        inner->count = source->count;
+        return inner;
+    }
+
+    template<typename Key_T, typename Mapped_T>
+    void BTreeMap<Key_T, Mapped_T>::destroy(Node *node) {
+        if (node->leaf) {
+            Leaf *leaf = static_cast<Leaf *>(node);
+            for (int i = 0; i < leaf->count; ++i)
+                leaf->entries()[i].~value_type();
+            delete leaf;
+        } else {
+            Inner *inner = static_cast<Inner *>(node);
+            for (int i = 0; i <= inner->count; ++i)
+                destroy(inner->children[i]);
+            delete inner;
+        }
+    }
+
+    template<typename Key_T, typename Mapped_T>
+    void BTreeMap<Key_T, Mapped_T>::clear() {
+        if (root)
+            destroy(root);
+        root = nullptr;
+        first = last = nullptr;
+        entries = 0;
+    }
+
+    // Takes, at every inner node, the child after the separators not after `key`, noting the way in `path`
+    template<typename Key_T, typename Mapped_T>
+    typename BTreeMap<Key_T, Mapped_T>::Leaf *BTreeMap<Key_T, Mapped_T>::descend(const Key_T &key, Path *path) const {
+        Node *node = root;
+        while (!node->leaf) {
+            Inner *inner = static_cast<Inner *>(node);
+            int index = NodeSearch<Key_T>::notAbove(inner->keys, inner->count, key);
+            if (path) {
+                path->nodes[path->depth] = inner;
+                path->indexes[path->depth++] = index;
+            }
+            node = inner->children[index];
+        }
+        return static_cast<Leaf *>(node);
+    }
+
+    template<typename Key_T, typename Mapped_T>
+    typename BTreeMap<Key_T, Mapped_T>::Iterator BTreeMap<Key_T, Mapped_T>::find(const Key_T &key) {
+        if (!root)
+            return this->end();
+        Leaf *leaf = this->descend(key, nullptr);
+        int slot = NodeSearch<Key_T>::below(leaf->keys, leaf->count, key);
+        if (slot == leaf->count || key < leaf->keys[slot])
+            return this->end();
+        return Iterator(this, leaf, slot);
+    }
+
+    template<typename Key_T, typename Mapped_T>
+    Mapped_T &BTreeMap<Key_T, Mapped_T>::at(const Key_T &key) {
+        Iterator it = this->find(key);
+        if (it == this->end())
+            throw std::out_of_range("specified key does not exist");
+        return it->second;
+    }
+
+    // The bound may lie past the leaf the descent ends in, at the start of the next one
+    template<typename Key_T, typename Mapped_T>
+    typename BTreeMap<Key_T, Mapped_T>::Iterator BTreeMap<Key_T, Mapped_T>::bound(const Key_T &key, bool upper) {
+        if (!root)
+            return this->end();
+        Leaf *leaf = this->descend(key, nullptr);
+        int slot = upper ? NodeSearch<Key_T>::notAbove(leaf->keys, leaf->count, key)
+                         : NodeSearch<Key_T>::below(leaf->keys, leaf->count, key);
+        if (slot == leaf->count)
+            return Iterator(this, leaf->next, 0);
+        return Iterator(this, leaf, slot);
+    }
+
+    // A full leaf is split in two halves first, and the separator of the new right half is inserted into the parent
+    template<typename Key_T, typename Mapped_T>
+    template<typename... Args>
+    std::pair<typename BTreeMap<Key_T, Mapped_T>::Iterator, bool> BTreeMap<Key_T, Mapped_T>::try_emplace(const Key_T &key, Args &&...args) {
+        if (!root)
+            root = first = last = new Leaf();
+        Path path;
+        Leaf *leaf = this->descend(key, &path);
+        int slot = NodeSearch<Key_T>::below(leaf->keys, leaf->count, key);
+        if (slot < leaf->count && !(key < leaf->keys[slot]))
+            return {Iterator(this, leaf, slot), false};
+
+        value_type value(std::piecewise_construct, std::forward_as_tuple(key),
+                         std::forward_as_tuple(std::forward<Args>(args)...));
+        if (leaf->count == CAPACITY) {
+            Leaf *right = new Leaf();
+            for (int i = MINIMUM; i < CAPACITY; ++i)
+                moveEntry(right, i - MINIMUM, leaf, i);
+            right->count = CAPACITY - MINIMUM;
+            leaf->count = MINIMUM;
+            right->prev = leaf;
+            right->next = leaf->next;
+            if (leaf->next)
+                leaf->next->prev = right;
+            else
+                last = right;
+            leaf->next = right;
+            this->insertAbove(path, right->keys[0], right);
+            if (slot > MINIMUM) {
+                slot -= MINIMUM;
+                leaf = right;
+            }
+        }
+        for (int i = leaf->count; i > slot; --i)
+            moveEntry(leaf, i, leaf, i - 1);
+        leaf->keys[slot] = key;
+        new(leaf->entries() + slot) value_type(std::move(value));
+        ++leaf->count;
+        ++entries;
+        return {Iterator(this, leaf, slot), true};
+    }
+
+    // Inserts `separator` and the `right` node it leads to into the parent of the node that split off `right`,
+    // splitting the parent in turn when it is full, up to a new root
+    template<typename Key_T, typename Mapped_T>
+    void BTreeMap<Key_T, Mapped_T>::insertAbove(Path &path, Key_T separator, Node *right) {
+        while (path.depth) {
+            Inner *parent = path.nodes[--path.depth];
+            int index = path.indexes[path.depth];
+            Key_T keys[CAPACITY + 1];
+            Node *children[CAPACITY + 2];
+            for (int i = 0, j = 0; i <= parent->count; ++i) {
+                if (i == index) {
+                    keys[j] = separator;
+                    children[j + 1] = right;
+                    children[j] = parent->children[i];
+                    if (i < parent->count)
+                        keys[j + 1] = parent->keys[i];
+                    j += 2;
+                } else {
+                    children[j] = parent->children[i];
+                    if (i < parent->count)
+                        keys[j] = parent->keys[i];
+                    ++j;
+                }
+            }
+            if (parent->count < CAPACITY) {
+                ++parent->count;
+                std::copy(keys, keys + parent->count, parent->keys);
+                std::copy(children, children + parent->count + 1, parent->children);
+                return;
+            }
+            // CAPACITY + 1 separators: the middle one goes up, the halves around it stay below
+            Inner *sibling = new Inner();
+            parent->count = MINIMUM;
+            std::copy(keys, keys + MINIMUM, parent->keys);
+            std::copy(children, children + MINIMUM + 1, parent->children);
+            sibling->count = CAPACITY - MINIMUM;
+            std::copy(keys + MINIMUM + 1, keys + CAPACITY + 1, sibling->keys);
+            std::copy(children + MINIMUM + 1, children + CAPACITY + 2, sibling->children);
+            separator = keys[MINIMUM];
+            right = sibling;
+        }
+        Inner *top = new Inner();
+        top->count = 1;
+        top->keys[0] = separator;
+        top->children[0] = root;
+        top->children[1] = right;
+        root = top;
+    }
+
+    template<typename Key_T, typename Mapped_T>
+    void BTreeMap<Key_T, Mapped_T>::erase(const Key_T &key) {
+        if (!root)
+            throw std::out_of_range("specified key does not exist");
+        Path path;
+        Leaf *leaf = this->descend(key, &path);
+        int slot = NodeSearch<Key_T>::below(leaf->keys, leaf->count, key);
+        if (slot == leaf->count || key < leaf->keys[slot])
+            throw std::out_of_range("specified key does not exist");
+        leaf->entries()[slot].~value_type();
+        for (int i = slot + 1; i < leaf->count; ++i)
+            moveEntry(leaf, i - 1, leaf, i);
+        --leaf->count;
+        --entries;
+        this->rebalance(path, leaf);
+    }
+
+    // Refills a node left with too few keys from a sibling that can spare one, or else merges it with a sibling,
+    // which takes a separator out of the parent and may leave that short in turn. Separators stay valid as long as
+    // they bound their subtrees, so they only change when an entry moves between leaves.
+    template<typename Key_T, typename Mapped_T>
+    void BTreeMap<Key_T, Mapped_T>::rebalance(Path &path, Node *node) {
+        while (path.depth && node->count < MINIMUM) {
+            Inner *parent = path.nodes[--path.depth];
+            int index = path.indexes[path.depth];
+            Node *left = index > 0 ? parent->children[index - 1] : nullptr;
+            Node *right = index < parent->count ? parent->children[index + 1] : nullptr;
+            if (node->leaf) {
+                Leaf *leaf = static_cast<Leaf *>(node);
+                if (left && left->count > MINIMUM) {
+                    Leaf *from = static_cast<Leaf *>(left);
+                    for (int i = leaf->count; i > 0; --i)
+                        moveEntry(leaf, i, leaf, i - 1);
+                    moveEntry(leaf, 0, from, --from->count);
+                    ++leaf->count;
+                    parent->keys[index - 1] = leaf->keys[0];
+                    return;
+                }
+                if (right && right->count > MINIMUM) {
+                    Leaf *from = static_cast<Leaf *>(right);
+                    moveEntry(leaf, leaf->count++, from, 0);
+                    for (int i = 1; i < from->count; ++i)
+                        moveEntry(from, i - 1, from, i);
+                    --from->count;
+                    parent->keys[index] = from->keys[0];
+                    return;
+                }
+                // Merge the right one of the pair into the left one
+                Leaf *into = static_cast<Leaf *>(left ? left : leaf), *gone = static_cast<Leaf *>(left ? leaf : right);
+                for (int i = 0; i < gone->count; ++i)
+                    moveEntry(into, into->count++, gone, i);
+                into->next = gone->next;
+                if (gone->next)
+                    gone->next->prev = into;
+                else
+                    last = into;
+                delete gone;
+            } else {
+                Inner *inner = static_cast<Inner *>(node);
+                if (left && left->count > MINIMUM) {
+                    Inner *from = static_cast<Inner *>(left);
+                    std::copy_backward(inner->keys, inner->keys + inner->count, inner->keys + inner->count + 1);
+                    std::copy_backward(inner->children, inner->children + inner->count + 1,
+                                       inner->children + inner->count + 2);
+                    inner->keys[0] = parent->keys[index - 1];
+                    inner->children[0] = from->children[from->count];
+                    parent->keys[index - 1] = from->keys[--from->count];
+                    ++inner->count;
+                    return;
+                }
+                if (right && right->count > MINIMUM) {
+                    Inner *from = static_cast<Inner *>(right);
+                    inner->keys[inner->count] = parent->keys[index];
+                    inner->children[++inner->count] = from->children[0];
+                    parent->keys[index] = from->keys[0];
+                    std::copy(from->keys + 1, from->keys + from->count, from->keys);
+                    std::copy(from->children + 1, from->children + from->count + 1, from->children);
+                    --from->count;
+                    return;
+                }
+                Inner *into = static_cast<Inner *>(left ? left : inner), *gone = static_cast<Inner *>(left ? inner : right);
+                into->keys[into->count] = parent->keys[left ? index - 1 : index];
+                std::copy(gone->keys, gone->keys + gone->count, into->keys + into->count + 1);
+                std::copy(gone->children, gone->children + gone->count + 1, into->children + into->count + 1);
+                into->count += gone->count + 1;
+                delete gone;
+            }
+            // Take the merged-away node's separator and link out of the parent
+            int removed = left ? index - 1 : index;
+            std::copy(parent->keys + removed + 1, parent->keys + parent->count, parent->keys + removed);
+            std::copy(parent->children + removed + 2, parent->children + parent->count + 1, parent->children + removed + 1);
+            --parent->count;
+            node = parent;
+        }
+        if (!root->leaf && !root->count) {
+            Inner *top = static_cast<Inner *>(root);
+            root = top->children[0];
+            delete top;
+        } else if (root->leaf && !root->count) {
+            delete static_cast<Leaf *>(root);
+            root = nullptr;
+            first = last = nullptr;
+        }
+    }
+
+    template<typename Key_T, typename Mapped_T>
+    bool BTreeMap<Key_T, Mapped_T>::operator==(const BTreeMap &other) const {
+        if (entries != other.entries)
+            return false;
+        for (ConstIterator it = this->begin(), theirs = other.begin(); it != this->end(); ++it, ++theirs) {
+            if (!(it->first == theirs->first && it->second == theirs->second))
+                return false;
+        }
+        return true;
+    }
+
+}
+
+#endif // AVL_TREE_BTREE_MAP
@@ -0,0 +1,454 @@
+#ifndef AVL_TREE_CONCURRENT_MAP
+#define AVL_TREE_CONCURRENT_MAP
+
+#include "Map.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+namespace cs540 {
+
+    // Epoch-based reclamation. A reader announces the epoch it starts in for as long as it may hold node pointers;
+    // whatever a writer retires in epoch r can be freed once the epoch has been advanced past r and every announced
+    // epoch is above r, since a reader that started later can no longer reach it.
+    class EpochDomain {
+    public:
+        static const unsigned SLOTS = 64;
+
+        // Pins the calling thread for its lifetime. All slots can be taken by other readers, in which case nothing is
+        // pinned and the reader has to fall back to locking.
+        class Guard {
+        public:
+            explicit Guard(EpochDomain &domain) : slot(domain.pin()) {}
+
+            Guard(const Guard &) = delete;
+
+            Guard &operator=(const Guard &) = delete;
+
+            ~Guard() {
+                if (slot)
+                    slot->store(0, std::memory_order_release);
+            }
+
+            bool pinned() const {
+                return slot;
+            }
+
+        private:
+            std::atomic<uint64_t> *slot;
+        };
+
+        uint64_t current() const {
+            return epoch.load(std::memory_order_seq_cst);
+        }
+
+        // Moves to a new epoch and returns the oldest one a reader may still be in
+        uint64_t advance();
+
+    private:
+        // A slot per cache line, so readers pinning and unpinning do not invalidate each other's lines
+        struct alignas(64) Slot {
+            std::atomic<uint64_t> epoch{0};
+        };
+
+        std::atomic<uint64_t> epoch{1};
+        Slot slots[SLOTS];
+
+        static inline std::atomic<unsigned> threads{0};
+        static inline thread_local unsigned hint = threads.fetch_add(1, std::memory_order_relaxed) % SLOTS;
+
+        std::atomic<uint64_t> *pin();
+    };
+
+    // An ordered map for many threads. Lookups take no locks: they walk the AVL tree optimistically and validate the
+    // walk against a version counter (a seqlock) that writers bump around every structural change, retrying, and
+    // after a few failures taking the lock, when a writer got in the way. Nodes are never modified in place once they
+    // are reachable: an assignment links in a new node, and replaced or erased nodes are only freed through the
+    // EpochDomain, so an optimistic reader never dereferences freed memory. Writers are serialized.
+    template<typename Key_T, typename Mapped_T, typename Compare_T = std::less<Key_T>,
+            typename Alloc_T = std::allocator<std::pair<const Key_T, Mapped_T>>>
+    class ConcurrentMap : private Map<Key_T, Mapped_T, Compare_T, Alloc_T>::TreeType {
+        using MapDataNode = typename Map<Key_T, Mapped_T, Compare_T, Alloc_T>::MapDataNode;
+        using DataCompare = typename Map<Key_T, Mapped_T, Compare_T, Alloc_T>::DataCompare;
+        using TreeType = typename Map<Key_T, Mapped_T, Compare_T, Alloc_T>::TreeType;
+        using BinNode = typename TreeType::BinNode;
+        using AVLNode = typename TreeType::AVLNode;
+
+    public:
+        typedef Key_T key_type;
+        typedef Mapped_T mapped_type;
+        typedef std::pair<Key_T, Mapped_T> value_type;
+        typedef size_t size_type;
+
+        // -- constructing
+        explicit ConcurrentMap(const Compare_T &comp = Compare_T(), const Alloc_T &alloc = Alloc_T())
+                : TreeType(false, DataCompare(comp), alloc) {}
+
+        ConcurrentMap(const ConcurrentMap &) = delete;
+
+        ConcurrentMap &operator=(const ConcurrentMap &) = delete;
+
+        // No other thread may still be using the map
+        ~ConcurrentMap();
+
+        // -- lookup: safe alongside writers, lock-free unless writers keep invalidating the walk
+        // Calls visitor(const Mapped_T &) on the value for `key`, if there is one. The value is never modified while
+        // the visitor runs, though a writer may replace or erase its entry meanwhile.
+        template<typename Visitor_T>
+        bool visit(const Key_T &key, Visitor_T &&visitor) const;
+
+        std::optional<Mapped_T> get(const Key_T &key) const;
+
+        bool contains(const Key_T &key) const;
+
+        size_t size() const {
+            return entries.load(std::memory_order_relaxed);
+        }
+
+        bool empty() const {
+            return !this->size();
+        }
+
+        // Calls visitor(const value_type &) on every entry in key order, holding writers off until it is done
+        template<typename Visitor_T>
+        void for_each(Visitor_T &&visitor) const;
+
+        // -- modifiers: one writer at a time
+        // Each returns whether `key` was new
+        bool insert(const value_type &value);
+
+        template<typename... Args>
+        bool emplace(Args &&...args);
+
+        template<typename M>
+        bool insert_or_assign(const Key_T &key, M &&obj);
+
+        // Returns whether there was an entry to erase
+        bool erase(const Key_T &key);
+
+        void clear();
+
+    protected:
+        void destroyNode(BinNode *node) override;
+
+        void deleteSubTree(BinNode *&node) override;
+
+    private:
+        // Lookups that fail validation this many times take the lock instead
+        static const unsigned OPTIMISTIC_ATTEMPTS = 4;
+
+        // Deeper than any AVL tree of 2^64 nodes; a walk that gets this far went astray in a concurrent rotation
+        static const unsigned MAX_DEPTH = 128;
+
+        // Retired nodes that trigger an attempt to free them
+        static const size_t RECLAIM_BATCH = 128;
+
+        static constexpr bool concurrentAllocation = std::allocator_traits<typename TreeType::NodeAlloc_T>::is_always_equal::value;
+
+        // Makes the version odd for its lifetime, which fails every optimistic lookup that overlaps it
+        class WriteSection {
+        public:
+            explicit WriteSection(std::atomic<uint64_t> &version) : version(version) {
+                version.store(version.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_release);
+            }
+
+            ~WriteSection() {
+                version.store(version.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            }
+
+        private:
+            std::atomic<uint64_t> &version;
+        };
+
+        struct Retired {
+            BinNode *node;
+            uint64_t epoch;
+            bool subtree;
+        };
+
+        mutable std::shared_mutex writeLock;
+        std::atomic<uint64_t> version{0};
+        std::atomic<size_t> entries{0};
+        mutable EpochDomain epochs;
+        std::vector<Retired> retired;
+
+        const MapDataNode *lookup(const Key_T &key, bool &astray) const;
+
+        template<typename... Args>
+        bool place(bool assign, Args &&...args);
+
+        void substitute(AVLNode *node, AVLNode *replacement);
+
+        void reclaim();
+
+        void release(const Retired &entry);
+    };
+
+/********** EpochDomain ************/
+    // The slot is published before the epoch is read again: either a writer advancing the epoch after that sees the
+    // slot, or this reader sees the advanced epoch (and with it every unlink before it) and announces that instead
+    inline std::atomic<uint64_t> *EpochDomain::pin() {
+        for (unsigned i = 0; i < SLOTS; ++i) {
+            std::atomic<uint64_t> &slot = slots[(hint + i) % SLOTS].epoch;
+            uint64_t free = 0, seen = this->current();
+            if (slot.load(std::memory_order_relaxed) || !slot.compare_exchange_strong(free, seen, std::memory_order_seq_cst))
+                continue;
+            for (uint64_t now; (now = this->current()) != seen; seen = now)
+                slot.store(now, std::memory_order_seq_cst);
+            hint = (hint + i) % SLOTS;
+            return &slot;
+        }
+        return nullptr;
+    }
+
+    inline uint64_t EpochDomain::advance() {
+        uint64_t oldest = epoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+        for (Slot &slot : slots) {
+            uint64_t pinned = slot.epoch.load(std::memory_order_seq_cst);
+            if (pinned && pinned < oldest)
+                oldest = pinned;
+        }
+        return oldest;
+    }
+
+/********** ConcurrentMap ************/
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T>
+    ConcurrentMap<Key_T, Mapped_T, Compare_T, Alloc_T>::~ConcurrentMap() {
+        for (const Retired &entry : retired)
+            this->release(entry);
+    }
+
+// -- lookup:
+    // The walk loads every link with acquire semantics, and writers store them with release (BST::setLink), so a node
+    // reached through a freshly written link is seen fully built. Nodes reached through stale links may have been
+    // unlinked since, but the pin keeps them allocated, and the version check afterwards tells whether the path taken
+    // was the tree's at one point in time.
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T>
+    template<typename Visitor_T>
+    bool ConcurrentMap<Key_T, Mapped_T, Compare_T, Alloc_T>::visit(const Key_T &key, Visitor_T &&visitor) const {
+        EpochDomain::Guard guard(epochs);
+        for (unsigned attempt = 0; guard.pinned() && attempt < OPTIMISTIC_ATTEMPTS; ++attempt) {
+            uint64_t before = version.load(std::memory_order_acquire);
+            if (before & 1) {
+                std::this_thread::yield();
+                continue;
+            }
+            bool astray = false;
+            const MapDataNode *entry = this->lookup(key, astray);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (astray || version.load(std::memory_order_relaxed) != before)
+                continue;
+            if (!entry)
+                return false;
+            visitor(static_cast<const Mapped_T &>(entry->second));
+            return true;
+        }
+
+        std::shared_lock<std::shared_mutex> lock(writeLock);
+        bool astray = false;
+        const MapDataNode *entry = this->lookup(key, astray);
+        if (!entry)
+            return false;
+        visitor(static_cast<const Mapped_T &>(entry->second));
+        return true;
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T>
+    std::optional<Mapped_T> ConcurrentMap<Key_T, Mapped_T, Compare_T, Alloc_T>::get(const Key_T &key) const {
+        std::optional<Mapped_T> value;
+        this->visit(key, [&value](const Mapped_T &mapped) { value.emplace(mapped); });
+        return value;
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T>
+    bool ConcurrentMap<Key_T, Mapped_T, Compare_T, Alloc_T>::contains(const Key_T &key) const {
+        return this->visit(key, [](const Mapped_T &) {});
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T>
+    template<typename Visitor_T>
+    void ConcurrentMap<Key_T, Mapped_T, Compare_T, Alloc_T>::for_each(Visitor_T &&visitor) const {
+        std::shared_lock<std::shared_mutex> lock(writeLock);
+        for (typename TreeType::Iterator it = this->begin(); it.hasNext();)
+            visitor(static_cast<const value_type &>(it.next()));
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T>
+    const typename ConcurrentMap<Key_T, Mapped_T, Compare_T, Alloc_T>::MapDataNode *
+    ConcurrentMap<Key_T, Mapped_T, Compare_T, Alloc_T>::lookup(const Key_T &key, bool &astray) const {
+        BinNode *node = __atomic_load_n(&this->myRoot, __ATOMIC_ACQUIRE);
+        for (unsigned depth = 0; node; ++depth) {
+            if (depth == MAX_DEPTH) {
+                astray = true;
+                return nullptr;
+            }
+            if (this->compare()(key, node->getData()))
+                node = __atomic_load_n(&node->left, __ATOMIC_ACQUIRE);
+            else if (this->compare()(node->getData(), key))
+                node = __atomic_load_n(&node->right, __ATOMIC_ACQUIRE);
+            else
+                return &node->getData();
+        }
+        return nullptr;
+    }
+
+// -- modifiers:
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T>
+    bool ConcurrentMap<Key_T, Mapped_T, Compare_T, Alloc_T>::insert(const value_type &value) {
+        return this->place(false, value);
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T>
+    template<typename... Args>
+    bool ConcurrentMap<Key_T, Mapped_T, Compare_T, Alloc_T>::emplace(Args &&...args) {
+        return this->place(false, std::forward<Args>(args)...);
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T>
+    template<typename M>
+    bool ConcurrentMap<Key_T, Mapped_T, Compare_T, Alloc_T>::insert_or_assign(const Key_T &key, M &&obj) {
+        return this->place(true, key, std::forward<M>(obj));
+    }
+
+    // The entry is built before the lock is taken when the node allocator may be used from several threads at once
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T>
+    template<typename... Args>
+    bool ConcurrentMap<Key_T, Mapped_T, Compare_T, Alloc_T>::place(bool assign, Args &&...args) {
+        std::unique_lock<std::shared_mutex> lock(writeLock, std::defer_lock);
+        if (!concurrentAllocation)
+            lock.lock();
+        AVLNode *node = this->makeNode(std::forward<Args>(args)...);
+        if (concurrentAllocation)
+            lock.lock();
+
+        BinNode *parent = nullptr;
+        bool asLeftChild = false;
+        AVLNode *existing = (AVLNode *) this->searchNode(this->myRoot, node->getData(), parent, asLeftChild);
+        if (existing && !assign) {
+            this->TreeType::destroyNode(node);
+            return false;
+        }
+        {
+            WriteSection section(version);
+            if (existing) {
+                this->substitute(existing, node);
+            } else {
+                this->insertNode(parent, asLeftChild, node);
+                entries.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        if (retired.size() >= RECLAIM_BATCH)
+            this->reclaim();
+        return !existing;
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T>
+    bool ConcurrentMap<Key_T, Mapped_T, Compare_T, Alloc_T>::erase(const Key_T &key) {
+        std::unique_lock<std::shared_mutex> lock(writeLock);
+        BinNode *parent = nullptr;
+        AVLNode *node = (AVLNode *) this->searchNode(this->myRoot, key, parent);
+        if (!node)
+            return false;
+        {
+            WriteSection section(version);
+            this->TreeType::erase(typename TreeType::Iterator(node, this));
+            entries.fetch_sub(1, std::memory_order_relaxed);
+        }
+        if (retired.size() >= RECLAIM_BATCH)
+            this->reclaim();
+        return true;
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T>
+    void ConcurrentMap<Key_T, Mapped_T, Compare_T, Alloc_T>::clear() {
+        std::unique_lock<std::shared_mutex> lock(writeLock);
+        {
+            WriteSection section(version);
+            this->TreeType::clear();
+            entries.store(0, std::memory_order_relaxed);
+        }
+        this->reclaim();
+    }
+
+    // Puts `replacement` in the tree exactly where `node` is, so readers see either entry but never one being changed
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T>
+    void ConcurrentMap<Key_T, Mapped_T, Compare_T, Alloc_T>::substitute(AVLNode *node, AVLNode *replacement) {
+        AVLNode *parent = node->parent();
+        replacement->left = node->left;
+        replacement->right = node->right;
+        replacement->setParent(parent);
+        replacement->setBalance(node->balance());
+        if (replacement->left)
+            ((AVLNode *) replacement->left)->setParent(replacement);
+        if (replacement->right)
+            ((AVLNode *) replacement->right)->setParent(replacement);
+        if (!parent)
+            TreeType::setLink(this->myRoot, replacement);
+        else if (parent->left == node)
+            TreeType::setLink(parent->left, replacement);
+        else
+            TreeType::setLink(parent->right, replacement);
+        if (this->smallestNode == node)
+            this->smallestNode = replacement;
+        if (this->largestNode == node)
+            this->largestNode = replacement;
+        this->destroyNode(node);
+    }
+
+// -- reclamation:
+    // Every node the tree lets go of is retired instead of freed
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T>
+    void ConcurrentMap<Key_T, Mapped_T, Compare_T, Alloc_T>::destroyNode(BinNode *node) {
+        retired.push_back({node, epochs.current(), false});
+    }
+
+    // Whole subtrees (from clear) are retired in one piece and taken apart when they are freed
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T>
+    void ConcurrentMap<Key_T, Mapped_T, Compare_T, Alloc_T>::deleteSubTree(BinNode *&node) {
+        if (node)
+            retired.push_back({node, epochs.current(), true});
+        TreeType::setLink(node, nullptr);
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T>
+    void ConcurrentMap<Key_T, Mapped_T, Compare_T, Alloc_T>::reclaim() {
+        uint64_t oldest = epochs.advance();
+        size_t kept = 0;
+        for (const Retired &entry : retired) {
+            if (entry.epoch < oldest)
+                this->release(entry);
+            else
+                retired[kept++] = entry;
+        }
+        retired.resize(kept);
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T>
+    void ConcurrentMap<Key_T, Mapped_T, Compare_T, Alloc_T>::release(const Retired &entry) {
+        if (!entry.subtree) {
+            this->TreeType::destroyNode(entry.node);
+            return;
+        }
+        BinNode *current = entry.node, *next;
+        while (current) {
+            if (current->left) {
+                next = current->left;
+                current->left = next->right;
+                next->right = current;
+            } else {
+                next = current->right;
+                this->TreeType::destroyNode(current);
+            }
+            current = next;
+        }
+    }
+
+}
+
+#endif // AVL_TREE_CONCURRENT_MAP
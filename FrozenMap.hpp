@@ -0,0 +1,332 @@
+#ifndef AVL_TREE_FROZEN_MAP
+#define AVL_TREE_FROZEN_MAP
+
+#include "Map.hpp"
+
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace cs540 {
+
+    // A read-only ordered map for data built once and then only looked up. The entries sit in one array in Eytzinger
+    // (breadth-first) order: the children of slot i are slots 2i and 2i + 1, so a lookup walks down an implicit,
+    // complete binary tree without a single pointer. The keys are also kept in an array of their own, aligned to a
+    // cache line, which is all a descent touches: the first levels stay hot, and the descendants a few levels down
+    // share a line, so each step prefetches the line the descent reaches a few steps on, and takes no branch but the
+    // loop's (Khuong and Morin, "Array Layouts for Comparison-Based Searching"). In-order iteration steps through the
+    // implicit tree like through a threaded one.
+    template<typename Key_T, typename Mapped_T, typename Compare_T = std::less<Key_T>>
+    class FrozenMap {
+    public:
+        typedef Key_T key_type;
+        typedef Mapped_T mapped_type;
+        typedef std::pair<Key_T, Mapped_T> value_type;
+        typedef size_t size_type;
+
+        // -- constructing
+        explicit FrozenMap(const Compare_T &comp = Compare_T()) : comp(comp) {}
+
+        // Copies the entries of `map`, whichever its allocator and policies
+        template<typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+        explicit FrozenMap(const Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &map)
+                : FrozenMap(map.begin(), map.end(), map.key_comp()) {}
+
+        // From a range of entries with strictly ascending keys; throws std::out_of_range otherwise
+        template<typename IT_T>
+        FrozenMap(IT_T first, IT_T last, const Compare_T &comp = Compare_T());
+
+        FrozenMap(const FrozenMap &other) : comp(other.comp), entries(other.entries) {
+            this->layKeys();
+        }
+
+        FrozenMap(FrozenMap &&other) noexcept
+                : comp(std::move(other.comp)), entries(std::move(other.entries)), keys(std::move(other.keys)) {
+            other.entries.clear();
+        }
+
+        FrozenMap &operator=(FrozenMap other) noexcept {
+            std::swap(this->comp, other.comp);
+            this->entries.swap(other.entries);
+            this->keys.swap(other.keys);
+            return *this;
+        }
+
+        Compare_T key_comp() const {
+            return comp;
+        }
+
+        // -- size:
+        size_t size() const {
+            return entries.size();
+        }
+
+        bool empty() const {
+            return entries.empty();
+        }
+
+        // -- iterators: bidirectional, in key order. A slot's successor is the leftmost slot of its right subtree, or
+        // else its first ancestor it lies left of, so stepping is O(1) amortized.
+        class ConstIterator {
+            friend FrozenMap<Key_T, Mapped_T, Compare_T>;
+        public:
+            typedef std::bidirectional_iterator_tag iterator_category;
+            typedef typename FrozenMap<Key_T, Mapped_T, Compare_T>::value_type value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef const value_type *pointer;
+            typedef const value_type &reference;
+
+            const value_type &operator*() const {
+                return map->entries[slot - 1];
+            }
+
+            const value_type *operator->() const {
+                return &map->entries[slot - 1];
+            }
+
+            ConstIterator &operator++() {
+                slot = FrozenMap<Key_T, Mapped_T, Compare_T>::successor(slot, map->entries.size());
+                return *this;
+            }
+
+            ConstIterator &operator--() {
+                size_t count = map->entries.size();
+                slot = slot ? FrozenMap<Key_T, Mapped_T, Compare_T>::predecessor(slot, count)
+                            : FrozenMap<Key_T, Mapped_T, Compare_T>::last(count);
+                return *this;
+            }
+
+            ConstIterator operator++(int) {
+                ConstIterator copy(*this);
+                ++*this;
+                return copy;
+            }
+
+            ConstIterator operator--(int) {
+                ConstIterator copy(*this);
+                --*this;
+                return copy;
+            }
+
+            bool operator==(const ConstIterator &other) const {
+                return slot == other.slot;
+            }
+
+            bool operator!=(const ConstIterator &other) const {
+                return slot != other.slot;
+            }
+
+        private:
+            // The end is slot 0, which the 1-based layout leaves free
+            ConstIterator(const FrozenMap<Key_T, Mapped_T, Compare_T> *map, size_t slot) : map(map), slot(slot) {}
+
+            const FrozenMap<Key_T, Mapped_T, Compare_T> *map;
+            size_t slot;
+        };
+
+        ConstIterator begin() const {
+            return ConstIterator(this, first(entries.size()));
+        }
+
+        ConstIterator end() const {
+            return ConstIterator(this, 0);
+        }
+
+        // -- lookup, O(log n) comparisons and no data-dependent branch
+        ConstIterator find(const Key_T &key) const;
+
+        bool contains(const Key_T &key) const {
+            return this->find(key) != this->end();
+        }
+
+        size_t count(const Key_T &key) const {
+            return this->contains(key) ? 1 : 0;
+        }
+
+        const Mapped_T &at(const Key_T &key) const;
+
+        // First entry not ordered before `key`
+        ConstIterator lower_bound(const Key_T &key) const {
+            return ConstIterator(this, this->descend(key, std::false_type()));
+        }
+
+        // First entry ordered after `key`
+        ConstIterator upper_bound(const Key_T &key) const {
+            return ConstIterator(this, this->descend(key, std::true_type()));
+        }
+
+        std::pair<ConstIterator, ConstIterator> equal_range(const Key_T &key) const {
+            return {this->lower_bound(key), this->upper_bound(key)};
+        }
+
+        bool operator==(const FrozenMap &other) const;
+
+        bool operator!=(const FrozenMap &other) const {
+            return !(*this == other);
+        }
+
+    private:
+        // The keys a cache line holds, and so how many levels down a descent prefetches (the children of the
+        // descendants that far down fill one aligned line)
+        static constexpr size_t LINE_BYTES = 64;
+        static constexpr size_t KEYS_PER_LINE = sizeof(Key_T) < LINE_BYTES ? LINE_BYTES / sizeof(Key_T) : 1;
+
+        // Frees the key array: destroys the keys in slots 1 to count, then the line-aligned block
+        struct KeysDeleter {
+            size_t count = 0;
+
+            void operator()(Key_T *keys) const {
+                for (size_t slot = 1; slot <= count; ++slot)
+                    keys[slot].~Key_T();
+                ::operator delete(keys, std::align_val_t(LINE_BYTES));
+            }
+        };
+
+        Compare_T comp;
+        // Slot i of the layout is entries[i - 1] and keys.get()[i]
+        std::vector<value_type> entries;
+        std::unique_ptr<Key_T, KeysDeleter> keys;
+
+        void layKeys();
+
+        // Slot of the first entry matching, by `Upper_T`, lower_bound (not before `key`) or upper_bound (after it)
+        template<typename Upper_T>
+        size_t descend(const Key_T &key, Upper_T) const;
+
+        // Leftmost and rightmost slots of a layout of `count` entries, 0 when empty
+        static size_t first(size_t count) {
+            size_t slot = count ? 1 : 0;
+            while (slot && 2 * slot <= count)
+                slot = 2 * slot;
+            return slot;
+        }
+
+        static size_t last(size_t count) {
+            size_t slot = count ? 1 : 0;
+            while (slot && 2 * slot + 1 <= count)
+                slot = 2 * slot + 1;
+            return slot;
+        }
+
+        static size_t successor(size_t slot, size_t count);
+
+        static size_t predecessor(size_t slot, size_t count);
+
+        static unsigned trailingOnes(size_t slot) {
+#if defined(__GNUC__) || defined(__clang__)
+            return ~slot ? (unsigned) __builtin_ctzll(~(unsigned long long) slot) : (unsigned) (8 * sizeof(size_t));
+#else
+            unsigned ones = 0;
+            for (; slot & 1; slot >>= 1)
+                ++ones;
+            return ones;
+#endif
+        }
+
+        static void prefetch(const void *address) {
+#if defined(__GNUC__) || defined(__clang__)
+            __builtin_prefetch(address);
+#endif
+        }
+    };
+
+    // Numbers the slots in key order by walking them, then fills the array in slot order
+    template<typename Key_T, typename Mapped_T, typename Compare_T>
+    template<typename IT_T>
+    FrozenMap<Key_T, Mapped_T, Compare_T>::FrozenMap(IT_T first, IT_T last, const Compare_T &comp) : comp(comp) {
+        std::vector<value_type> sorted;
+        for (; first != last; ++first) {
+            if (!sorted.empty() && !this->comp(sorted.back().first, first->first))
+                throw std::out_of_range("FrozenMap entries are not in strictly ascending key order");
+            sorted.emplace_back(first->first, first->second);
+        }
+        size_t count = sorted.size(), position = 0;
+        std::vector<size_t> rank(count + 1);
+        for (size_t slot = FrozenMap::first(count); slot; slot = successor(slot, count))
+            rank[slot] = position++;
+        entries.reserve(count);
+        for (size_t slot = 1; slot <= count; ++slot)
+            entries.push_back(std::move(sorted[rank[slot]]));
+        this->layKeys();
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T>
+    void FrozenMap<Key_T, Mapped_T, Compare_T>::layKeys() {
+        size_t count = entries.size();
+        if (!count)
+            return;
+        std::unique_ptr<Key_T, KeysDeleter> laid(
+                (Key_T *) ::operator new(sizeof(Key_T) * (count + 1), std::align_val_t(LINE_BYTES)));
+        for (size_t slot = 1; slot <= count; ++slot) {
+            new(laid.get() + slot) Key_T(entries[slot - 1].first);
+            laid.get_deleter().count = slot;
+        }
+        this->keys = std::move(laid);
+    }
+
+    // Goes right wherever the slot's key is before `key` (or, for upper_bound, not after it), prefetching the line
+    // the descent reaches a few levels on. The slot index it falls off at spells out the path, a 1 bit per right
+    // turn: the answer is the slot where the path last turned left, found by dropping the trailing right turns and
+    // that left one.
+    template<typename Key_T, typename Mapped_T, typename Compare_T>
+    template<typename Upper_T>
+    size_t FrozenMap<Key_T, Mapped_T, Compare_T>::descend(const Key_T &key, Upper_T) const {
+        size_t count = entries.size(), slot = 1;
+        const Key_T *laid = keys.get();
+        while (slot <= count) {
+            size_t ahead = slot * KEYS_PER_LINE;
+            prefetch(laid + (ahead <= count ? ahead : 0));
+            if constexpr (Upper_T::value)
+                slot = 2 * slot + !comp(key, laid[slot]);
+            else
+                slot = 2 * slot + comp(laid[slot], key);
+        }
+        return slot >> (trailingOnes(slot) + 1);
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T>
+    typename FrozenMap<Key_T, Mapped_T, Compare_T>::ConstIterator FrozenMap<Key_T, Mapped_T, Compare_T>::find(const Key_T &key) const {
+        size_t slot = this->descend(key, std::false_type());
+        return ConstIterator(this, slot && !comp(key, keys.get()[slot]) ? slot : 0);
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T>
+    const Mapped_T &FrozenMap<Key_T, Mapped_T, Compare_T>::at(const Key_T &key) const {
+        ConstIterator it = this->find(key);
+        if (it == this->end())
+            throw std::out_of_range("specified key does not exist");
+        return it->second;
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T>
+    bool FrozenMap<Key_T, Mapped_T, Compare_T>::operator==(const FrozenMap &other) const {
+        return entries == other.entries;
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T>
+    size_t FrozenMap<Key_T, Mapped_T, Compare_T>::successor(size_t slot, size_t count) {
+        if (2 * slot + 1 <= count) {
+            for (slot = 2 * slot + 1; 2 * slot <= count;)
+                slot = 2 * slot;
+            return slot;
+        }
+        return slot >> (trailingOnes(slot) + 1);
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T>
+    size_t FrozenMap<Key_T, Mapped_T, Compare_T>::predecessor(size_t slot, size_t count) {
+        if (2 * slot <= count) {
+            for (slot = 2 * slot; 2 * slot + 1 <= count;)
+                slot = 2 * slot + 1;
+            return slot;
+        }
+        return slot >> (trailingOnes(~slot) + 1);
+    }
+
+}
+
+#endif // AVL_TREE_FROZEN_MAP
@@ -6,8 +6,18 @@
 #define AVL_TREE_MAP
 
 #include "tree/AVL.hpp"
+#include "tree/MapImage.hpp"
+#include "tree/MapStream.hpp"
+#include "tree/NodePool.hpp"
 
+#include <algorithm>
 #include <functional>
+#include <iterator>
+#include <limits>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <vector>
 #include <experimental/type_traits>
 
 using std::experimental::is_detected;
@@ -31,16 +41,81 @@ namespace cs540 {
         return false;
     }
 
-    template<typename Key_T, typename Mapped_T>
+    template<typename IT>
+    using forward_iterator_t = typename std::enable_if<std::is_base_of<
+            std::forward_iterator_tag, typename std::iterator_traits<IT>::iterator_category>::value>::type;
+
+    template<typename IT>
+    using is_forward_iterator = typename is_detected<forward_iterator_t, IT>::type;
+
+    // -- Aggregate_T policies for Map::aggregate, over the mapped values (see SubtreeAggregate in tree/AVL.hpp)
+    template<typename Value_T>
+    class SumAggregate {
+    public:
+        typedef Value_T value_type;
+
+        static Value_T identity() { return Value_T(); }
+
+        static Value_T combine(const Value_T &lhs, const Value_T &rhs) { return lhs + rhs; }
+
+        template<typename Entry_T>
+        static Value_T of(const Entry_T &entry) { return entry.second; }
+    };
+
+    template<typename Value_T>
+    class MinAggregate {
+    public:
+        typedef Value_T value_type;
+
+        static Value_T identity() { return std::numeric_limits<Value_T>::max(); }
+
+        static Value_T combine(const Value_T &lhs, const Value_T &rhs) { return rhs < lhs ? rhs : lhs; }
+
+        template<typename Entry_T>
+        static Value_T of(const Entry_T &entry) { return entry.second; }
+    };
+
+    template<typename Value_T>
+    class MaxAggregate {
+    public:
+        typedef Value_T value_type;
+
+        static Value_T identity() { return std::numeric_limits<Value_T>::lowest(); }
+
+        static Value_T combine(const Value_T &lhs, const Value_T &rhs) { return lhs < rhs ? rhs : lhs; }
+
+        template<typename Entry_T>
+        static Value_T of(const Entry_T &entry) { return entry.second; }
+    };
+
+    // Number of entries; the same answer as count_range, without needing OrderStatistics_T
+    class CountAggregate {
+    public:
+        typedef size_t value_type;
+
+        static size_t identity() { return 0; }
+
+        static size_t combine(size_t lhs, size_t rhs) { return lhs + rhs; }
+
+        template<typename Entry_T>
+        static size_t of(const Entry_T &) { return 1; }
+    };
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T = std::less<Key_T>,
+            typename Alloc_T = std::allocator<std::pair<const Key_T, Mapped_T>>, bool OrderStatistics_T = false,
+            typename Aggregate_T = void, bool Snapshots_T = false>
     class Map {
         using ValueType = std::pair<Key_T, Mapped_T>;
 
     public:
         class MapDataNode : public ValueType {
         public:
-            MapDataNode(const Key_T key, Mapped_T mappedItem) : ValueType({key, mappedItem}) {}
+            // Every std::pair constructor (converting, forwarding, piecewise), so entries can be built in place
+            using ValueType::ValueType;
+
+            MapDataNode(const ValueType &p) : ValueType(p) {}
 
-            MapDataNode(const ValueType &p) : MapDataNode(p.first, p.second) {}
+            MapDataNode(ValueType &&p) : ValueType(std::move(p)) {}
 
 //            MapDataNode(std::initializer_list <Mapped_T> list) : MapDataNode(list.begin(), list.begin() + 1) {}
 
@@ -67,117 +142,129 @@ namespace cs540 {
             bool operator==(const MapDataNode &node) const {
                 return this->first == node.first && this->second == node.second;
             }
-
-            MapDataNode operator=(const MapDataNode &other) const {
-                return MapDataNode(other);
-            }
-
-            MapDataNode operator=(const ValueType &other) const {
-                return MapDataNode(other);
-            }
         };
 
-        class MapKeyNode {
-        protected:
-            const Key_T key;
+        // Orders tree entries by key through Compare_T. The key overloads let a lookup compare the probe straight
+        // against the entries, without wrapping (or, with a transparent Compare_T, even constructing) a Key_T.
+        class DataCompare : private CompareHolder<Compare_T> {
         public:
-            MapKeyNode(const Key_T key) : key(key) {}
+            DataCompare(const Compare_T &comp) : CompareHolder<Compare_T>(comp) {}
 
-            const Key_T &getKey() {
-                return key;
-            }
-
-            bool operator<(const typename Map<Key_T, Mapped_T>::MapKeyNode &node) const {
-                return key < node.key;
+            const Compare_T &key_comp() const {
+                return this->compare();
             }
 
-            bool operator==(const typename Map<Key_T, Mapped_T>::MapKeyNode &node) const {
-                return key == node.key;
+            bool operator()(const MapDataNode &lhs, const MapDataNode &rhs) const {
+                return this->compare()(lhs.first, rhs.first);
             }
 
-            bool operator<(const typename Map<Key_T, Mapped_T>::MapDataNode &node) const {
-                return key < node.first;
+            template<typename K>
+            bool operator()(const MapDataNode &lhs, const K &key) const {
+                return this->compare()(lhs.first, key);
             }
 
-            bool operator==(const typename Map<Key_T, Mapped_T>::MapDataNode &node) const {
-                return key == node.first;
+            template<typename K>
+            bool operator()(const K &key, const MapDataNode &rhs) const {
+                return this->compare()(key, rhs.first);
             }
         };
 
+        using TreeType = AVL<MapDataNode, DataCompare,
+                typename std::allocator_traits<Alloc_T>::template rebind_alloc<MapDataNode>, OrderStatistics_T, Aggregate_T, Snapshots_T>;
+
         class Iterator {
-            friend Map<Key_T, Mapped_T>;
+            friend Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>;
         public:
-            Iterator(const Iterator &it) : Iterator(it.it) {}
-
-            virtual ~Iterator() {}
-
-            virtual void inc() {
-                it.next();
-            }
-
-            virtual void dec() {
-                it.prev();
-            }
+            typedef std::bidirectional_iterator_tag iterator_category;
+            typedef ValueType value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef ValueType *pointer;
+            typedef ValueType &reference;
 
             ValueType &operator*() const {
-                return this->it.get();
+                return TreeType::writable(this->it);
             }
 
             ValueType *operator->() const {
-                return &(this->it.get());
+                return &TreeType::writable(this->it);
             }
 
             // Prefix inc/dec
             Iterator &operator++() {
-                this->inc();
+                it.next();
                 return *this;
             }
 
             Iterator &operator--() {
-                this->dec();
+                it.prev();
                 return *this;
             }
 
             // Postfix inc/dec
             Iterator operator++(int) {
                 Iterator old = *this;
-                this->inc();
+                it.next();
                 return old;
             }
 
             Iterator operator--(int) {
                 Iterator old = *this;
-                this->dec();
+                it.prev();
                 return old;
             }
 
-            bool operator==(const typename Map<Key_T, Mapped_T>::Iterator &other) {
+            // O(log n) jumps and distances, only on a Map with OrderStatistics_T
+            Iterator &operator+=(difference_type offset) {
+                it.advance(offset);
+                return *this;
+            }
+
+            Iterator &operator-=(difference_type offset) {
+                it.advance(-offset);
+                return *this;
+            }
+
+            Iterator operator+(difference_type offset) const {
+                Iterator moved = *this;
+                return moved += offset;
+            }
+
+            Iterator operator-(difference_type offset) const {
+                Iterator moved = *this;
+                return moved -= offset;
+            }
+
+            difference_type operator-(const Iterator &other) const {
+                return (difference_type) it.index() - (difference_type) other.it.index();
+            }
+
+            bool operator==(const typename Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::Iterator &other) const {
                 return this->it == other.it;
             }
 
-            bool operator!=(const typename Map<Key_T, Mapped_T>::Iterator &other) {
+            bool operator!=(const typename Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::Iterator &other) const {
                 return this->it != other.it;
             }
 
         protected:
-            typename AVL<MapDataNode>::Iterator it;
+            // Moved onto a copy when a write goes through an entry still shared with a snapshot
+            mutable typename TreeType::Iterator it;
 
-            Iterator(const AVL<MapDataNode> &tree) : Iterator(tree.begin()) {}
+            Iterator(const TreeType &tree) : Iterator(tree.begin()) {}
 
-            Iterator(const AVL<MapDataNode> &tree, const MapDataNode &node) : Iterator(tree.begin(node)) {}
+            Iterator(const TreeType &tree, const MapDataNode &node) : Iterator(tree.begin(node)) {}
 
-            Iterator(const typename AVL<MapDataNode>::Iterator &it) : it(it) {}
+            Iterator(const typename TreeType::Iterator &it) : it(it) {}
 
         };
 
         class ConstIterator : public Iterator {
-            friend Map<Key_T, Mapped_T>;
+            friend Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>;
         public:
-            ConstIterator(const Iterator &it) : Iterator(it) {}
-
-            ConstIterator(const ConstIterator &it) : Iterator(it) {}
+            typedef const ValueType *pointer;
+            typedef const ValueType &reference;
 
-            ~ConstIterator() {}
+            ConstIterator(const Iterator &it) : Iterator(it) {}
 
             const ValueType &operator*() const {
                 return this->it.get();
@@ -188,45 +275,115 @@ namespace cs540 {
             }
 
         protected:
-            ConstIterator(const AVL<MapDataNode> &tree) : Iterator(tree) {}
+            ConstIterator(const TreeType &tree) : Iterator(tree) {}
 
-            ConstIterator(const AVL<MapDataNode> &tree, const MapDataNode &node) : Iterator(tree, node) {}
+            ConstIterator(const TreeType &tree, const MapDataNode &node) : Iterator(tree, node) {}
 
-            ConstIterator(const typename AVL<MapDataNode>::Iterator &it) : Iterator(it) {}
+            ConstIterator(const typename TreeType::Iterator &it) : Iterator(it) {}
         };
 
-        class ReverseIterator : public Iterator {
-            friend Map<Key_T, Mapped_T>;
+        class ReverseIterator {
+            friend Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>;
         public:
-            ReverseIterator(const ReverseIterator &it) : Iterator(it) {}
+            typedef std::bidirectional_iterator_tag iterator_category;
+            typedef ValueType value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef ValueType *pointer;
+            typedef ValueType &reference;
+
+            ValueType &operator*() const {
+                return TreeType::writable(this->it);
+            }
 
-            ~ReverseIterator() {}
+            ValueType *operator->() const {
+                return &TreeType::writable(this->it);
+            }
+
+            // Prefix inc/dec
+            ReverseIterator &operator++() {
+                it.next();
+                return *this;
+            }
+
+            ReverseIterator &operator--() {
+                it.prev();
+                return *this;
+            }
+
+            // Postfix inc/dec
+            ReverseIterator operator++(int) {
+                ReverseIterator old = *this;
+                it.next();
+                return old;
+            }
+
+            ReverseIterator operator--(int) {
+                ReverseIterator old = *this;
+                it.prev();
+                return old;
+            }
+
+            bool operator==(const typename Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::ReverseIterator &other) const {
+                return this->it == other.it;
+            }
+
+            bool operator!=(const typename Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::ReverseIterator &other) const {
+                return this->it != other.it;
+            }
 
         protected:
-            ReverseIterator(AVL<MapDataNode> &tree) : Iterator(tree.rbegin()) {}
+            mutable typename TreeType::ReverseIterator it;
 
-            ReverseIterator(const typename AVL<MapDataNode>::ReverseIterator &it) : Iterator(it) {}
+            ReverseIterator(const typename TreeType::ReverseIterator &it) : it(it) {}
         };
 
         // -- constructing
-        Map() : tree(false) {}
+        Map() : tree(false, DataCompare(Compare_T())) {}
+
+        explicit Map(const Compare_T &comp, const Alloc_T &alloc = Alloc_T()) : tree(false, DataCompare(comp), alloc) {}
+
+        explicit Map(const Alloc_T &alloc) : tree(false, DataCompare(Compare_T()), alloc) {}
 
-        Map(std::initializer_list <std::pair<const Key_T, Mapped_T>> list) : tree(false) {
-            for (std::pair<const Key_T, Mapped_T> p : list)
-                this->insert(p);
+        Map(std::initializer_list <std::pair<const Key_T, Mapped_T>> list, const Compare_T &comp = Compare_T(),
+            const Alloc_T &alloc = Alloc_T())
+                : tree(false, DataCompare(comp), alloc) {
+            this->insert(list.begin(), list.end());
         }
 
-        Map(const Map<Key_T, Mapped_T> &map) : tree(map.tree) {}
+        // With Snapshots_T, O(1): the copy borrows the entries, and each map copies the ones it shares on their first
+        // write, as after a snapshot (see below). Otherwise every entry is copied.
+        Map(const Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &map) : tree(map.tree) {}
+
+        // Copies the tree with its subtrees cloned in parallel (see AVL::cloneFrom)
+        Map(const Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &map, const ParallelMode &mode) : tree(map.tree, mode) {}
+
+        // O(1): the nodes change owner, `map` is left empty
+        Map(Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &&map) noexcept : tree(std::move(map.tree)) {}
 
         ~Map() {
             this->clear();
         }
 
-        Map<Key_T, Mapped_T> &operator=(const Map<Key_T, Mapped_T> &other) {
-            this->clear();
-            this->tree = other.tree;
+        Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &operator=(const Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &other) {
+            if (&other != this) {
+                this->clear();
+                this->tree = other.tree;
+            }
+            return *this;
+//            return Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>(other);
+        }
+
+        Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &operator=(Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &&other) {
+            this->tree = std::move(other.tree);
             return *this;
-//            return Map<Key_T, Mapped_T>(other);
+        }
+
+        Alloc_T get_allocator() const {
+            return Alloc_T(tree.get_allocator());
+        }
+
+        Compare_T key_comp() const {
+            return tree.value_comp().key_comp();
         }
 
         // -- size:
@@ -234,6 +391,13 @@ namespace cs540 {
 
         bool empty() const;
 
+        // -- memory:
+        typedef struct {
+            size_t nodes, nodeBytes, payloadBytes, overheadPerNode, totalBytes;
+        } Footprint;
+
+        Footprint memory_footprint() const;
+
         // -- element access:
         Mapped_T &at(const Key_T &);
 
@@ -243,14 +407,69 @@ namespace cs540 {
 
         ConstIterator find(const Key_T &) const;
 
+        // Heterogeneous lookups, only available when Compare_T is transparent (declares is_transparent)
+        template<typename K, typename C = Compare_T, typename = typename C::is_transparent>
+        Mapped_T &at(const K &);
+
+        template<typename K, typename C = Compare_T, typename = typename C::is_transparent>
+        const Mapped_T &at(const K &) const;
+
+        template<typename K, typename C = Compare_T, typename = typename C::is_transparent>
+        Iterator find(const K &);
+
+        template<typename K, typename C = Compare_T, typename = typename C::is_transparent>
+        ConstIterator find(const K &) const;
+
+        // -- ordered lookup:
+        Iterator lower_bound(const Key_T &);
+
+        ConstIterator lower_bound(const Key_T &) const;
+
+        Iterator upper_bound(const Key_T &);
+
+        ConstIterator upper_bound(const Key_T &) const;
+
+        std::pair<Iterator, Iterator> equal_range(const Key_T &);
+
+        std::pair<ConstIterator, ConstIterator> equal_range(const Key_T &) const;
+
+        template<typename K, typename C = Compare_T, typename = typename C::is_transparent>
+        Iterator lower_bound(const K &);
+
+        template<typename K, typename C = Compare_T, typename = typename C::is_transparent>
+        ConstIterator lower_bound(const K &) const;
+
+        template<typename K, typename C = Compare_T, typename = typename C::is_transparent>
+        Iterator upper_bound(const K &);
+
+        template<typename K, typename C = Compare_T, typename = typename C::is_transparent>
+        ConstIterator upper_bound(const K &) const;
+
+        template<typename K, typename C = Compare_T, typename = typename C::is_transparent>
+        std::pair<Iterator, Iterator> equal_range(const K &);
+
+        template<typename K, typename C = Compare_T, typename = typename C::is_transparent>
+        std::pair<ConstIterator, ConstIterator> equal_range(const K &) const;
+
+        // -- batched lookups:
+        // Looks up `count` keys with their descents interleaved and prefetched (see BST::searchNodes), writing each
+        // key's entry, or end(), to out[i]. Pays off from a few dozen keys on a tree that does not fit in cache.
+        void find_many(const Key_T *keys, size_t count, Iterator *out);
+
+        void find_many(const Key_T *keys, size_t count, ConstIterator *out) const;
+
+        void contains_many(const Key_T *keys, size_t count, bool *out) const;
+
         Mapped_T &operator[](const Key_T &key);
 
+        Mapped_T &operator[](Key_T &&key);
+
         // -- iterators
         Iterator begin() {
             return Iterator(tree);
         }
 
-        Iterator begin(const typename Map<Key_T, Mapped_T>::MapDataNode &node) {
+        Iterator begin(const typename Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::MapDataNode &node) {
             return Iterator(tree, node);
         }
 
@@ -270,43 +489,278 @@ namespace cs540 {
             return ConstIterator(tree.end());
         }
 
-        Map<Key_T, Mapped_T>::ReverseIterator rbegin() {
-            return Map<Key_T, Mapped_T>::ReverseIterator(tree.rbegin());
+        Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::ReverseIterator rbegin() {
+            return Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::ReverseIterator(tree.rbegin());
         }
 
-        Map<Key_T, Mapped_T>::ReverseIterator rend() {
-            return Map<Key_T, Mapped_T>::ReverseIterator(tree.rend());
+        Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::ReverseIterator rend() {
+            return Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::ReverseIterator(tree.rend());
         }
 
         // -- modifiers:
         std::pair<Iterator, bool> insert(const std::pair<const Key_T, Mapped_T> &);
 
+        std::pair<Iterator, bool> insert(std::pair<const Key_T, Mapped_T> &&);
+
+        // Constructs the entry in its node from std::pair constructor arguments; it is discarded if the key exists
+        template<typename... Args>
+        std::pair<Iterator, bool> emplace(Args &&...);
+
+        // Only constructs (in place, from `args`) when `key` is absent; otherwise neither `key` nor `args` are touched
+        template<typename... Args>
+        std::pair<Iterator, bool> try_emplace(const Key_T &key, Args &&...args);
+
+        template<typename... Args>
+        std::pair<Iterator, bool> try_emplace(Key_T &&key, Args &&...args);
+
+        template<typename M>
+        std::pair<Iterator, bool> insert_or_assign(const Key_T &key, M &&mapped);
+
+        template<typename M>
+        std::pair<Iterator, bool> insert_or_assign(Key_T &&key, M &&mapped);
+
+        // Into an empty Map, a sorted forward range is bulk-loaded (see assign_sorted)
         template<typename IT_T>
         void insert(IT_T range_beg, IT_T range_end);
 
+        // -- bulk loading:
+        // Replace the contents with a forward range. If the keys are strictly ascending (checked in one O(n) pass of
+        // key comparisons) the tree is built bottom-up in O(n); otherwise the items are inserted one by one. With a
+        // ParallelMode, a random access range is built in parallel (see AVL::assignSorted).
+        template<typename IT_T>
+        void assign_sorted(IT_T range_beg, IT_T range_end, const ParallelMode &mode = ParallelMode());
+
+        template<typename IT_T>
+        static Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> from_sorted(IT_T range_beg, IT_T range_end,
+                                                                    const Compare_T &comp = Compare_T(),
+                                                                    const Alloc_T &alloc = Alloc_T());
+
+        template<typename IT_T>
+        static Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> from_sorted(IT_T range_beg, IT_T range_end, const ParallelMode &mode,
+                                                                    const Compare_T &comp = Compare_T(),
+                                                                    const Alloc_T &alloc = Alloc_T());
+
+        // -- split and join, O(log n) (see AVL::split and AVL::join):
+        // Moves the entries with keys not before `key` into the returned Map
+        Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> split_at(const Key_T &key);
+
+        // Appends `other`, whose keys must all come after this Map's, and leaves it empty
+        void concat(Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &other);
+
+        void concat(Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &&other) { this->concat(other); }
+
+        // -- set operations, O(m log(n/m + 1)) for maps of m <= n entries. They consume `other`, leaving it empty.
+        // With a ParallelMode, the pieces above the grain are combined in parallel.
+        // Keys present in both keep this Map's value
+        void merge_union(Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &other, const ParallelMode &mode = ParallelMode());
+
+        void merge_union(Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &&other, const ParallelMode &mode = ParallelMode()) {
+            this->merge_union(other, mode);
+        }
+
+        void intersection(Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &other, const ParallelMode &mode = ParallelMode());
+
+        void intersection(Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &&other, const ParallelMode &mode = ParallelMode()) {
+            this->intersection(other, mode);
+        }
+
+        void difference(Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &other, const ParallelMode &mode = ParallelMode());
+
+        void difference(Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &&other, const ParallelMode &mode = ParallelMode()) {
+            this->difference(other, mode);
+        }
+
+        // -- batches:
+        // One change of a batch: sets `key` to `mapped`, or erases `key` when `mapped` is empty
+        struct BatchEntry {
+            Key_T key;
+            std::optional<Mapped_T> mapped;
+        };
+
+        enum class BatchOutcome {
+            INSERTED, UPDATED, ERASED, NOT_FOUND
+        };
+
+        // Sorts the batch by key and applies it in one ordered pass of splits and joins (see AVL::applySorted),
+        // O(m log(n/m + 1)) for m changes. Where a key comes up more than once, its last change wins. Returns each
+        // entry's outcome, in batch order, as if the entries had been applied one after the other, without looking
+        // any key up again; unlike erase(key), a missing key is reported rather than thrown. The winning changes'
+        // keys and values are moved into the map. Iterators stay valid except to erased entries.
+        std::vector<BatchOutcome> apply_batch(BatchEntry *entries, size_t count);
+
+        std::vector<BatchOutcome> apply_batch(std::vector<BatchEntry> &batch) {
+            return this->apply_batch(batch.data(), batch.size());
+        }
+
         void erase(const Key_T &);
 
         void erase(Iterator);
 
+        // Removes [first, last); returns `last`
+        Iterator erase(Iterator first, Iterator last);
+
+        // -- order statistics (only with OrderStatistics_T), all O(log n):
+        // Number of keys ordered before `key`
+        size_t rank(const Key_T &) const;
+
+        template<typename K, typename C = Compare_T, typename = typename C::is_transparent>
+        size_t rank(const K &) const;
+
+        // The entry at position `index` in key order (end() for index == size())
+        Iterator select(size_t index);
+
+        ConstIterator select(size_t index) const;
+
+        // Number of keys in [lo, hi)
+        size_t count_range(const Key_T &lo, const Key_T &hi) const;
+
+        // -- aggregates (only with an Aggregate_T policy):
+        // The tree keeps them current through insert/emplace/insert_or_assign/erase. A mapped value changed any other
+        // way (operator[], at, through an iterator) must be followed by refresh() on its entry.
+        typedef typename TreeType::aggregate_type aggregate_type;
+
+        // Combination of the entries with keys in [lo, hi), in key order, O(log n)
+        aggregate_type aggregate(const Key_T &lo, const Key_T &hi) const;
+
+        // Combination of every entry, O(1)
+        aggregate_type aggregate() const;
+
+        void refresh(Iterator);
+
         void clear();
 
+        // -- persistence (only with trivially copyable keys and mapped values):
+        // Writes the entries to `path` as a position-independent image (see MapImage) that MappedMap::open maps and
+        // reads in place; it must be opened with the same Compare_T. Throws std::system_error when it cannot write.
+        void save(const std::string &path) const;
+
+        // -- streaming (with a Codec for Key_T and Mapped_T, see MapStreamFormat):
+        // Writes the entries to `out` in blocks of about `block_bytes`, each followed by its CRC-32 if `checksums`.
+        // Throws std::ios_base::failure when `out` fails.
+        void write_to(std::ostream &out, bool checksums = true, size_t block_bytes = MapStreamFormat::BLOCK_BYTES) const;
+
+        // Replaces the contents with a stream written by write_to. The entries are decoded a block at a time straight
+        // into a bottom-up build (see AVL::assignSorted), O(n), then checked to be in key order. Throws
+        // std::ios_base::failure when `in` ends early and std::runtime_error when the stream is damaged; either way
+        // the map is left as it was.
+        void read_from(std::istream &in);
+
+        // -- snapshots (only with Snapshots_T):
+        // A read-only view of the map as it was, taken in O(1) (see AVL::Snapshot). It can be read from any thread
+        // while the map goes on changing, and outlives the map if need be. Entries still shared with a live snapshot
+        // are copied on their first write afterwards, so Mapped_T has to be copyable, and a write through an iterator
+        // (or operator[], at) moves the entry and the ones above it in the tree: other iterators to them are then
+        // invalidated. Copies of the map share entries the same way.
+        class Snapshot {
+            friend Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>;
+        public:
+            class ConstIterator {
+                friend Snapshot;
+            public:
+                typedef std::forward_iterator_tag iterator_category;
+                typedef ValueType value_type;
+                typedef std::ptrdiff_t difference_type;
+                typedef const ValueType *pointer;
+                typedef const ValueType &reference;
+
+                const ValueType &operator*() const {
+                    return this->it.get();
+                }
+
+                const ValueType *operator->() const {
+                    return &(this->it.get());
+                }
+
+                ConstIterator &operator++() {
+                    it.next();
+                    return *this;
+                }
+
+                ConstIterator operator++(int) {
+                    ConstIterator old = *this;
+                    it.next();
+                    return old;
+                }
+
+                bool operator==(const ConstIterator &other) const {
+                    return this->it == other.it;
+                }
+
+                bool operator!=(const ConstIterator &other) const {
+                    return this->it != other.it;
+                }
+
+            protected:
+                typename TreeType::Snapshot::Iterator it;
+
+                ConstIterator(const typename TreeType::Snapshot::Iterator &it) : it(it) {}
+            };
+
+            Snapshot() = default;
+
+            size_t size() const {
+                return snapshot.nodeCount();
+            }
+
+            bool empty() const {
+                return snapshot.empty();
+            }
+
+            ConstIterator begin() const {
+                return ConstIterator(snapshot.begin());
+            }
+
+            ConstIterator end() const {
+                return ConstIterator(snapshot.end());
+            }
+
+            ConstIterator find(const Key_T &key) const {
+                return ConstIterator(snapshot.find(key));
+            }
+
+            ConstIterator lower_bound(const Key_T &key) const {
+                return ConstIterator(snapshot.lowerBound(key));
+            }
+
+            ConstIterator upper_bound(const Key_T &key) const {
+                return ConstIterator(snapshot.upperBound(key));
+            }
+
+            const Mapped_T &at(const Key_T &key) const {
+                typename TreeType::Snapshot::Iterator it = snapshot.find(key);
+                if (!it.hasNext())
+                    throw std::out_of_range("specified key does not exist");
+                return it.get().second;
+            }
+
+        protected:
+            typename TreeType::Snapshot snapshot;
+
+            Snapshot(const typename TreeType::Snapshot &snapshot) : snapshot(snapshot) {}
+        };
+
+        Snapshot snapshot() {
+            return Snapshot(tree.snapshot());
+        }
+
         // -- equality:
-        bool operator==(const Map<Key_T, Mapped_T> &other) {
+        bool operator==(const Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &other) {
             return this->size() == other.size() && this->tree == other.tree;
         }
 
-        bool operator!=(const Map<Key_T, Mapped_T> &other) {
+        bool operator!=(const Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &other) {
             return this->size() != other.size() || this->tree != other.tree;
         }
 
-        bool operator<(const Map<Key_T, Mapped_T> &other) {
-            typename AVL<MapDataNode>::Iterator it1(this->tree.begin()), it2(other.tree.begin());
+        bool operator<(const Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &other) {
+            typename TreeType::Iterator it1(this->tree.begin()), it2(other.tree.begin());
+            const Compare_T &comp = this->tree.value_comp().key_comp();
             bool lt;
             while (it1.hasNext() && it2.hasNext()) {
                 lt = (
-                        it1.get().first < it2.get().first ||
+                        comp(it1.get().first, it2.get().first) ||
                         (
-                                it1.get().first == it2.get().first &&
+                                !comp(it2.get().first, it1.get().first) &&
                                 do_compare(
                                         it1.get().second, it2.get().second, has_less_than<Mapped_T>{}
                                 )
@@ -320,147 +774,608 @@ namespace cs540 {
             return it2.hasNext();
         }
 
-        const std::function<short int(const MapKeyNode &, MapDataNode &)> key_data_comp_val =
-                [](const MapKeyNode &key,
-                   MapDataNode &data) {
-                    return key < data ? -1 : key == data ? 0 : 1;
-                };
+    protected:
+        TreeType tree;
 
-//        const static std::function<short int(const MapKeyNode &, MapDataNode &)> &key_data_comp() {
-//            return key_data_comp_val;
-//        }
+        // The changes of a batch to one key, as a range [first, second) of the sorted batch order
+        typedef std::pair<size_t, size_t> BatchRun;
 
-    protected:
-        AVL<MapDataNode> tree;
+        // Hands the runs to AVL::applySorted and reports their outcomes
+        class BatchApplier {
+        public:
+            BatchEntry *entries;
+            const size_t *order;
+            BatchOutcome *outcomes;
 
-        MapDataNode *get_data_node(const Key_T &) const;
+            const Key_T &key(const BatchRun &run) const {
+                return entries[order[run.first]].key;
+            }
 
-        MapDataNode *get_data_node(const MapDataNode &) const;
+            bool update(const BatchRun &run, MapDataNode &data) {
+                BatchEntry &last = this->settle(run, true);
+                if (!last.mapped)
+                    return false;
+                data.second = std::move(*last.mapped);
+                return true;
+            }
 
-    };
+            bool insert(const BatchRun &run) {
+                return this->settle(run, false).mapped.has_value();
+            }
 
-#endif // AVL_TREE_MAP
+            MapDataNode make(const BatchRun &run) {
+                BatchEntry &last = entries[order[run.second - 1]];
+                return MapDataNode(std::move(last.key), std::move(*last.mapped));
+            }
+
+        private:
+            // Reports the run's outcomes, given whether the key was there before it, and returns its last change
+            BatchEntry &settle(const BatchRun &run, bool present) {
+                for (size_t i = run.first; i < run.second; ++i) {
+                    bool upsert = entries[order[i]].mapped.has_value();
+                    outcomes[order[i]] = upsert ? (present ? BatchOutcome::UPDATED : BatchOutcome::INSERTED)
+                                                : (present ? BatchOutcome::ERASED : BatchOutcome::NOT_FOUND);
+                    present = upsert;
+                }
+                return entries[order[run.second - 1]];
+            }
+        };
+
+        template<typename K>
+        MapDataNode *get_data_node(const K &) const;
+
+        template<typename IT_T>
+        void insert(IT_T range_beg, IT_T range_end, std::true_type);
+
+        template<typename IT_T>
+        void insert(IT_T range_beg, IT_T range_end, std::false_type);
+
+    };
 
 
 // - protected
 // -- element access
-    template<typename Key_T, typename Mapped_T>
-    typename Map<Key_T, Mapped_T>::MapDataNode *Map<Key_T, Mapped_T>::get_data_node(const Key_T &key) const {
-        return tree.search(MapKeyNode(key), key_data_comp_val);
-    }
-
-    template<typename Key_T, typename Mapped_T>
-    typename Map<Key_T, Mapped_T>::MapDataNode *
-    Map<Key_T, Mapped_T>::get_data_node(const typename Map<Key_T, Mapped_T>::MapDataNode &node) const {
-        return get_data_node(node.first);
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    template<typename K>
+    typename Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::MapDataNode *
+    Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::get_data_node(const K &key) const {
+        return tree.search(key);
     }
 
 // - public:
 // -- size:
-    template<typename Key_T, typename Mapped_T>
-    size_t Map<Key_T, Mapped_T>::size() const {
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    size_t Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::size() const {
         return tree.nodeCount();
     }
 
-    template<typename Key_T, typename Mapped_T>
-    bool Map<Key_T, Mapped_T>::empty() const {
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    bool Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::empty() const {
         return tree.empty();
     }
 
+// -- memory:
+    // Bytes taken by the tree nodes (excluding whatever the keys and values own on the heap); overheadPerNode is what
+    // each entry costs on top of its key/value pair
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    typename Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::Footprint Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::memory_footprint() const {
+        Footprint footprint;
+        footprint.nodes = this->size();
+        footprint.nodeBytes = TreeType::nodeSize();
+        footprint.payloadBytes = sizeof(ValueType);
+        footprint.overheadPerNode = footprint.nodeBytes - footprint.payloadBytes;
+        footprint.totalBytes = sizeof(*this) + footprint.nodes * footprint.nodeBytes;
+        return footprint;
+    }
+
 // -- element access:
-    template<typename Key_T, typename Mapped_T>
-    Mapped_T &Map<Key_T, Mapped_T>::operator[](const Key_T &key) {
-        MapKeyNode keyNode(key);
-        MapDataNode *dataNodePtr = tree.search(keyNode, key_data_comp_val);
-        if (!dataNodePtr) {
-            MapDataNode dataNode(key, Mapped_T());
-            tree.insert(dataNode);
-            return dataNode.getMappedItem();
-        }
-        return dataNodePtr->getMappedItem();
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    Mapped_T &Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::operator[](const Key_T &key) {
+        return this->try_emplace(key).first->second;
     }
 
-    template<typename Key_T, typename Mapped_T>
-    Mapped_T &Map<Key_T, Mapped_T>::at(const Key_T &key) {
-        MapDataNode *node = this->get_data_node(key);
-        if (!node)
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    Mapped_T &Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::operator[](Key_T &&key) {
+        return this->try_emplace(std::move(key)).first->second;
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    Mapped_T &Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::at(const Key_T &key) {
+        typename TreeType::Iterator it = tree.find(key);
+        if (!it.hasNext())
             throw std::out_of_range("specified key does not exist");
-        return node->getMappedItem();
+        return TreeType::writable(it).getMappedItem();
     }
 
-    template<typename Key_T, typename Mapped_T>
-    const Mapped_T &Map<Key_T, Mapped_T>::at(const Key_T &key) const {
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    const Mapped_T &Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::at(const Key_T &key) const {
         const MapDataNode *node = this->get_data_node(key);
         if (!node)
             throw std::out_of_range("specified key does not exist");
         return node->second;
     }
 
-    template<typename Key_T, typename Mapped_T>
-    typename Map<Key_T, Mapped_T>::Iterator Map<Key_T, Mapped_T>::find(const Key_T &key) {
-        const MapDataNode *node = this->get_data_node(key);
-        return node ? begin(*node) : end();
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    typename Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::Iterator Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::find(const Key_T &key) {
+        return Iterator(tree.find(key));
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    typename Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::ConstIterator Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::find(const Key_T &key) const {
+        return ConstIterator(tree.find(key));
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    void Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::find_many(const Key_T *keys, size_t count, Iterator *out) {
+        tree.findMany(keys, count, [out](size_t index, const typename TreeType::Iterator &it) {
+            out[index] = Iterator(it);
+        });
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    void Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::find_many(const Key_T *keys, size_t count, ConstIterator *out) const {
+        tree.findMany(keys, count, [out](size_t index, const typename TreeType::Iterator &it) {
+            out[index] = ConstIterator(it);
+        });
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    void Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::contains_many(const Key_T *keys, size_t count, bool *out) const {
+        tree.findMany(keys, count, [out](size_t index, const typename TreeType::Iterator &it) {
+            out[index] = it.hasNext();
+        });
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    template<typename K, typename C, typename>
+    Mapped_T &Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::at(const K &key) {
+        typename TreeType::Iterator it = tree.find(key);
+        if (!it.hasNext())
+            throw std::out_of_range("specified key does not exist");
+        return TreeType::writable(it).getMappedItem();
     }
 
-    template<typename Key_T, typename Mapped_T>
-    typename Map<Key_T, Mapped_T>::ConstIterator Map<Key_T, Mapped_T>::find(const Key_T &key) const {
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    template<typename K, typename C, typename>
+    const Mapped_T &Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::at(const K &key) const {
         const MapDataNode *node = this->get_data_node(key);
-        return node ? begin(*node) : end();
+        if (!node)
+            throw std::out_of_range("specified key does not exist");
+        return node->second;
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    template<typename K, typename C, typename>
+    typename Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::Iterator Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::find(const K &key) {
+        return Iterator(tree.find(key));
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    template<typename K, typename C, typename>
+    typename Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::ConstIterator
+    Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::find(const K &key) const {
+        return ConstIterator(tree.find(key));
+    }
+
+// -- ordered lookup:
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    typename Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::Iterator Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::lower_bound(const Key_T &key) {
+        return Iterator(tree.lowerBound(key));
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    typename Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::ConstIterator Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::lower_bound(const Key_T &key) const {
+        return ConstIterator(tree.lowerBound(key));
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    template<typename K, typename C, typename>
+    typename Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::Iterator Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::lower_bound(const K &key) {
+        return Iterator(tree.lowerBound(key));
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    template<typename K, typename C, typename>
+    typename Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::ConstIterator Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::lower_bound(const K &key) const {
+        return ConstIterator(tree.lowerBound(key));
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    typename Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::Iterator Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::upper_bound(const Key_T &key) {
+        return Iterator(tree.upperBound(key));
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    typename Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::ConstIterator Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::upper_bound(const Key_T &key) const {
+        return ConstIterator(tree.upperBound(key));
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    template<typename K, typename C, typename>
+    typename Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::Iterator Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::upper_bound(const K &key) {
+        return Iterator(tree.upperBound(key));
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    template<typename K, typename C, typename>
+    typename Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::ConstIterator Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::upper_bound(const K &key) const {
+        return ConstIterator(tree.upperBound(key));
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    std::pair<typename Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::Iterator, typename Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::Iterator>
+    Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::equal_range(const Key_T &key) {
+        auto range = tree.equalRange(key);
+        return {Iterator(range.first), Iterator(range.second)};
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    std::pair<typename Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::ConstIterator, typename Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::ConstIterator>
+    Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::equal_range(const Key_T &key) const {
+        auto range = tree.equalRange(key);
+        return {ConstIterator(range.first), ConstIterator(range.second)};
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    template<typename K, typename C, typename>
+    std::pair<typename Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::Iterator, typename Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::Iterator>
+    Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::equal_range(const K &key) {
+        auto range = tree.equalRange(key);
+        return {Iterator(range.first), Iterator(range.second)};
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    template<typename K, typename C, typename>
+    std::pair<typename Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::ConstIterator, typename Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::ConstIterator>
+    Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::equal_range(const K &key) const {
+        auto range = tree.equalRange(key);
+        return {ConstIterator(range.first), ConstIterator(range.second)};
     }
 
 // -- modifiers:
-    template<typename Key_T, typename Mapped_T>
-    std::pair<typename Map<Key_T, Mapped_T>::Iterator, bool>
-    Map<Key_T, Mapped_T>::insert(const std::pair<const Key_T, Mapped_T> &pair) {
-        const MapDataNode node(pair);
-        bool new_inserted;
-        if ((new_inserted = !get_data_node(node))) {
-            tree.insert(node);
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    std::pair<typename Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::Iterator, bool>
+    Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::insert(const std::pair<const Key_T, Mapped_T> &pair) {
+        auto inserted = tree.findOrEmplace(pair.first, pair);
+        return {Iterator(inserted.first), inserted.second};
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    std::pair<typename Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::Iterator, bool>
+    Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::insert(std::pair<const Key_T, Mapped_T> &&pair) {
+        auto inserted = tree.findOrEmplace(pair.first, std::move(pair));
+        return {Iterator(inserted.first), inserted.second};
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    template<typename... Args>
+    std::pair<typename Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::Iterator, bool>
+    Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::emplace(Args &&...args) {
+        auto inserted = tree.emplace(std::forward<Args>(args)...);
+        return {Iterator(inserted.first), inserted.second};
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    template<typename... Args>
+    std::pair<typename Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::Iterator, bool>
+    Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::try_emplace(const Key_T &key, Args &&...args) {
+        auto inserted = tree.findOrEmplace(key, std::piecewise_construct, std::forward_as_tuple(key),
+                                           std::forward_as_tuple(std::forward<Args>(args)...));
+        return {Iterator(inserted.first), inserted.second};
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    template<typename... Args>
+    std::pair<typename Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::Iterator, bool>
+    Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::try_emplace(Key_T &&key, Args &&...args) {
+        auto inserted = tree.findOrEmplace(key, std::piecewise_construct, std::forward_as_tuple(std::move(key)),
+                                           std::forward_as_tuple(std::forward<Args>(args)...));
+        return {Iterator(inserted.first), inserted.second};
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    template<typename M>
+    std::pair<typename Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::Iterator, bool>
+    Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::insert_or_assign(const Key_T &key, M &&mapped) {
+        auto inserted = this->try_emplace(key, std::forward<M>(mapped));
+        if (!inserted.second) {
+            inserted.first->second = std::forward<M>(mapped);
+            if constexpr (!std::is_void<Aggregate_T>::value)
+                tree.refresh(inserted.first.it);
         }
-        return {begin(node), new_inserted};
+        return inserted;
     }
 
-    template<typename Key_T, typename Mapped_T>
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    template<typename M>
+    std::pair<typename Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::Iterator, bool>
+    Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::insert_or_assign(Key_T &&key, M &&mapped) {
+        auto inserted = this->try_emplace(std::move(key), std::forward<M>(mapped));
+        if (!inserted.second) {
+            inserted.first->second = std::forward<M>(mapped);
+            if constexpr (!std::is_void<Aggregate_T>::value)
+                tree.refresh(inserted.first.it);
+        }
+        return inserted;
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    template<typename IT_T>
+    void Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::insert(IT_T range_beg, IT_T range_end) {
+        this->insert(range_beg, range_end, is_forward_iterator<IT_T>{});
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
     template<typename IT_T>
-    void Map<Key_T, Mapped_T>::insert(IT_T range_beg, IT_T range_end) {
+    void Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::insert(IT_T range_beg, IT_T range_end, std::true_type) {
+        if (this->empty())
+            this->assign_sorted(range_beg, range_end);
+        else
+            this->insert(range_beg, range_end, std::false_type{});
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    template<typename IT_T>
+    void Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::insert(IT_T range_beg, IT_T range_end, std::false_type) {
         while (range_beg != range_end) {
-            this->insert(MapDataNode(*range_beg));
+            this->insert(*range_beg);
             ++range_beg;
         }
     }
 
-    template<typename Key_T, typename Mapped_T>
-    void Map<Key_T, Mapped_T>::erase(const Key_T &key) {
-        tree.deleteNode(MapKeyNode(key), key_data_comp_val);
+// -- order statistics:
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    size_t Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::rank(const Key_T &key) const {
+        return tree.rank(key);
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    template<typename K, typename C, typename>
+    size_t Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::rank(const K &key) const {
+        return tree.rank(key);
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    typename Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::Iterator Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::select(size_t index) {
+        return Iterator(tree.select(index));
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    typename Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::ConstIterator Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::select(size_t index) const {
+        return ConstIterator(tree.select(index));
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    size_t Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::count_range(const Key_T &lo, const Key_T &hi) const {
+        size_t below = tree.rank(lo), upTo = tree.rank(hi);
+        return upTo > below ? upTo - below : 0;
+    }
+
+// -- aggregates:
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    typename Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::aggregate_type Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::aggregate(const Key_T &lo, const Key_T &hi) const {
+        return tree.aggregate(lo, hi);
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    typename Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::aggregate_type Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::aggregate() const {
+        return tree.aggregate();
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    void Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::refresh(Iterator it) {
+        tree.refresh(it.it);
+    }
+
+// -- bulk loading:
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    template<typename IT_T>
+    void Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::assign_sorted(IT_T range_beg, IT_T range_end, const ParallelMode &mode) {
+        const Compare_T &comp = this->tree.value_comp().key_comp();
+        size_t count = 0;
+        bool ascending = true;
+        if (range_beg != range_end) {
+            IT_T prev = range_beg, it = range_beg;
+            for (++count; ++it != range_end; prev = it, ++count) {
+                if (!comp((*prev).first, (*it).first)) {
+                    ascending = false;
+                    break;
+                }
+            }
+        }
+        if (ascending) {
+            this->tree.assignSorted(range_beg, count, mode);
+        } else {
+            this->clear();
+            this->insert(range_beg, range_end, std::false_type{});
+        }
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    template<typename IT_T>
+    Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>
+    Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::from_sorted(IT_T range_beg, IT_T range_end, const Compare_T &comp,
+                                                          const Alloc_T &alloc) {
+        Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> map(comp, alloc);
+        map.assign_sorted(range_beg, range_end);
+        return map;
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    template<typename IT_T>
+    Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>
+    Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::from_sorted(IT_T range_beg, IT_T range_end, const ParallelMode &mode,
+                                                          const Compare_T &comp, const Alloc_T &alloc) {
+        Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> map(comp, alloc);
+        map.assign_sorted(range_beg, range_end, mode);
+        return map;
+    }
+
+// -- split and join:
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::split_at(const Key_T &key) {
+        Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> upper(this->key_comp(), this->get_allocator());
+        upper.tree = tree.split(key);
+        return upper;
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    void Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::concat(Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &other) {
+        tree.join(other.tree);
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    void Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::merge_union(Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &other, const ParallelMode &mode) {
+        tree.mergeUnion(other.tree, mode);
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    void Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::intersection(Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &other, const ParallelMode &mode) {
+        tree.intersection(other.tree, mode);
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    void Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::difference(Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &other, const ParallelMode &mode) {
+        tree.difference(other.tree, mode);
+    }
+
+    // The runs of equal keys are found after a stable sort of the entries' positions, which keeps each run in batch order
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    std::vector<typename Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::BatchOutcome>
+    Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::apply_batch(BatchEntry *entries, size_t count) {
+        std::vector<BatchOutcome> outcomes(count);
+        std::vector<size_t> order(count);
+        std::iota(order.begin(), order.end(), (size_t) 0);
+        const Compare_T &comp = this->tree.value_comp().key_comp();
+        std::stable_sort(order.begin(), order.end(), [&](size_t lhs, size_t rhs) {
+            return comp(entries[lhs].key, entries[rhs].key);
+        });
+        std::vector<BatchRun> runs;
+        for (size_t first = 0, last; first < count; first = last) {
+            for (last = first + 1; last < count && !comp(entries[order[first]].key, entries[order[last]].key); ++last);
+            runs.emplace_back(first, last);
+        }
+        BatchApplier applier{entries, order.data(), outcomes.data()};
+        tree.applySorted(runs.begin(), runs.size(), applier);
+        return outcomes;
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    void Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::erase(const Key_T &key) {
+        tree.deleteNode(key);
     }
 
 //    template<typename Key_T, typename Mapped_T>
-//    void Map<Key_T, Mapped_T>::erase(const Iterator &&it) {
+//    void Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::erase(const Iterator &&it) {
 //        this->erase((*it).first);
 //    }
 
-    template<typename Key_T, typename Mapped_T>
-    void Map<Key_T, Mapped_T>::erase(Iterator it) {
-        this->erase((*it).first);
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    void Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::erase(Iterator it) {
+        tree.erase(it.it);
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    typename Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::Iterator
+    Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::erase(Iterator first, Iterator last) {
+        TreeType::unshare(first.it, last.it);
+        tree.erase(first.it, last.it);
+        return last;
     }
 
-    template<typename Key_T, typename Mapped_T>
-    void Map<Key_T, Mapped_T>::clear() {
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    void Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::clear() {
         tree.clear();
     }
 
-/*********** MapKeyNode ************/
-// public:
-// -- static members:
-//    template<typename K, typename M>
-//    const std::function<short int(
-//            const typename Map<K, M>::MapKeyNode &, typename Map<K, M>::MapDataNode &
-//    )> Map<K, M>::key_data_comp_val =
-//            [](const MapKeyNode &key,
-//               MapDataNode &data) {
-//                return key < data ? -1 : key == data ? 0 : 1;
-//            };
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    void Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::save(const std::string &path) const {
+        MapImage<Key_T, Mapped_T>::write(path, this->begin(), this->size());
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    void Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::write_to(std::ostream &out, bool checksums, size_t block_bytes) const {
+        MapStreamFormat::write<Key_T, Mapped_T>(out, this->begin(), this->size(), checksums, block_bytes);
+    }
 
+    template<typename Key_T, typename Mapped_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T,
+            typename Aggregate_T, bool Snapshots_T>
+    void Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::read_from(std::istream &in) {
+        MapStreamFormat::Reader<Key_T, Mapped_T> reader(in);
+        Map<Key_T, Mapped_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> restored(this->key_comp(), this->get_allocator());
+        restored.tree.assignSorted(reader.entries(), reader.count());
+        reader.finish();
+        const Compare_T &comp = restored.tree.value_comp().key_comp();
+        if (!restored.empty()) {
+            for (ConstIterator prev = restored.begin(), it = std::next(prev); it != restored.end(); prev = it++) {
+                if (!comp(prev->first, it->first))
+                    throw std::runtime_error("map stream entries are not in strictly ascending key order");
+            }
+        }
+        *this = std::move(restored);
+    }
 
 /********** MapDataNode ************/
 // non-members:
@@ -472,3 +1387,5 @@ namespace cs540 {
 
 
 }
+
+#endif // AVL_TREE_MAP
@@ -0,0 +1,207 @@
+#ifndef AVL_TREE_MAPPED_MAP
+#define AVL_TREE_MAPPED_MAP
+
+#include "Map.hpp"
+
+#include <cerrno>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace cs540 {
+
+    // A read-only map over an image written by Map::save, mapped straight from the file (POSIX mmap). Opening it
+    // checks the header and maps the file, nothing more: the entries are read in place, so there is nothing to parse
+    // or allocate however large the map, the pages come in as lookups and iteration touch them, and processes that
+    // open the same image share its pages through the page cache. The image must have been saved by a Map ordered
+    // like Compare_T. It stays valid while the file is replaced (Map::save renames a new image over it), but not if
+    // the file is truncated or written to in place.
+    template<typename Key_T, typename Mapped_T, typename Compare_T = std::less<Key_T>>
+    class MappedMap {
+    public:
+        typedef Key_T key_type;
+        typedef Mapped_T mapped_type;
+        typedef std::pair<Key_T, Mapped_T> value_type;
+        typedef size_t size_type;
+
+        // The entries lie in key order in the image, so a pointer to one walks them
+        typedef const value_type *ConstIterator;
+
+        // -- constructing
+        explicit MappedMap(const Compare_T &comp = Compare_T()) : comp(comp) {}
+
+        // Maps the image at `path`. Throws std::system_error when the file cannot be opened or mapped, and
+        // std::runtime_error when it is not an image of these key and mapped types.
+        static MappedMap open(const std::string &path, const Compare_T &comp = Compare_T());
+
+        MappedMap(const MappedMap &) = delete;
+
+        MappedMap(MappedMap &&other) noexcept : MappedMap(other.comp) {
+            this->swap(other);
+        }
+
+        MappedMap &operator=(MappedMap other) noexcept {
+            this->swap(other);
+            return *this;
+        }
+
+        ~MappedMap() {
+            if (image)
+                ::munmap(image, bytes);
+        }
+
+        void swap(MappedMap &other) noexcept {
+            std::swap(comp, other.comp);
+            std::swap(image, other.image);
+            std::swap(bytes, other.bytes);
+            std::swap(keys, other.keys);
+            std::swap(entries, other.entries);
+            std::swap(entryCount, other.entryCount);
+        }
+
+        Compare_T key_comp() const {
+            return comp;
+        }
+
+        // -- size:
+        size_t size() const {
+            return entryCount;
+        }
+
+        bool empty() const {
+            return !entryCount;
+        }
+
+        // -- iterators:
+        ConstIterator begin() const {
+            return entries;
+        }
+
+        ConstIterator end() const {
+            return entries + entryCount;
+        }
+
+        // -- lookup, O(log n) comparisons over the key array:
+        ConstIterator find(const Key_T &key) const {
+            size_t index = this->rank(key, std::false_type());
+            return index < entryCount && !comp(key, keys[index]) ? entries + index : this->end();
+        }
+
+        bool contains(const Key_T &key) const {
+            return this->find(key) != this->end();
+        }
+
+        size_t count(const Key_T &key) const {
+            return this->contains(key) ? 1 : 0;
+        }
+
+        const Mapped_T &at(const Key_T &key) const;
+
+        // First entry not ordered before `key`
+        ConstIterator lower_bound(const Key_T &key) const {
+            return entries + this->rank(key, std::false_type());
+        }
+
+        // First entry ordered after `key`
+        ConstIterator upper_bound(const Key_T &key) const {
+            return entries + this->rank(key, std::true_type());
+        }
+
+        std::pair<ConstIterator, ConstIterator> equal_range(const Key_T &key) const {
+            return {this->lower_bound(key), this->upper_bound(key)};
+        }
+
+    private:
+        Compare_T comp;
+        void *image = nullptr;
+        size_t bytes = 0;
+        const Key_T *keys = nullptr;
+        const value_type *entries = nullptr;
+        size_t entryCount = 0;
+
+        // Index of the first key matching, by `Upper_T`, lower_bound (not before `key`) or upper_bound (after it)
+        template<typename Upper_T>
+        size_t rank(const Key_T &key, Upper_T) const;
+
+        static void prefetch(const void *address) {
+#if defined(__GNUC__) || defined(__clang__)
+            __builtin_prefetch(address);
+#endif
+        }
+    };
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T>
+    MappedMap<Key_T, Mapped_T, Compare_T> MappedMap<Key_T, Mapped_T, Compare_T>::open(const std::string &path, const Compare_T &comp) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            throw std::system_error(errno, std::generic_category(), "cannot open " + path);
+        struct stat status;
+        if (::fstat(fd, &status) != 0) {
+            int error = errno;
+            ::close(fd);
+            throw std::system_error(error, std::generic_category(), "cannot stat " + path);
+        }
+        MappedMap mapped(comp);
+        mapped.bytes = (size_t) status.st_size;
+        if (mapped.bytes >= sizeof(MapImageHeader)) {
+            void *image = ::mmap(nullptr, mapped.bytes, PROT_READ, MAP_SHARED, fd, 0);
+            if (image == MAP_FAILED) {
+                int error = errno;
+                ::close(fd);
+                throw std::system_error(error, std::generic_category(), "cannot map " + path);
+            }
+            mapped.image = image;
+        }
+        // The mapping holds its own reference to the file
+        ::close(fd);
+        const MapImageHeader *header = (const MapImageHeader *) mapped.image;
+        if (!header || !MapImage<Key_T, Mapped_T>::fits(*header, mapped.bytes))
+            throw std::runtime_error(path + " is not a map image of these key and mapped types");
+        const char *base = (const char *) mapped.image;
+        mapped.keys = (const Key_T *) (base + header->keysOffset);
+        mapped.entries = (const value_type *) (base + header->entriesOffset);
+        mapped.entryCount = (size_t) header->count;
+        return mapped;
+    }
+
+    // Halves the range without a data-dependent branch, prefetching both places the next step can probe
+    template<typename Key_T, typename Mapped_T, typename Compare_T>
+    template<typename Upper_T>
+    size_t MappedMap<Key_T, Mapped_T, Compare_T>::rank(const Key_T &key, Upper_T) const {
+        if (!entryCount)
+            return 0;
+        const Key_T *base = keys;
+        for (size_t n = entryCount; n > 1;) {
+            size_t half = n / 2, next = (n - half) / 2;
+            prefetch(base + next);
+            prefetch(base + half + next);
+            if constexpr (Upper_T::value)
+                base = !comp(key, base[half - 1]) ? base + half : base;
+            else
+                base = comp(base[half - 1], key) ? base + half : base;
+            n -= half;
+        }
+        if constexpr (Upper_T::value)
+            return (base - keys) + !comp(key, *base);
+        else
+            return (base - keys) + comp(*base, key);
+    }
+
+    template<typename Key_T, typename Mapped_T, typename Compare_T>
+    const Mapped_T &MappedMap<Key_T, Mapped_T, Compare_T>::at(const Key_T &key) const {
+        ConstIterator it = this->find(key);
+        if (it == this->end())
+            throw std::out_of_range("specified key does not exist");
+        return it->second;
+    }
+
+}
+
+#endif // AVL_TREE_MAPPED_MAP
@@ -0,0 +1,486 @@
+#ifndef AVL_TREE_SHARDED_MAP
+#define AVL_TREE_SHARDED_MAP
+
+// For its EpochDomain
+#include "ConcurrentMap.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace cs540 {
+
+    // An ordered map for write-heavy ingestion from many threads. The key space is cut into N ranges, each held by a
+    // Map of its own with its own lock and node pool, so writers to different ranges share neither a lock nor an
+    // allocator. The cut points move online: every few inserts the cuts that have drifted from the quantiles of the
+    // entries are put back, each by handing the entries between its old and new place to the shard across it, split off
+    // in O(log n) and copied into that shard's pool. Shards past the last cut are unused until the last used shard
+    // spills into the next one, so a map started without cuts spreads itself out as it fills. Writers find
+    // their shard through an immutable layout of the cuts, which a rebalance replaces and retires through an
+    // EpochDomain; a writer that routed by a stale layout notices under the shard's lock.
+    template<typename Key_T, typename Mapped_T, size_t N, typename Compare_T = std::less<Key_T>>
+    class ShardedMap {
+        static_assert(N > 0, "ShardedMap needs at least one shard");
+
+    public:
+        typedef Key_T key_type;
+        typedef Mapped_T mapped_type;
+        typedef std::pair<Key_T, Mapped_T> value_type;
+        typedef size_t size_type;
+
+        // Order statistics find where a rebalance cuts in O(log n)
+        typedef Map<Key_T, Mapped_T, Compare_T, PoolAllocator<std::pair<const Key_T, Mapped_T>>, true> ShardType;
+
+        // -- constructing
+        explicit ShardedMap(const Compare_T &comp = Compare_T()) : ShardedMap(std::vector<Key_T>(), comp) {}
+
+        // Starts from up to N - 1 strictly ascending cuts: shard i holds the keys from cuts[i - 1] up to cuts[i]
+        explicit ShardedMap(std::vector<Key_T> cuts, const Compare_T &comp = Compare_T());
+
+        ShardedMap(const ShardedMap &) = delete;
+
+        ShardedMap &operator=(const ShardedMap &) = delete;
+
+        // No other thread may still be using the map
+        ~ShardedMap();
+
+        // -- lookup: safe alongside writers, under the lock of the key's shard
+        // Calls visitor(const Mapped_T &) on the value for `key`, if there is one
+        template<typename Visitor_T>
+        bool visit(const Key_T &key, Visitor_T &&visitor) const;
+
+        std::optional<Mapped_T> get(const Key_T &key) const;
+
+        bool contains(const Key_T &key) const;
+
+        // First entry with a key not before `key`, looking on into the following shards when its own has none
+        std::optional<value_type> lower_bound_entry(const Key_T &key) const;
+
+        // Sum of the shard sizes, each read on its own
+        size_t size() const;
+
+        bool empty() const {
+            return !this->size();
+        }
+
+        // Entries per shard, the unused ones included
+        std::vector<size_t> shard_sizes() const;
+
+        // Calls visitor(const value_type &) on every entry in key order. Rebalancing waits meanwhile, and each shard is
+        // locked while it is being visited.
+        template<typename Visitor_T>
+        void for_each(Visitor_T &&visitor) const;
+
+        // -- modifiers: safe alongside each other and lookups
+        // Each returns whether `key` was new
+        bool insert(const value_type &value);
+
+        template<typename... Args>
+        bool emplace(Args &&...args);
+
+        template<typename M>
+        bool insert_or_assign(const Key_T &key, M &&obj);
+
+        // Returns whether there was an entry to erase
+        bool erase(const Key_T &key);
+
+        // Keeps the cuts
+        void clear();
+
+        // -- iterators: only while no thread writes (say, once an ingestion is done). The shards are in key order, so
+        // going through them one after the other is the ordered merge of their entries.
+        class ConstIterator {
+            friend ShardedMap<Key_T, Mapped_T, N, Compare_T>;
+        public:
+            typedef std::forward_iterator_tag iterator_category;
+            typedef typename ShardedMap<Key_T, Mapped_T, N, Compare_T>::value_type value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef const value_type *pointer;
+            typedef const value_type &reference;
+
+            const value_type &operator*() const {
+                return *it;
+            }
+
+            const value_type *operator->() const {
+                return &*it;
+            }
+
+            ConstIterator &operator++() {
+                ++it;
+                this->skipEmpty();
+                return *this;
+            }
+
+            ConstIterator operator++(int) {
+                ConstIterator old = *this;
+                ++*this;
+                return old;
+            }
+
+            bool operator==(const ConstIterator &other) const {
+                return shard == other.shard && it == other.it;
+            }
+
+            bool operator!=(const ConstIterator &other) const {
+                return !(*this == other);
+            }
+
+        private:
+            const ShardedMap<Key_T, Mapped_T, N, Compare_T> *map;
+            size_t shard;
+            typename ShardType::ConstIterator it;
+
+            ConstIterator(const ShardedMap<Key_T, Mapped_T, N, Compare_T> *map, size_t shard,
+                          const typename ShardType::ConstIterator &it) : map(map), shard(shard), it(it) {
+                this->skipEmpty();
+            }
+
+            void skipEmpty() {
+                for (size_t used = map->used(); it == map->shards[shard].map.end() && shard + 1 < used;)
+                    it = map->shards[++shard].map.begin();
+            }
+        };
+
+        ConstIterator begin() const {
+            return ConstIterator(this, 0, shards[0].map.begin());
+        }
+
+        ConstIterator end() const {
+            size_t last = this->used() - 1;
+            return ConstIterator(this, last, shards[last].map.end());
+        }
+
+        ConstIterator lower_bound(const Key_T &key) const {
+            size_t shard = this->route(*layout.load(std::memory_order_acquire), key);
+            return ConstIterator(this, shard, shards[shard].map.lower_bound(key));
+        }
+
+    private:
+        // Inserts into a shard between two checks for a rebalance, which keeps writers off the other shards' counters
+        static const unsigned CHECK_INTERVAL = 64;
+
+        // A cut is moved once the shards below it are off from their share by a quarter of a shard's share plus this
+        // many entries, and by no fewer than this many entries
+        static const size_t MIN_MOVE = 1024;
+
+        // Shard i holds the keys from cuts[i - 1] (inclusive) up to cuts[i]; the shards past cuts.size() are unused
+        struct Layout {
+            uint64_t version;
+            std::vector<Key_T> cuts;
+        };
+
+        // A cache line each, so that writers to neighbouring shards do not invalidate each other's
+        struct alignas(64) Shard {
+            mutable std::mutex lock;
+            // Layout that last moved this shard's cuts: anyone who routed by an older one may be at the wrong shard
+            uint64_t version = 0;
+            unsigned inserts = 0;
+            std::atomic<size_t> entries{0};
+            ShardType map;
+        };
+
+        struct Retired {
+            const Layout *layout;
+            uint64_t epoch;
+        };
+
+        Compare_T comp;
+        Shard shards[N];
+        std::atomic<const Layout *> layout;
+        // Serializes rebalances, and holds the cuts still for whoever takes it
+        mutable std::mutex rebalanceLock;
+        mutable EpochDomain epochs;
+        std::vector<Retired> retired;
+
+        size_t route(const Layout &current, const Key_T &key) const {
+            return (size_t) (std::upper_bound(current.cuts.begin(), current.cuts.end(), key, comp) - current.cuts.begin());
+        }
+
+        size_t used() const {
+            return layout.load(std::memory_order_acquire)->cuts.size() + 1;
+        }
+
+        size_t lockShard(const Key_T &key, std::unique_lock<std::mutex> &lock) const;
+
+        void inserted(Shard &shard, std::unique_lock<std::mutex> &lock);
+
+        void rebalance();
+
+        void moveCut(size_t cut, size_t wanted);
+
+        void reclaim();
+    };
+
+// -- constructing
+    template<typename Key_T, typename Mapped_T, size_t N, typename Compare_T>
+    ShardedMap<Key_T, Mapped_T, N, Compare_T>::ShardedMap(std::vector<Key_T> cuts, const Compare_T &comp) : comp(comp) {
+        if (cuts.size() >= N)
+            throw std::out_of_range("more cuts than a ShardedMap has shards to separate");
+        for (size_t i = 1; i < cuts.size(); ++i)
+            if (!comp(cuts[i - 1], cuts[i]))
+                throw std::out_of_range("ShardedMap cuts are not strictly ascending");
+        for (Shard &shard : shards)
+            shard.map = ShardType(comp);
+        layout.store(new Layout{0, std::move(cuts)}, std::memory_order_relaxed);
+    }
+
+    template<typename Key_T, typename Mapped_T, size_t N, typename Compare_T>
+    ShardedMap<Key_T, Mapped_T, N, Compare_T>::~ShardedMap() {
+        for (const Retired &entry : retired)
+            delete entry.layout;
+        delete layout.load(std::memory_order_relaxed);
+    }
+
+// -- lookup:
+    template<typename Key_T, typename Mapped_T, size_t N, typename Compare_T>
+    template<typename Visitor_T>
+    bool ShardedMap<Key_T, Mapped_T, N, Compare_T>::visit(const Key_T &key, Visitor_T &&visitor) const {
+        std::unique_lock<std::mutex> lock;
+        const ShardType &map = shards[this->lockShard(key, lock)].map;
+        typename ShardType::ConstIterator it = map.find(key);
+        if (it == map.end())
+            return false;
+        visitor(static_cast<const Mapped_T &>(it->second));
+        return true;
+    }
+
+    template<typename Key_T, typename Mapped_T, size_t N, typename Compare_T>
+    std::optional<Mapped_T> ShardedMap<Key_T, Mapped_T, N, Compare_T>::get(const Key_T &key) const {
+        std::optional<Mapped_T> value;
+        this->visit(key, [&value](const Mapped_T &mapped) { value.emplace(mapped); });
+        return value;
+    }
+
+    template<typename Key_T, typename Mapped_T, size_t N, typename Compare_T>
+    bool ShardedMap<Key_T, Mapped_T, N, Compare_T>::contains(const Key_T &key) const {
+        return this->visit(key, [](const Mapped_T &) {});
+    }
+
+    // The key's own shard usually has the answer. Otherwise the following shards are searched with rebalancing held
+    // off, so that no entries can move past the search between two shards.
+    template<typename Key_T, typename Mapped_T, size_t N, typename Compare_T>
+    std::optional<typename ShardedMap<Key_T, Mapped_T, N, Compare_T>::value_type>
+    ShardedMap<Key_T, Mapped_T, N, Compare_T>::lower_bound_entry(const Key_T &key) const {
+        {
+            std::unique_lock<std::mutex> lock;
+            const ShardType &map = shards[this->lockShard(key, lock)].map;
+            typename ShardType::ConstIterator it = map.lower_bound(key);
+            if (it != map.end())
+                return value_type(*it);
+        }
+        std::lock_guard<std::mutex> rebalancing(rebalanceLock);
+        const Layout *current = layout.load(std::memory_order_relaxed);
+        for (size_t i = this->route(*current, key); i <= current->cuts.size(); ++i) {
+            std::lock_guard<std::mutex> lock(shards[i].lock);
+            typename ShardType::ConstIterator it = shards[i].map.lower_bound(key);
+            if (it != shards[i].map.end())
+                return value_type(*it);
+        }
+        return std::nullopt;
+    }
+
+    template<typename Key_T, typename Mapped_T, size_t N, typename Compare_T>
+    size_t ShardedMap<Key_T, Mapped_T, N, Compare_T>::size() const {
+        size_t total = 0;
+        for (const Shard &shard : shards)
+            total += shard.entries.load(std::memory_order_relaxed);
+        return total;
+    }
+
+    template<typename Key_T, typename Mapped_T, size_t N, typename Compare_T>
+    std::vector<size_t> ShardedMap<Key_T, Mapped_T, N, Compare_T>::shard_sizes() const {
+        std::vector<size_t> sizes;
+        for (const Shard &shard : shards)
+            sizes.push_back(shard.entries.load(std::memory_order_relaxed));
+        return sizes;
+    }
+
+    template<typename Key_T, typename Mapped_T, size_t N, typename Compare_T>
+    template<typename Visitor_T>
+    void ShardedMap<Key_T, Mapped_T, N, Compare_T>::for_each(Visitor_T &&visitor) const {
+        std::lock_guard<std::mutex> rebalancing(rebalanceLock);
+        for (size_t i = 0, used = this->used(); i < used; ++i) {
+            std::lock_guard<std::mutex> lock(shards[i].lock);
+            for (const value_type &entry : shards[i].map)
+                visitor(entry);
+        }
+    }
+
+    // The pin keeps the layout that was routed by allocated. When no epoch slot is free, the rebalance lock holds the
+    // layout still instead.
+    template<typename Key_T, typename Mapped_T, size_t N, typename Compare_T>
+    size_t ShardedMap<Key_T, Mapped_T, N, Compare_T>::lockShard(const Key_T &key, std::unique_lock<std::mutex> &lock) const {
+        EpochDomain::Guard guard(epochs);
+        std::unique_lock<std::mutex> rebalancing(rebalanceLock, std::defer_lock);
+        if (!guard.pinned())
+            rebalancing.lock();
+        for (;;) {
+            const Layout *current = layout.load(std::memory_order_acquire);
+            size_t index = this->route(*current, key);
+            lock = std::unique_lock<std::mutex>(shards[index].lock);
+            if (shards[index].version <= current->version)
+                return index;
+            lock.unlock();
+        }
+    }
+
+// -- modifiers:
+    template<typename Key_T, typename Mapped_T, size_t N, typename Compare_T>
+    bool ShardedMap<Key_T, Mapped_T, N, Compare_T>::insert(const value_type &value) {
+        std::unique_lock<std::mutex> lock;
+        Shard &shard = shards[this->lockShard(value.first, lock)];
+        if (!shard.map.try_emplace(value.first, value.second).second)
+            return false;
+        this->inserted(shard, lock);
+        return true;
+    }
+
+    template<typename Key_T, typename Mapped_T, size_t N, typename Compare_T>
+    template<typename... Args>
+    bool ShardedMap<Key_T, Mapped_T, N, Compare_T>::emplace(Args &&...args) {
+        value_type value(std::forward<Args>(args)...);
+        std::unique_lock<std::mutex> lock;
+        Shard &shard = shards[this->lockShard(value.first, lock)];
+        if (!shard.map.try_emplace(std::move(value.first), std::move(value.second)).second)
+            return false;
+        this->inserted(shard, lock);
+        return true;
+    }
+
+    template<typename Key_T, typename Mapped_T, size_t N, typename Compare_T>
+    template<typename M>
+    bool ShardedMap<Key_T, Mapped_T, N, Compare_T>::insert_or_assign(const Key_T &key, M &&obj) {
+        std::unique_lock<std::mutex> lock;
+        Shard &shard = shards[this->lockShard(key, lock)];
+        if (!shard.map.insert_or_assign(key, std::forward<M>(obj)).second)
+            return false;
+        this->inserted(shard, lock);
+        return true;
+    }
+
+    template<typename Key_T, typename Mapped_T, size_t N, typename Compare_T>
+    bool ShardedMap<Key_T, Mapped_T, N, Compare_T>::erase(const Key_T &key) {
+        std::unique_lock<std::mutex> lock;
+        Shard &shard = shards[this->lockShard(key, lock)];
+        typename ShardType::Iterator it = shard.map.find(key);
+        if (it == shard.map.end())
+            return false;
+        shard.map.erase(it);
+        shard.entries.store(shard.map.size(), std::memory_order_relaxed);
+        return true;
+    }
+
+    template<typename Key_T, typename Mapped_T, size_t N, typename Compare_T>
+    void ShardedMap<Key_T, Mapped_T, N, Compare_T>::clear() {
+        std::lock_guard<std::mutex> rebalancing(rebalanceLock);
+        for (Shard &shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.lock);
+            shard.map.clear();
+            shard.entries.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // Called with the shard locked after a new entry went in; the rebalance check runs once the lock is let go
+    template<typename Key_T, typename Mapped_T, size_t N, typename Compare_T>
+    void ShardedMap<Key_T, Mapped_T, N, Compare_T>::inserted(Shard &shard, std::unique_lock<std::mutex> &lock) {
+        shard.entries.store(shard.map.size(), std::memory_order_relaxed);
+        bool check = ++shard.inserts % CHECK_INTERVAL == 0;
+        lock.unlock();
+        if (check)
+            this->rebalance();
+    }
+
+// -- rebalancing:
+    // Puts every cut that has drifted back at its quantile: the shards up to cut i are meant to hold (i + 1) / N of the
+    // entries. The cuts are visited in key order, so entries pushed across one cut go on across the next in the same
+    // pass, and the last used shard counts as having an empty neighbour to spill into. A writer already busy
+    // rebalancing is not waited for: the next check will come.
+    template<typename Key_T, typename Mapped_T, size_t N, typename Compare_T>
+    void ShardedMap<Key_T, Mapped_T, N, Compare_T>::rebalance() {
+        std::unique_lock<std::mutex> rebalancing(rebalanceLock, std::try_to_lock);
+        if (!rebalancing.owns_lock())
+            return;
+        size_t total = this->size(), slack = total / N / 4 + MIN_MOVE, before = 0;
+        for (size_t cut = 0; cut + 1 < N; ++cut) {
+            size_t cuts = layout.load(std::memory_order_relaxed)->cuts.size();
+            if (cut > cuts)
+                break;
+            size_t share = total * (cut + 1) / N, wanted = share > before ? share - before : 0;
+            size_t size = shards[cut].entries.load(std::memory_order_relaxed);
+            if (size > wanted + slack || (cut < cuts && size + slack < wanted))
+                this->moveCut(cut, wanted);
+            before += shards[cut].entries.load(std::memory_order_relaxed);
+        }
+    }
+
+    // Trades entries across cut `cut` until the shard below it holds `wanted`, or as close to that as leaves each shard
+    // an entry. Entries going right are split off above the new cut and united with the shard above; entries going left
+    // are split off below it and appended to the shard below. Either way the receiving shard copies them into its own
+    // pool. Called with the rebalance lock held.
+    template<typename Key_T, typename Mapped_T, size_t N, typename Compare_T>
+    void ShardedMap<Key_T, Mapped_T, N, Compare_T>::moveCut(size_t cut, size_t wanted) {
+        const Layout *current = layout.load(std::memory_order_relaxed);
+        Shard &lower = shards[cut], &upper = shards[cut + 1];
+        std::unique_lock<std::mutex> lowerLock(lower.lock), upperLock(upper.lock);
+        size_t lowerSize = lower.map.size(), upperSize = upper.map.size();
+        bool right = lowerSize > wanted;
+        size_t moved = right ? lowerSize - std::max(wanted, (size_t) 1) : std::min(wanted - lowerSize, upperSize ? upperSize - 1 : 0);
+        if (moved < MIN_MOVE)
+            return;
+
+        Shard &from = right ? lower : upper, &to = right ? upper : lower;
+        std::unique_ptr<Layout> next(new Layout{current->version + 1, current->cuts});
+        retired.reserve(retired.size() + 1);
+        const ShardType &source = from.map;
+        Key_T key = source.select(right ? source.size() - moved : moved)->first;
+        ShardType above = from.map.split_at(key);
+        try {
+            if (right)
+                to.map.merge_union(above);
+            else
+                to.map.concat(from.map);
+        } catch (...) {
+            from.map.concat(above);
+            throw;
+        }
+        if (!right)
+            from.map = std::move(above);
+        if (cut == current->cuts.size())
+            next->cuts.push_back(key);
+        else
+            next->cuts[cut] = key;
+
+        from.version = to.version = next->version;
+        from.entries.store(from.map.size(), std::memory_order_relaxed);
+        to.entries.store(to.map.size(), std::memory_order_relaxed);
+        layout.store(next.release(), std::memory_order_release);
+        retired.push_back({current, epochs.current()});
+        lowerLock.unlock();
+        upperLock.unlock();
+        this->reclaim();
+    }
+
+    template<typename Key_T, typename Mapped_T, size_t N, typename Compare_T>
+    void ShardedMap<Key_T, Mapped_T, N, Compare_T>::reclaim() {
+        uint64_t oldest = epochs.advance();
+        size_t kept = 0;
+        for (const Retired &entry : retired) {
+            if (entry.epoch < oldest)
+                delete entry.layout;
+            else
+                retired[kept++] = entry;
+        }
+        retired.resize(kept);
+    }
+
+}
+
+#endif // AVL_TREE_SHARDED_MAP
@@ -0,0 +1,405 @@
+#ifndef AVL_TREE_SMALL_MAP
+#define AVL_TREE_SMALL_MAP
+
+#include "Map.hpp"
+
+#include <algorithm>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace cs540 {
+
+    // A Map for the common case of a handful of entries. Up to Small_N entries sit in one sorted array, which costs a
+    // single allocation and is searched without chasing a pointer: arithmetic keys are ranked by a branch-free count
+    // of the smaller ones, any other key by binary search. The entry that would make Small_N + 1 promotes the array
+    // into a Map, built bottom-up in O(n), and the map stays a tree from then on, whatever it shrinks back to, until
+    // clear(). Iterators: in the array, insert and erase invalidate them (as for a std::vector); the promotion
+    // invalidates every one of them; after it, they behave as Map's do.
+    template<typename Key_T, typename Mapped_T, size_t Small_N = 32, typename Compare_T = std::less<Key_T>,
+            typename Alloc_T = std::allocator<std::pair<const Key_T, Mapped_T>>>
+    class SmallMap {
+        static_assert(Small_N > 0, "SmallMap needs room for at least one entry before promoting");
+
+    public:
+        typedef Key_T key_type;
+        typedef Mapped_T mapped_type;
+        typedef std::pair<Key_T, Mapped_T> value_type;
+        typedef size_t size_type;
+
+        typedef Map<Key_T, Mapped_T, Compare_T, Alloc_T> TreeType;
+
+    private:
+        typedef std::vector<value_type, typename std::allocator_traits<Alloc_T>::template rebind_alloc<value_type>> FlatType;
+
+    public:
+        class Iterator {
+            friend SmallMap<Key_T, Mapped_T, Small_N, Compare_T, Alloc_T>;
+        public:
+            typedef std::bidirectional_iterator_tag iterator_category;
+            typedef typename SmallMap<Key_T, Mapped_T, Small_N, Compare_T, Alloc_T>::value_type value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef value_type *pointer;
+            typedef value_type &reference;
+
+            // Only a non-const map hands these out, so its entries may be written through them
+            value_type &operator*() const {
+                return tree ? *static_cast<const typename TreeType::Iterator &>(*tree)
+                            : const_cast<value_type &>((*flat)[slot]);
+            }
+
+            value_type *operator->() const {
+                return &**this;
+            }
+
+            Iterator &operator++() {
+                if (tree)
+                    ++*tree;
+                else
+                    ++slot;
+                return *this;
+            }
+
+            Iterator &operator--() {
+                if (tree)
+                    --*tree;
+                else
+                    --slot;
+                return *this;
+            }
+
+            Iterator operator++(int) {
+                Iterator copy(*this);
+                ++*this;
+                return copy;
+            }
+
+            Iterator operator--(int) {
+                Iterator copy(*this);
+                --*this;
+                return copy;
+            }
+
+            bool operator==(const Iterator &other) const {
+                return tree ? other.tree && *tree == *other.tree : !other.tree && slot == other.slot;
+            }
+
+            bool operator!=(const Iterator &other) const {
+                return !(*this == other);
+            }
+
+        protected:
+            Iterator(const FlatType *flat, size_t slot) : flat(flat), slot(slot) {}
+
+            Iterator(const typename TreeType::ConstIterator &it) : flat(nullptr), slot(0), tree(it) {}
+
+            // Into the array while the map is flat, into the tree once it has been promoted. The tree's ConstIterator
+            // reads an entry without making it writable; operator* above goes through Map's Iterator instead.
+            const FlatType *flat;
+            size_t slot;
+            std::optional<typename TreeType::ConstIterator> tree;
+        };
+
+        class ConstIterator : public Iterator {
+            friend SmallMap<Key_T, Mapped_T, Small_N, Compare_T, Alloc_T>;
+        public:
+            typedef const value_type *pointer;
+            typedef const value_type &reference;
+
+            ConstIterator(const Iterator &it) : Iterator(it) {}
+
+            const value_type &operator*() const {
+                return this->tree ? **this->tree : (*this->flat)[this->slot];
+            }
+
+            const value_type *operator->() const {
+                return &**this;
+            }
+
+        protected:
+            ConstIterator(const FlatType *flat, size_t slot) : Iterator(flat, slot) {}
+
+            ConstIterator(const typename TreeType::ConstIterator &it) : Iterator(it) {}
+        };
+
+        // -- constructing
+        explicit SmallMap(const Compare_T &comp = Compare_T(), const Alloc_T &alloc = Alloc_T())
+                : comp(comp), alloc(alloc), flat(typename FlatType::allocator_type(alloc)) {}
+
+        SmallMap(std::initializer_list<std::pair<const Key_T, Mapped_T>> list, const Compare_T &comp = Compare_T(),
+                 const Alloc_T &alloc = Alloc_T()) : SmallMap(comp, alloc) {
+            for (const std::pair<const Key_T, Mapped_T> &value : list)
+                this->insert(value);
+        }
+
+        // A promoted map's copy is promoted too
+        SmallMap(const SmallMap &other)
+                : comp(other.comp), alloc(other.alloc), flat(other.flat),
+                  tree(other.tree ? new TreeType(*other.tree) : nullptr) {}
+
+        SmallMap(SmallMap &&other) noexcept
+                : comp(std::move(other.comp)), alloc(std::move(other.alloc)), flat(std::move(other.flat)),
+                  tree(std::move(other.tree)) {
+            other.flat.clear();
+        }
+
+        SmallMap &operator=(SmallMap other) noexcept {
+            std::swap(comp, other.comp);
+            std::swap(alloc, other.alloc);
+            flat.swap(other.flat);
+            tree.swap(other.tree);
+            return *this;
+        }
+
+        Compare_T key_comp() const {
+            return comp;
+        }
+
+        // Whether the entries have moved into a tree
+        bool promoted() const {
+            return (bool) tree;
+        }
+
+        // -- size:
+        size_t size() const {
+            return tree ? tree->size() : flat.size();
+        }
+
+        bool empty() const {
+            return !this->size();
+        }
+
+        // -- iterators:
+        Iterator begin() {
+            return tree ? Iterator(tree->begin()) : Iterator(&flat, 0);
+        }
+
+        Iterator end() {
+            return tree ? Iterator(tree->end()) : Iterator(&flat, flat.size());
+        }
+
+        // The tree is reached through a const reference, so these use Map's const overloads
+        ConstIterator begin() const {
+            return tree ? ConstIterator(std::as_const(*tree).begin()) : ConstIterator(&flat, 0);
+        }
+
+        ConstIterator end() const {
+            return tree ? ConstIterator(std::as_const(*tree).end()) : ConstIterator(&flat, flat.size());
+        }
+
+        // -- lookup:
+        Iterator find(const Key_T &key) {
+            return tree ? Iterator(tree->find(key)) : Iterator(&flat, this->findSlot(key));
+        }
+
+        ConstIterator find(const Key_T &key) const {
+            return tree ? ConstIterator(std::as_const(*tree).find(key)) : ConstIterator(&flat, this->findSlot(key));
+        }
+
+        bool contains(const Key_T &key) const {
+            return this->find(key) != this->end();
+        }
+
+        size_t count(const Key_T &key) const {
+            return this->contains(key) ? 1 : 0;
+        }
+
+        Mapped_T &at(const Key_T &key);
+
+        const Mapped_T &at(const Key_T &key) const;
+
+        Mapped_T &operator[](const Key_T &key) {
+            return this->try_emplace(key).first->second;
+        }
+
+        // First entry not ordered before `key`
+        Iterator lower_bound(const Key_T &key) {
+            return tree ? Iterator(tree->lower_bound(key)) : Iterator(&flat, this->rank(key));
+        }
+
+        ConstIterator lower_bound(const Key_T &key) const {
+            return tree ? ConstIterator(std::as_const(*tree).lower_bound(key)) : ConstIterator(&flat, this->rank(key));
+        }
+
+        // First entry ordered after `key`
+        Iterator upper_bound(const Key_T &key) {
+            return tree ? Iterator(tree->upper_bound(key)) : Iterator(&flat, this->upperSlot(key));
+        }
+
+        ConstIterator upper_bound(const Key_T &key) const {
+            return tree ? ConstIterator(std::as_const(*tree).upper_bound(key)) : ConstIterator(&flat, this->upperSlot(key));
+        }
+
+        // -- modifiers: each returns where the entry for the key is and whether it is new
+        std::pair<Iterator, bool> insert(const std::pair<const Key_T, Mapped_T> &value) {
+            return this->try_emplace(value.first, value.second);
+        }
+
+        template<typename... Args>
+        std::pair<Iterator, bool> emplace(Args &&...args) {
+            value_type value(std::forward<Args>(args)...);
+            return this->try_emplace(value.first, std::move(value.second));
+        }
+
+        // Only constructs the value (from `args`) when `key` is absent
+        template<typename... Args>
+        std::pair<Iterator, bool> try_emplace(const Key_T &key, Args &&...args);
+
+        template<typename M>
+        std::pair<Iterator, bool> insert_or_assign(const Key_T &key, M &&mapped) {
+            std::pair<Iterator, bool> inserted = this->try_emplace(key, std::forward<M>(mapped));
+            if (!inserted.second)
+                inserted.first->second = std::forward<M>(mapped);
+            return inserted;
+        }
+
+        // Throws std::out_of_range when `key` is absent, as Map's does
+        void erase(const Key_T &key);
+
+        void erase(Iterator it);
+
+        // Also goes back to the flat array
+        void clear() {
+            flat.clear();
+            tree.reset();
+        }
+
+        bool operator==(const SmallMap &other) const;
+
+        bool operator!=(const SmallMap &other) const {
+            return !(*this == other);
+        }
+
+    private:
+        Compare_T comp;
+        Alloc_T alloc;
+        FlatType flat;
+        std::unique_ptr<TreeType> tree;
+
+        // Slot of the first entry of the array not ordered before `key`
+        size_t rank(const Key_T &key) const;
+
+        bool matches(size_t slot, const Key_T &key) const {
+            return slot < flat.size() && !comp(key, flat[slot].first);
+        }
+
+        // Slot of the entry for `key`, or the end of the array
+        size_t findSlot(const Key_T &key) const {
+            size_t slot = this->rank(key);
+            return this->matches(slot, key) ? slot : flat.size();
+        }
+
+        // Slot of the first entry of the array ordered after `key`
+        size_t upperSlot(const Key_T &key) const {
+            size_t slot = this->rank(key);
+            return this->matches(slot, key) ? slot + 1 : slot;
+        }
+
+        void promote();
+    };
+
+    // Counting the smaller keys touches every entry but takes no branch on them, which beats a binary search's
+    // mispredictions on a few dozen arithmetic keys
+    template<typename Key_T, typename Mapped_T, size_t Small_N, typename Compare_T, typename Alloc_T>
+    size_t SmallMap<Key_T, Mapped_T, Small_N, Compare_T, Alloc_T>::rank(const Key_T &key) const {
+        if constexpr (std::is_arithmetic<Key_T>::value) {
+            size_t smaller = 0;
+            for (const value_type &entry : flat)
+                smaller += comp(entry.first, key);
+            return smaller;
+        } else {
+            return std::lower_bound(flat.begin(), flat.end(), key, [this](const value_type &entry, const Key_T &probe) {
+                return comp(entry.first, probe);
+            }) - flat.begin();
+        }
+    }
+
+    template<typename Key_T, typename Mapped_T, size_t Small_N, typename Compare_T, typename Alloc_T>
+    Mapped_T &SmallMap<Key_T, Mapped_T, Small_N, Compare_T, Alloc_T>::at(const Key_T &key) {
+        Iterator it = this->find(key);
+        if (it == this->end())
+            throw std::out_of_range("specified key does not exist");
+        return it->second;
+    }
+
+    template<typename Key_T, typename Mapped_T, size_t Small_N, typename Compare_T, typename Alloc_T>
+    const Mapped_T &SmallMap<Key_T, Mapped_T, Small_N, Compare_T, Alloc_T>::at(const Key_T &key) const {
+        ConstIterator it = this->find(key);
+        if (it == this->end())
+            throw std::out_of_range("specified key does not exist");
+        return it->second;
+    }
+
+    template<typename Key_T, typename Mapped_T, size_t Small_N, typename Compare_T, typename Alloc_T>
+    template<typename... Args>
+    std::pair<typename SmallMap<Key_T, Mapped_T, Small_N, Compare_T, Alloc_T>::Iterator, bool>
+    SmallMap<Key_T, Mapped_T, Small_N, Compare_T, Alloc_T>::try_emplace(const Key_T &key, Args &&...args) {
+        if (!tree) {
+            size_t slot = this->rank(key);
+            if (this->matches(slot, key))
+                return {Iterator(&flat, slot), false};
+            if (flat.size() < Small_N) {
+                flat.emplace(flat.begin() + slot, std::piecewise_construct, std::forward_as_tuple(key),
+                             std::forward_as_tuple(std::forward<Args>(args)...));
+                return {Iterator(&flat, slot), true};
+            }
+            this->promote();
+        }
+        auto inserted = tree->try_emplace(key, std::forward<Args>(args)...);
+        return {Iterator(inserted.first), inserted.second};
+    }
+
+    // The tree is built from copies of the entries and takes over only once complete, so a failed build leaves the
+    // array as it was. Entries that cannot be copied have to be moved, and a failed build then loses them.
+    template<typename Key_T, typename Mapped_T, size_t Small_N, typename Compare_T, typename Alloc_T>
+    void SmallMap<Key_T, Mapped_T, Small_N, Compare_T, Alloc_T>::promote() {
+        std::unique_ptr<TreeType> built(new TreeType(comp, alloc));
+        if constexpr (std::is_copy_constructible<value_type>::value)
+            built->assign_sorted(flat.cbegin(), flat.cend());
+        else
+            built->assign_sorted(std::make_move_iterator(flat.begin()), std::make_move_iterator(flat.end()));
+        tree = std::move(built);
+        flat.clear();
+        flat.shrink_to_fit();
+    }
+
+    template<typename Key_T, typename Mapped_T, size_t Small_N, typename Compare_T, typename Alloc_T>
+    void SmallMap<Key_T, Mapped_T, Small_N, Compare_T, Alloc_T>::erase(const Key_T &key) {
+        if (tree) {
+            tree->erase(key);
+            return;
+        }
+        size_t slot = this->rank(key);
+        if (!this->matches(slot, key))
+            throw std::out_of_range("specified key does not exist");
+        flat.erase(flat.begin() + slot);
+    }
+
+    template<typename Key_T, typename Mapped_T, size_t Small_N, typename Compare_T, typename Alloc_T>
+    void SmallMap<Key_T, Mapped_T, Small_N, Compare_T, Alloc_T>::erase(Iterator it) {
+        if (tree)
+            tree->erase(*it.tree);
+        else
+            flat.erase(flat.begin() + it.slot);
+    }
+
+    template<typename Key_T, typename Mapped_T, size_t Small_N, typename Compare_T, typename Alloc_T>
+    bool SmallMap<Key_T, Mapped_T, Small_N, Compare_T, Alloc_T>::operator==(const SmallMap &other) const {
+        if (this->size() != other.size())
+            return false;
+        for (ConstIterator it = this->begin(), theirs = other.begin(); it != this->end(); ++it, ++theirs) {
+            if (!(it->first == theirs->first && it->second == theirs->second))
+                return false;
+        }
+        return true;
+    }
+
+}
+
+#endif // AVL_TREE_SMALL_MAP
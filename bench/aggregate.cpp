@@ -0,0 +1,63 @@
+// Map::aggregate(lo, hi) with SumAggregate against summing the same range with an iterator scan, over 2000 random
+// ranges per size, then what the Sum policy adds to random insert_or_assign. Build with `make bench`, run as
+// bench/aggregate.
+
+#include "../Map.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <utility>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+typedef cs540::Map<int, long> PlainMap;
+typedef cs540::Map<int, long, std::less<int>, std::allocator<std::pair<const int, long>>, false, cs540::SumAggregate<long>> SumMap;
+
+static const int QUERIES = 2000, INSERTS = 500000;
+
+static double nanosPer(Clock::duration elapsed, size_t ops) {
+    return std::chrono::duration<double, std::nano>(elapsed).count() / ops;
+}
+
+template<typename Map_T>
+static double insertCost() {
+    std::mt19937 rng(3);
+    Clock::time_point start = Clock::now();
+    Map_T map;
+    for (int i = 0; i < INSERTS; ++i)
+        map.insert_or_assign((int) rng(), 1L);
+    return nanosPer(Clock::now() - start, INSERTS);
+}
+
+int main() {
+    for (int n : {1000, 100000, 1000000}) {
+        std::vector<std::pair<int, long>> entries;
+        for (int i = 0; i < n; ++i)
+            entries.push_back({i, (long) (i % 97)});
+        SumMap map = SumMap::from_sorted(entries.begin(), entries.end());
+
+        std::mt19937 rng(1);
+        std::vector<std::pair<int, int>> ranges;
+        for (int i = 0; i < QUERIES; ++i) {
+            int lo = rng() % n, hi = rng() % n;
+            ranges.push_back({std::min(lo, hi), std::max(lo, hi)});
+        }
+
+        long check = 0;
+        Clock::time_point start = Clock::now();
+        for (const std::pair<int, int> &range : ranges)
+            check += map.aggregate(range.first, range.second);
+        Clock::time_point aggregated = Clock::now();
+        for (const std::pair<int, int> &range : ranges)
+            for (SumMap::Iterator it = map.lower_bound(range.first); it != map.end() && it->first < range.second; ++it)
+                check -= it->second;
+        Clock::time_point scanned = Clock::now();
+
+        printf("n=%-8d aggregate %9.0f ns/range  scan %11.0f ns/range  (difference %ld)\n", n,
+               nanosPer(aggregated - start, QUERIES), nanosPer(scanned - aggregated, QUERIES), check);
+    }
+    printf("insert_or_assign %d random keys: plain %.0f ns/op, Sum policy %.0f ns/op\n", INSERTS,
+           insertCost<PlainMap>(), insertCost<SumMap>());
+}
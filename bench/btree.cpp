@@ -0,0 +1,77 @@
+// BTreeMap against the AVL Map on uint64_t -> uint64_t with random keys: insert, find and lower_bound over 2M probes
+// (half of them present keys), a full in-order scan, then erasing every other key. Build with `make bench`, run as
+// bench/btree [entries] [avl|btree]. `make bench` also builds bench/btree-scalar from this file with
+// AVL_TREE_BTREE_NO_SIMD defined, so the two binaries compare BTreeMap's AVX2 and scalar node searches; each names
+// the kernel it ran (without AVX2 in the CPU, both run the scalar one). Add -mavx2 to BENCHFLAGS to inline AVX2.
+
+#include "../BTreeMap.hpp"
+#include "../Map.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static const size_t PROBES = 2000000;
+
+static double nanosPer(Clock::duration elapsed, size_t ops) {
+    return std::chrono::duration<double, std::nano>(elapsed).count() / ops;
+}
+
+template<typename Map_T>
+static void run(const char *name, const std::vector<uint64_t> &keys, const std::vector<uint64_t> &probes) {
+    size_t n = keys.size();
+    std::unique_ptr<Map_T> map(new Map_T());
+    uint64_t check = 0;
+
+    Clock::time_point start = Clock::now();
+    for (uint64_t key : keys)
+        map->insert_or_assign(key, key);
+    Clock::time_point inserted = Clock::now();
+    for (uint64_t probe : probes) {
+        typename Map_T::Iterator it = map->find(probe);
+        if (it != map->end())
+            check += it->second;
+    }
+    Clock::time_point found = Clock::now();
+    for (uint64_t probe : probes) {
+        typename Map_T::Iterator it = map->lower_bound(probe);
+        if (it != map->end())
+            check += it->first;
+    }
+    Clock::time_point bounded = Clock::now();
+    for (const auto &entry : *map)
+        check += entry.second;
+    Clock::time_point scanned = Clock::now();
+    for (size_t i = 0; i < n; i += 2)
+        map->erase(keys[i]);
+    Clock::time_point erased = Clock::now();
+
+    printf("%-14s n=%-9zu insert %5.0f  find %5.0f  lower_bound %5.0f  scan %5.1f  erase %5.0f ns/op  (%u)\n", name, n,
+           nanosPer(inserted - start, n), nanosPer(found - inserted, probes.size()),
+           nanosPer(bounded - found, probes.size()), nanosPer(scanned - bounded, n), nanosPer(erased - scanned, n / 2),
+           (unsigned) (check & 1));
+}
+
+int main(int argc, char **argv) {
+    size_t n = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+    const char *only = argc > 2 ? argv[2] : "";
+    std::mt19937_64 rng(7);
+    std::vector<uint64_t> keys(n), probes(PROBES);
+    for (uint64_t &key : keys)
+        key = rng();
+    for (uint64_t &probe : probes)
+        probe = rng() % 2 ? keys[rng() % n] : rng();
+
+    if (!*only || !strcmp(only, "avl"))
+        run<cs540::Map<uint64_t, uint64_t>>("AVL", keys, probes);
+    if (!*only || !strcmp(only, "btree"))
+        run<cs540::BTreeMap<uint64_t, uint64_t>>(cs540::NodeSearch<uint64_t>::simd() ? "BTree (avx2)" : "BTree (scalar)",
+                                                 keys, probes);
+}
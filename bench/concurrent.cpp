@@ -0,0 +1,86 @@
+// Throughput of ConcurrentMap against a Map behind a std::shared_mutex, over 100K keys half of which are present, at
+// 0%, 10% and 50% writes (insert_or_assign or erase) and 1 to 8 threads, each run for half a second. Build with
+// `make bench`, run as bench/concurrent.
+
+#include "../ConcurrentMap.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+static const int KEYS = 100000;
+static const std::chrono::milliseconds RUN(500);
+
+// Keeps lookups whose result is otherwise unused from being optimized away
+static thread_local volatile bool found;
+
+// Millions of calls to op(rng) per second, summed over `threads` threads
+template<typename Op_T>
+static double throughput(int threads, Op_T op) {
+    std::atomic<bool> stop{false};
+    std::atomic<long> total{0};
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t)
+        workers.emplace_back([&, t] {
+            std::mt19937 rng(t);
+            long ops = 0;
+            for (; !stop.load(std::memory_order_relaxed); ops += 64)
+                for (int i = 0; i < 64; ++i)
+                    op(rng);
+            total += ops;
+        });
+    std::this_thread::sleep_for(RUN);
+    stop = true;
+    for (std::thread &worker : workers)
+        worker.join();
+    return total / std::chrono::duration<double>(RUN).count() / 1e6;
+}
+
+int main() {
+    printf("Mops/s, ConcurrentMap / shared_mutex Map (%u hardware threads)\n", std::thread::hardware_concurrency());
+    for (int writePercent : {0, 10, 50}) {
+        printf("%2d%% writes", writePercent);
+        for (int threads : {1, 2, 4, 8}) {
+            cs540::ConcurrentMap<int, int> concurrent;
+            cs540::Map<int, int> locked;
+            std::shared_mutex lock;
+            for (int key = 0; key < KEYS; key += 2) {
+                concurrent.insert({key, key});
+                locked.insert({key, key});
+            }
+
+            double lockFree = throughput(threads, [&](std::mt19937 &rng) {
+                int key = rng() % KEYS;
+                if ((int) (rng() % 100) >= writePercent)
+                    found = concurrent.contains(key);
+                else if (rng() & 1)
+                    concurrent.insert_or_assign(key, key);
+                else
+                    concurrent.erase(key);
+            });
+            double shared = throughput(threads, [&](std::mt19937 &rng) {
+                int key = rng() % KEYS;
+                if ((int) (rng() % 100) >= writePercent) {
+                    std::shared_lock<std::shared_mutex> reading(lock);
+                    found = locked.find(key) != locked.end();
+                } else {
+                    std::unique_lock<std::shared_mutex> writing(lock);
+                    if (rng() & 1) {
+                        locked.insert_or_assign(key, key);
+                    } else {
+                        cs540::Map<int, int>::Iterator it = locked.find(key);
+                        if (it != locked.end())
+                            locked.erase(it);
+                    }
+                }
+            });
+            printf("  %d thr %5.2f/%-5.2f", threads, lockFree, shared);
+        }
+        printf("\n");
+    }
+}
@@ -0,0 +1,84 @@
+// Cost of copying a 1M-entry Map<int, long>: a serial and a WorkPool copy, next to the O(1) copy of a map with
+// Snapshots_T, which borrows the nodes and copies them on write. Each copy is timed alone, followed by 100 const
+// lookups, followed by a write to one key, and followed by a full scan, along with an O(1) snapshot() and the first
+// write to the map while it is alive. Build with `make bench`, run as bench/copy [entries] [repetitions].
+
+#include "../Map.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <utility>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+typedef cs540::Map<int, long> PlainMap;
+typedef cs540::Map<int, long, std::less<int>, std::allocator<std::pair<const int, long>>, false, void, true> SnapshotMap;
+
+static volatile long sink = 0;
+
+static double millisPer(Clock::duration elapsed, int reps) {
+    return std::chrono::duration<double, std::milli>(elapsed).count() / reps;
+}
+
+// Copies `map` `reps` times and runs `use` on each copy, which is then dropped; returns ms per round. One round runs
+// untimed first: the first allocations after a large map is freed pay for the allocator tidying up after it.
+template<typename Map_T, typename Use_T>
+static double timeCopies(const Map_T &map, int reps, Use_T use) {
+    Clock::time_point start;
+    for (int r = -1; r < reps; ++r) {
+        if (!r)
+            start = Clock::now();
+        Map_T copy(map);
+        use(copy, r + 1);
+    }
+    return millisPer(Clock::now() - start, reps);
+}
+
+template<typename Map_T>
+static void report(const char *name, const Map_T &map, int n, int reps) {
+    double alone = timeCopies(map, reps, [](Map_T &copy, int) { sink += copy.size(); });
+    double read = timeCopies(map, reps, [n](const Map_T &copy, int r) {
+        for (int i = 0; i < 100; ++i)
+            sink += copy.at((int) ((r * 100 + i) * 7919L % n));
+    });
+    double write = timeCopies(map, reps, [n](Map_T &copy, int r) { copy[(int) (r * 7919L % n)] = -r; });
+    double scan = timeCopies(map, reps, [](Map_T &copy, int) {
+        long sum = 0;
+        for (auto it = copy.begin(); it != copy.end(); ++it)
+            sum += (*it).second;
+        sink += sum;
+    });
+    printf("%-28s copy %9.4f ms | + 100 lookups %9.4f ms | + one write %9.4f ms | + full scan %8.3f ms\n",
+           name, alone, read, write, scan);
+}
+
+int main(int argc, char **argv) {
+    int n = argc > 1 ? atoi(argv[1]) : 1000000, reps = argc > 2 ? atoi(argv[2]) : 10;
+    std::vector<std::pair<int, long>> entries;
+    for (int i = 0; i < n; ++i)
+        entries.push_back({i, (long) i});
+    PlainMap plain = PlainMap::from_sorted(entries.begin(), entries.end());
+    SnapshotMap versioned = SnapshotMap::from_sorted(entries.begin(), entries.end());
+
+    printf("n=%d\n", n);
+    report("Map<int, long>", plain, n, reps);
+    report("Map<..., Snapshots_T> (COW)", versioned, n, reps);
+
+    WorkPool pool;
+    Clock::time_point start = Clock::now();
+    for (int r = 0; r < reps; ++r) {
+        PlainMap copy(plain, ParallelMode(pool));
+        sink += copy.size();
+    }
+    printf("WorkPool copy %.3f ms\n", millisPer(Clock::now() - start, reps));
+
+    for (int r = -1; r < reps; ++r) {
+        if (!r)
+            start = Clock::now();
+        SnapshotMap::Snapshot view = versioned.snapshot();
+        versioned[r + 1] = -r;
+        sink += view.size();
+    }
+    printf("snapshot + one write %.4f ms\n", millisPer(Clock::now() - start, reps));
+}
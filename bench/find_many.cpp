@@ -0,0 +1,67 @@
+// Map::find_many and Map::contains_many against one find per key, on a tree built in random order so its nodes are
+// scattered in memory (8M long -> long entries by default, well past the last-level cache). 2M random probes, about
+// half of them hits, in batches of 16 to 1024. Build with `make bench`, run as bench/find_many [entries].
+
+#include "../Map.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+typedef cs540::Map<long, long> LongMap;
+
+static const long PROBES = 2000000;
+
+static double nanosPer(Clock::duration elapsed, long ops) {
+    return std::chrono::duration<double, std::nano>(elapsed).count() / ops;
+}
+
+int main(int argc, char **argv) {
+    long n = argc > 1 ? atol(argv[1]) : 8000000;
+    std::mt19937_64 rng(1);
+    std::vector<long> keys(n);
+    for (long i = 0; i < n; ++i)
+        keys[i] = i * 2;
+    std::shuffle(keys.begin(), keys.end(), rng);
+    LongMap map;
+    for (long key : keys)
+        map.insert_or_assign(key, key);
+    const LongMap &lookup = map;
+
+    std::vector<long> probes(PROBES);
+    for (long &probe : probes)
+        probe = rng() % (2 * n);
+
+    for (size_t batch : {16, 64, 256, 1024}) {
+        std::vector<LongMap::ConstIterator> found(batch, lookup.end());
+        std::unique_ptr<bool[]> present(new bool[batch]);
+        long singleHits = 0, manyHits = 0, containsHits = 0;
+
+        Clock::time_point start = Clock::now();
+        for (long i = 0; i + (long) batch <= PROBES; i += batch)
+            for (size_t j = 0; j < batch; ++j)
+                singleHits += lookup.find(probes[i + j]) != lookup.end();
+        Clock::time_point single = Clock::now();
+        for (long i = 0; i + (long) batch <= PROBES; i += batch) {
+            lookup.find_many(&probes[i], batch, found.data());
+            for (size_t j = 0; j < batch; ++j)
+                manyHits += found[j] != lookup.end();
+        }
+        Clock::time_point many = Clock::now();
+        for (long i = 0; i + (long) batch <= PROBES; i += batch) {
+            lookup.contains_many(&probes[i], batch, present.get());
+            for (size_t j = 0; j < batch; ++j)
+                containsHits += present[j];
+        }
+        Clock::time_point contains = Clock::now();
+
+        printf("n=%ld batch %4zu: find %5.0f  find_many %5.0f  contains_many %5.0f ns/key%s\n", n, batch,
+               nanosPer(single - start, PROBES), nanosPer(many - single, PROBES), nanosPer(contains - many, PROBES),
+               singleHits == manyHits && manyHits == containsHits ? "" : "  (hit counts differ!)");
+    }
+}
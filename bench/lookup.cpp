@@ -0,0 +1,43 @@
+// Map::find over present keys, visited in shuffled order, five passes per size. The keys are spread over their range
+// (or given a long common prefix, for strings) so that every comparison does real work. Build with `make bench`, run
+// as bench/lookup.
+
+#include "../Map.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static const int PASSES = 5;
+
+template<typename Key_T, typename Make_T>
+void lookups(const char *name, int n, Make_T make) {
+    cs540::Map<Key_T, int> map;
+    std::vector<Key_T> keys;
+    for (int i = 0; i < n; ++i) {
+        keys.push_back(make(i));
+        map.insert({keys.back(), i});
+    }
+    std::mt19937 rng(1);
+    std::shuffle(keys.begin(), keys.end(), rng);
+
+    long sum = 0;
+    Clock::time_point start = Clock::now();
+    for (int pass = 0; pass < PASSES; ++pass)
+        for (const Key_T &key : keys)
+            sum += map.find(key)->second;
+    double nanos = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    printf("%-6s n=%-8d find %6.1f ns/op  (%ld)\n", name, n, nanos / ((double) PASSES * n), sum);
+}
+
+int main() {
+    for (int n : {1000, 100000, 1000000})
+        lookups<int>("int", n, [](int i) { return (int) (i * 2654435761u); });
+    for (int n : {1000, 100000})
+        lookups<std::string>("string", n, [](int i) { return "key-prefix-" + std::to_string(i * 2654435761u); });
+}
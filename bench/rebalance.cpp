@@ -0,0 +1,38 @@
+// Insert and erase cost of the AVL tree, with its incremental rebalancing along the parent path: shuffled int keys are
+// inserted one by one, then erased in the same order. Build with `make bench`, run as bench/rebalance.
+
+#include "../tree/AVL.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static double nanosPer(Clock::duration elapsed, size_t ops) {
+    return std::chrono::duration<double, std::nano>(elapsed).count() / ops;
+}
+
+int main() {
+    std::mt19937 rng(1);
+    for (int n : {1000, 10000, 100000, 1000000, 10000000}) {
+        std::vector<int> keys(n);
+        for (int i = 0; i < n; ++i)
+            keys[i] = i;
+        std::shuffle(keys.begin(), keys.end(), rng);
+
+        AVL<int> tree;
+        Clock::time_point start = Clock::now();
+        for (int key : keys)
+            tree.insert(key);
+        Clock::time_point inserted = Clock::now();
+        for (int key : keys)
+            tree.deleteNode(key);
+        Clock::time_point erased = Clock::now();
+
+        printf("AVL<int> n=%-8d insert %7.1f ns/op  erase %7.1f ns/op\n", n, nanosPer(inserted - start, n),
+               nanosPer(erased - inserted, n));
+    }
+}
@@ -0,0 +1,57 @@
+// How evenly ShardedMap<long, long, 16> spreads 1M keys, random and ascending, over its shards as it fills from no cuts,
+// and the time to insert the random keys from 1 to 8 writer threads. Build with `make bench`, run as bench/sharded.
+
+#include "../ShardedMap.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+typedef cs540::ShardedMap<long, long, 16> Sharded;
+
+static const int KEYS = 1000000;
+
+static void printSizes(const char *name, const Sharded &map) {
+    printf("%-10s", name);
+    for (size_t size : map.shard_sizes())
+        printf(" %6zu", size);
+    printf("\n");
+}
+
+int main() {
+    std::mt19937_64 rng(1);
+    std::vector<long> keys(KEYS);
+    for (long &key : keys)
+        key = (long) (rng() >> 1);
+
+    {
+        Sharded map;
+        for (long key : keys)
+            map.insert({key, key});
+        printSizes("random", map);
+    }
+    {
+        Sharded map;
+        for (long key = 0; key < KEYS; ++key)
+            map.insert({key, key});
+        printSizes("ascending", map);
+    }
+
+    for (int threads : {1, 2, 4, 8}) {
+        Clock::time_point start = Clock::now();
+        Sharded map;
+        std::vector<std::thread> writers;
+        for (int t = 0; t < threads; ++t)
+            writers.emplace_back([&, t] {
+                for (int i = t; i < KEYS; i += threads)
+                    map.insert({keys[i], keys[i]});
+            });
+        for (std::thread &writer : writers)
+            writer.join();
+        printf("%d writer thread%s %6.0f ms\n", threads, threads > 1 ? "s" : " ",
+               std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+    }
+}
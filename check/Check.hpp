@@ -0,0 +1,36 @@
+#ifndef AVL_TREE_CHECK
+#define AVL_TREE_CHECK
+
+// Shared by the differential checks in check/: each drives a container and a std::map through the same operations and
+// compares them. A check exits nonzero once anything differs. Build and run them all with `make check`.
+
+#include <atomic>
+#include <cstdio>
+#include <exception>
+
+// Atomic for the checks that run several threads
+static std::atomic<int> failures{0};
+
+// Prints the first few failures where they happen and counts all of them
+#define CHECK(...) do { \
+        if (!(__VA_ARGS__) && failures++ < 10) \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #__VA_ARGS__); \
+    } while (0)
+
+template<typename Op_T>
+static bool throws(Op_T op) {
+    try {
+        op();
+    } catch (std::exception &) {
+        return true;
+    }
+    return false;
+}
+
+// The exit status of a check
+static int report(const char *name) {
+    printf("%s: %d failure%s\n", name, failures.load(), failures.load() == 1 ? "" : "s");
+    return failures.load() != 0;
+}
+
+#endif // AVL_TREE_CHECK
@@ -0,0 +1,82 @@
+// FrozenMap against std::map: maps of every size up to a few thousand entries, including the ones that leave the last
+// level of the implicit tree partly filled, are frozen from a Map and probed for keys inside, between and outside their
+// entries, in both directions of iteration. Also string keys under std::greater. Run by `make check`.
+
+#include "../FrozenMap.hpp"
+#include "Check.hpp"
+
+#include <map>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+using cs540::FrozenMap;
+using cs540::Map;
+
+template<typename Frozen_T, typename Reference_T, typename Probe_T>
+static void compare(const Frozen_T &frozen, const Reference_T &reference, Probe_T probe) {
+    CHECK(frozen.size() == reference.size() && frozen.empty() == reference.empty());
+    typename Frozen_T::ConstIterator it = frozen.begin();
+    for (const auto &entry : reference) {
+        if (it == frozen.end() || it->first != entry.first || it->second != entry.second) {
+            CHECK(false);
+            return;
+        }
+        ++it;
+    }
+    CHECK(it == frozen.end());
+    for (auto entry = reference.rbegin(); entry != reference.rend(); ++entry)
+        CHECK((--it)->first == entry->first);
+
+    for (int i = 0; i < 300; ++i) {
+        typename Reference_T::key_type key = probe();
+        auto lower = reference.lower_bound(key), upper = reference.upper_bound(key);
+        typename Frozen_T::ConstIterator frozenLower = frozen.lower_bound(key), frozenUpper = frozen.upper_bound(key);
+        CHECK(lower == reference.end() ? frozenLower == frozen.end() : frozenLower != frozen.end() && frozenLower->first == lower->first);
+        CHECK(upper == reference.end() ? frozenUpper == frozen.end() : frozenUpper != frozen.end() && frozenUpper->first == upper->first);
+        CHECK(frozen.equal_range(key) == std::make_pair(frozenLower, frozenUpper));
+        CHECK(frozen.contains(key) == (reference.count(key) == 1) && frozen.count(key) == reference.count(key));
+        if (reference.count(key))
+            CHECK(frozen.find(key) == frozenLower && frozen.at(key) == reference.at(key));
+        else
+            CHECK(frozen.find(key) == frozen.end() && throws([&] { frozen.at(key); }));
+    }
+}
+
+int main() {
+    std::mt19937 rng(21);
+    for (int round = 0; round < 300; ++round) {
+        Map<int, int> map;
+        std::map<int, int> reference;
+        int range = 1 + (int) (rng() % 5000), count = round < 70 ? round : (int) (rng() % 3000);
+        for (int i = 0; i < count; ++i) {
+            int key = (int) (rng() % range);
+            map.insert_or_assign(key, i);
+            reference[key] = i;
+        }
+        auto probe = [&] { return (int) (rng() % (range + 10)) - 5; };
+        FrozenMap<int, int> frozen(map);
+        compare(frozen, reference, probe);
+
+        FrozenMap<int, int> copy(frozen), assigned;
+        assigned = copy;
+        FrozenMap<int, int> moved(std::move(copy));
+        CHECK(assigned == frozen && moved == frozen && copy.empty() && copy.begin() == copy.end());
+        compare(moved, reference, probe);
+    }
+
+    Map<std::string, int, std::greater<std::string>> map;
+    std::map<std::string, int, std::greater<std::string>> reference;
+    for (int i = 0; i < 1000; ++i) {
+        std::string key = std::to_string(rng() % 2000);
+        map.insert_or_assign(key, i);
+        reference[key] = i;
+    }
+    FrozenMap<std::string, int, std::greater<std::string>> frozen(map);
+    compare(frozen, reference, [&] { return std::to_string(rng() % 2100); });
+
+    std::vector<std::pair<int, int>> repeated{{1, 1}, {1, 2}};
+    CHECK(throws([&] { FrozenMap<int, int> bad(repeated.begin(), repeated.end()); }));
+    return report("frozen");
+}
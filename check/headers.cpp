@@ -0,0 +1,122 @@
+// Every map in the tree against one std::map: the same random inserts, assignments and erasures go to Map (plain, with
+// order statistics and aggregates, and with snapshots), SmallMap, BTreeMap, ConcurrentMap and ShardedMap, and the
+// result is frozen into a FrozenMap, saved and mapped as a MappedMap, and streamed through write_to and read_from. This
+// is also the one check that includes every header, so none of them can stop compiling unnoticed. Run by
+// `make check`.
+
+#include "../BTreeMap.hpp"
+#include "../ConcurrentMap.hpp"
+#include "../FrozenMap.hpp"
+#include "../Map.hpp"
+#include "../MappedMap.hpp"
+#include "../ShardedMap.hpp"
+#include "../SmallMap.hpp"
+#include "Check.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <utility>
+
+using namespace cs540;
+
+typedef std::map<int, long> Reference;
+typedef Map<int, long, std::less<int>, std::allocator<std::pair<const int, long>>, true, SumAggregate<long>> CountedMap;
+typedef Map<int, long, std::less<int>, std::allocator<std::pair<const int, long>>, false, void, true> SnapshotMap;
+
+template<typename Map_T>
+static void compare(const Map_T &map, const Reference &reference) {
+    CHECK(map.size() == reference.size());
+    Reference::const_iterator expected = reference.begin();
+    for (const auto &entry : map) {
+        if (expected == reference.end() || entry.first != expected->first || entry.second != expected->second) {
+            CHECK(false);
+            return;
+        }
+        ++expected;
+    }
+    CHECK(expected == reference.end());
+}
+
+// Erasing a missing key throws from the maps that return nothing
+template<typename Map_T>
+static void erase(Map_T &map, int key, bool present) {
+    CHECK(throws([&] { map.erase(key); }) == !present);
+}
+
+int main() {
+    Map<int, long> plain;
+    CountedMap counted;
+    SnapshotMap versioned;
+    SmallMap<int, long, 16> small;
+    BTreeMap<int, long> btree;
+    ConcurrentMap<int, long> concurrent;
+    ShardedMap<int, long, 4> sharded;
+    Reference reference, atSnapshot;
+
+    std::mt19937 rng(1);
+    SnapshotMap::Snapshot before = versioned.snapshot();
+    for (int i = 0; i < 30000; ++i) {
+        int key = (int) (rng() % 5000);
+        long value = (long) (rng() % 1000);
+        if (rng() % 4 == 0) {
+            bool present = reference.erase(key) == 1;
+            erase(plain, key, present);
+            erase(counted, key, present);
+            erase(versioned, key, present);
+            erase(small, key, present);
+            erase(btree, key, present);
+            CHECK(concurrent.erase(key) == present && sharded.erase(key) == present);
+        } else {
+            bool added = !reference.count(key);
+            reference[key] = value;
+            plain.insert_or_assign(key, value);
+            counted.insert_or_assign(key, value);
+            counted.refresh(counted.find(key));
+            versioned[key] = value;
+            small.insert_or_assign(key, value);
+            btree.insert_or_assign(key, value);
+            CHECK(concurrent.insert_or_assign(key, value) == added && sharded.insert_or_assign(key, value) == added);
+        }
+        if (i == 15000) {
+            before = versioned.snapshot();
+            atSnapshot = reference;
+        }
+    }
+    compare(before, atSnapshot);
+
+    compare(plain, reference);
+    compare(counted, reference);
+    compare(versioned, reference);
+    compare(small, reference);
+    compare(btree, reference);
+    compare(sharded, reference);
+    Reference fromConcurrent;
+    concurrent.for_each([&](const std::pair<int, long> &entry) { fromConcurrent.insert(entry); });
+    CHECK(fromConcurrent == reference && concurrent.size() == reference.size());
+
+    long sum = 0;
+    for (const Reference::value_type &entry : reference)
+        sum += entry.second;
+    CHECK(counted.aggregate() == sum);
+    CHECK(counted.rank(2500) == (size_t) std::distance(reference.begin(), reference.lower_bound(2500)));
+
+    FrozenMap<int, long> frozen(plain);
+    compare(frozen, reference);
+
+    std::string directory = std::getenv("TMPDIR") ? std::getenv("TMPDIR") : "/tmp";
+    std::string image = directory + "/avl-tree-check-headers";
+    plain.save(image);
+    compare(MappedMap<int, long>::open(image), reference);
+    std::remove(image.c_str());
+
+    std::stringstream stream;
+    plain.write_to(stream);
+    Map<int, long> streamed;
+    streamed.read_from(stream);
+    compare(streamed, reference);
+    return report("headers");
+}
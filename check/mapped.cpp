@@ -0,0 +1,92 @@
+// MappedMap against std::map: Maps of up to a few thousand entries are saved, mapped back and probed, and files that are
+// missing, foreign, empty, truncated or of another key type are refused. Files go to $TMPDIR, or /tmp. Run by
+// `make check`.
+
+#include "../MappedMap.hpp"
+#include "Check.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <random>
+#include <string>
+#include <utility>
+
+using cs540::Map;
+using cs540::MappedMap;
+
+int main() {
+    std::string directory = std::getenv("TMPDIR") ? std::getenv("TMPDIR") : "/tmp";
+    std::string image = directory + "/avl-tree-check-mapped", other = image + "-other";
+    std::mt19937 rng(24);
+    for (int round = 0; round < 60; ++round) {
+        Map<int, double> map;
+        std::map<int, double> reference;
+        int count = round < 5 ? round : (int) (rng() % 3000);
+        for (int i = 0; i < count; ++i) {
+            int key = (int) (rng() % 5000) - 2500;
+            map[key] = i * 0.5;
+            reference[key] = i * 0.5;
+        }
+        map.save(image);
+        MappedMap<int, double> mapped = MappedMap<int, double>::open(image);
+        CHECK(mapped.size() == reference.size());
+        std::map<int, double>::iterator expected = reference.begin();
+        for (const auto &entry : mapped) {
+            CHECK(expected != reference.end() && entry.first == expected->first && entry.second == expected->second);
+            ++expected;
+        }
+        for (int key = -2600; key < 2600; key += 7) {
+            MappedMap<int, double>::ConstIterator lower = mapped.lower_bound(key), upper = mapped.upper_bound(key);
+            std::map<int, double>::iterator expectedLower = reference.lower_bound(key);
+            std::map<int, double>::iterator expectedUpper = reference.upper_bound(key);
+            CHECK((lower == mapped.end()) == (expectedLower == reference.end()));
+            if (expectedLower != reference.end())
+                CHECK(lower->first == expectedLower->first);
+            CHECK((upper == mapped.end()) == (expectedUpper == reference.end()));
+            if (expectedUpper != reference.end())
+                CHECK(upper->first == expectedUpper->first);
+            CHECK(mapped.count(key) == reference.count(key));
+            if (reference.count(key))
+                CHECK(mapped.at(key) == reference[key]);
+            else
+                CHECK(throws([&] { mapped.at(key); }));
+        }
+        MappedMap<int, double> moved(std::move(mapped));
+        CHECK(mapped.empty() && moved.size() == reference.size());
+    }
+
+    // Saving over a mapped file leaves the old mapping whole
+    Map<int, int> before{{1, 10}, {2, 20}}, after{{5, 50}};
+    before.save(other);
+    MappedMap<int, int> old = MappedMap<int, int>::open(other);
+    after.save(other);
+    CHECK(old.size() == 2 && old.at(2) == 20);
+    CHECK(MappedMap<int, int>::open(other).at(5) == 50);
+
+    CHECK(throws([&] { MappedMap<int, int>::open(directory + "/avl-tree-check-missing"); }));
+    CHECK(throws([&] { MappedMap<long, int>::open(other); }));
+    {
+        std::ofstream foreign(image, std::ios::binary | std::ios::trunc);
+        foreign << "hello";
+    }
+    CHECK(throws([&] { MappedMap<int, int>::open(image); }));
+    {
+        std::ofstream empty(image, std::ios::binary | std::ios::trunc);
+    }
+    CHECK(throws([&] { MappedMap<int, int>::open(image); }));
+    {
+        std::ifstream in(other, std::ios::binary);
+        std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        std::ofstream truncated(image, std::ios::binary | std::ios::trunc);
+        truncated << bytes.substr(0, bytes.size() - 4);
+    }
+    CHECK(throws([&] { MappedMap<int, int>::open(image); }));
+    CHECK(throws([&] { after.save(directory + "/avl-tree-check-missing/image"); }));
+
+    std::remove(image.c_str());
+    std::remove(other.c_str());
+    return report("mapped");
+}
@@ -0,0 +1,160 @@
+// ShardedMap against std::map: random inserts, assignments, erasures and lookups from one thread, then writers on
+// disjoint keys from several threads next to a reader, each writer keeping a std::map of its own keys. Also checks that
+// the shards even out as the map fills, for random and for ascending keys. Run by `make check`.
+
+#include "../ShardedMap.hpp"
+#include "Check.hpp"
+
+#include <map>
+#include <random>
+#include <thread>
+#include <vector>
+
+using cs540::ShardedMap;
+
+template<typename Map_T, typename Reference_T>
+static void compare(const Map_T &map, const Reference_T &reference) {
+    CHECK(map.size() == reference.size());
+    typename Reference_T::const_iterator expected = reference.begin();
+    for (typename Map_T::ConstIterator it = map.begin(); it != map.end(); ++it, ++expected) {
+        if (expected == reference.end() || it->first != expected->first || it->second != expected->second) {
+            CHECK(false);
+            return;
+        }
+    }
+    CHECK(expected == reference.end());
+    expected = reference.begin();
+    bool same = true;
+    map.for_each([&](const typename Map_T::value_type &entry) {
+        if (expected == reference.end() || entry.first != expected->first || entry.second != expected->second)
+            same = false;
+        else
+            ++expected;
+    });
+    CHECK(same && expected == reference.end());
+}
+
+// Every shard within half a share of the even split
+template<typename Map_T>
+static void checkEven(const Map_T &map) {
+    std::vector<size_t> sizes = map.shard_sizes();
+    size_t share = map.size() / sizes.size();
+    for (size_t size : sizes)
+        CHECK(size >= share / 2 && size <= share + share / 2);
+}
+
+static void singleThread() {
+    ShardedMap<int, long, 8> map;
+    std::map<int, long> reference;
+    std::mt19937 rng(18);
+    for (int i = 0; i < 200000; ++i) {
+        int key = (int) (rng() % 1000000);
+        switch (rng() % 10) {
+            case 0:
+                CHECK(map.erase(key) == (reference.erase(key) == 1));
+                break;
+            case 1:
+                CHECK(map.insert_or_assign(key, (long) i) == !reference.count(key));
+                reference[key] = i;
+                break;
+            case 2:
+                CHECK(map.emplace(key, (long) -i) == reference.emplace(key, (long) -i).second);
+                break;
+            case 3: {
+                std::optional<std::pair<int, long>> found = map.lower_bound_entry(key);
+                std::map<int, long>::iterator expected = reference.lower_bound(key);
+                CHECK(found.has_value() == (expected != reference.end()));
+                if (found && expected != reference.end())
+                    CHECK(found->first == expected->first && found->second == expected->second);
+                break;
+            }
+            case 4: {
+                std::optional<long> value = map.get(key);
+                CHECK(value.has_value() == (reference.count(key) == 1));
+                if (value)
+                    CHECK(*value == reference[key]);
+                CHECK(map.contains(key) == value.has_value());
+                break;
+            }
+            default:
+                CHECK(map.insert({key, (long) key}) == reference.insert({key, (long) key}).second);
+        }
+    }
+    compare(map, reference);
+    for (int key = -1; key < 1000100; key += 997) {
+        ShardedMap<int, long, 8>::ConstIterator it = map.lower_bound(key);
+        std::map<int, long>::iterator expected = reference.lower_bound(key);
+        CHECK((it == map.end()) == (expected == reference.end()));
+        if (it != map.end() && expected != reference.end())
+            CHECK(it->first == expected->first);
+    }
+    checkEven(map);
+    map.clear();
+    CHECK(map.empty() && map.begin() == map.end());
+
+    ShardedMap<int, long, 4> cut({100, 200, 300});
+    for (int key = 0; key < 400; ++key)
+        cut.insert({key, key});
+    CHECK(cut.shard_sizes() == std::vector<size_t>({100, 100, 100, 100}));
+    CHECK(throws([] { ShardedMap<int, long, 4> tooMany({1, 2, 3, 4}); }));
+    CHECK(throws([] { ShardedMap<int, long, 4> unordered({2, 1}); }));
+}
+
+static void ascending() {
+    ShardedMap<long, long, 16> map;
+    for (long key = 0; key < 300000; ++key)
+        map.insert({key, key});
+    CHECK(map.size() == 300000);
+    checkEven(map);
+}
+
+static void concurrent() {
+    const int WRITERS = 4, OPS = 50000;
+    ShardedMap<long, long, 16> map;
+    std::vector<std::map<long, long>> references(WRITERS);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < WRITERS; ++t)
+        threads.emplace_back([&, t] {
+            std::mt19937 rng(t);
+            std::map<long, long> &reference = references[t];
+            for (int i = 0; i < OPS; ++i) {
+                // Writer t owns the keys equal to t modulo WRITERS; half the writers go in ascending order
+                long key = (t % 2 ? (long) i : (long) (rng() % 10000000)) * WRITERS + t;
+                if (i % 7 == 0) {
+                    CHECK(map.erase(key) == (reference.erase(key) == 1));
+                } else {
+                    CHECK(map.insert_or_assign(key, (long) i) == !reference.count(key));
+                    reference[key] = i;
+                }
+                if (i % 5 == 0) {
+                    std::optional<long> value = map.get(key);
+                    CHECK(value.has_value() == (reference.count(key) == 1));
+                }
+            }
+        });
+    threads.emplace_back([&map] {
+        for (int pass = 0; pass < 10; ++pass) {
+            long previous = -1;
+            bool ordered = true;
+            map.for_each([&](const std::pair<long, long> &entry) {
+                ordered = ordered && entry.first > previous;
+                previous = entry.first;
+            });
+            CHECK(ordered);
+        }
+    });
+    for (std::thread &thread : threads)
+        thread.join();
+
+    std::map<long, long> reference;
+    for (const std::map<long, long> &own : references)
+        reference.insert(own.begin(), own.end());
+    compare(map, reference);
+}
+
+int main() {
+    singleThread();
+    ascending();
+    concurrent();
+    return report("sharded");
+}
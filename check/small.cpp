@@ -0,0 +1,103 @@
+// SmallMap against std::map: random operations on maps that grow past the flat threshold and shrink back, with small
+// and large thresholds and int and string keys, checking the map after every step and its copies and moves at the end
+// of each round. Run by `make check`.
+
+#include "../SmallMap.hpp"
+#include "Check.hpp"
+
+#include <map>
+#include <random>
+#include <string>
+#include <utility>
+
+using cs540::SmallMap;
+
+template<typename Key_T, size_t Small_N, typename Key_F>
+static void run(Key_F makeKey, int rounds) {
+    typedef SmallMap<Key_T, int, Small_N> Small;
+    std::mt19937 rng(23);
+    for (int round = 0; round < rounds; ++round) {
+        Small map;
+        std::map<Key_T, int> reference;
+        int steps = (int) (rng() % 200);
+        for (int i = 0; i < steps; ++i) {
+            Key_T key = makeKey(rng() % 60);
+            switch (rng() % 7) {
+                case 0:
+                case 1:
+                case 2: {
+                    std::pair<typename Small::Iterator, bool> inserted = map.insert({key, i});
+                    std::pair<typename std::map<Key_T, int>::iterator, bool> expected = reference.insert({key, i});
+                    CHECK(inserted.second == expected.second);
+                    CHECK(inserted.first->first == key && inserted.first->second == expected.first->second);
+                    break;
+                }
+                case 3: {
+                    bool missing = !reference.count(key);
+                    CHECK(throws([&] { map.erase(key); }) == missing);
+                    reference.erase(key);
+                    break;
+                }
+                case 4:
+                    map[key] += 1;
+                    reference[key] += 1;
+                    break;
+                case 5: {
+                    typename Small::Iterator lower = map.lower_bound(key), upper = map.upper_bound(key);
+                    typename std::map<Key_T, int>::iterator expectedLower = reference.lower_bound(key);
+                    typename std::map<Key_T, int>::iterator expectedUpper = reference.upper_bound(key);
+                    CHECK((lower == map.end()) == (expectedLower == reference.end()));
+                    if (expectedLower != reference.end())
+                        CHECK(lower->first == expectedLower->first);
+                    CHECK((upper == map.end()) == (expectedUpper == reference.end()));
+                    if (expectedUpper != reference.end())
+                        CHECK(upper->first == expectedUpper->first);
+                    typename Small::Iterator found = map.find(key);
+                    CHECK((found == map.end()) == !reference.count(key));
+                    if (found != map.end()) {
+                        map.erase(found);
+                        reference.erase(key);
+                    }
+                    break;
+                }
+                default:
+                    map.insert_or_assign(key, -i);
+                    reference[key] = -i;
+            }
+            CHECK(map.size() == reference.size() && map.contains(key) == (reference.count(key) == 1));
+        }
+
+        typename std::map<Key_T, int>::iterator expected = reference.begin();
+        for (const auto &entry : map) {
+            CHECK(expected != reference.end() && entry.first == expected->first && entry.second == expected->second);
+            ++expected;
+        }
+        CHECK(expected == reference.end());
+        if (!reference.empty())
+            CHECK((--map.end())->first == reference.rbegin()->first);
+        if (reference.size() > Small_N)
+            CHECK(map.promoted());
+
+        Small copy(map);
+        const Small &constant = copy;
+        CHECK(copy == map);
+        for (const auto &entry : reference)
+            CHECK(constant.at(entry.first) == entry.second);
+        Small moved(std::move(copy));
+        CHECK(moved == map);
+        copy = moved;
+        CHECK(copy == map);
+        map.clear();
+        CHECK(!map.promoted() && map.empty());
+    }
+}
+
+int main() {
+    run<int, 8>([](unsigned n) { return (int) n - 30; }, 400);
+    run<int, 32>([](unsigned n) { return (int) n; }, 400);
+    run<std::string, 16>([](unsigned n) { return std::to_string(n); }, 300);
+
+    SmallMap<int, int> listed{{3, 1}, {1, 2}};
+    CHECK(listed.begin()->first == 1 && listed.count(3) == 1);
+    return report("small");
+}
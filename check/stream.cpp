@@ -0,0 +1,135 @@
+// Map::write_to and read_from against std::map: maps of string keys and vector values, of up to a few thousand
+// entries, go through a stream with and without checksums and with one-byte and larger blocks. Truncated, corrupted,
+// foreign and out-of-order streams must be refused with the target left as it was. Also a user-defined Codec, enum
+// keys, streams embedded in a longer one, and order statistics after a read. Run by `make check`.
+
+#include "../Map.hpp"
+#include "Check.hpp"
+
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+using cs540::Map;
+
+enum class Color : short {
+    RED = -1, GREEN = 7
+};
+
+struct Point {
+    int x;
+    std::string label;
+
+    bool operator==(const Point &other) const {
+        return x == other.x && label == other.label;
+    }
+};
+
+template<>
+struct Codec<Point> {
+    static void encode(ByteWriter &out, const Point &point) {
+        Codec<int>::encode(out, point.x);
+        Codec<std::string>::encode(out, point.label);
+    }
+
+    static Point decode(ByteReader &in) {
+        int x = Codec<int>::decode(in);
+        return Point{x, Codec<std::string>::decode(in)};
+    }
+};
+
+typedef std::vector<std::pair<long, double>> Samples;
+
+int main() {
+    std::mt19937 rng(25);
+    for (int round = 0; round < 80; ++round) {
+        Map<std::string, Samples> map;
+        std::map<std::string, Samples> reference;
+        int count = round < 4 ? round : (int) (rng() % 2000);
+        for (int i = 0; i < count; ++i) {
+            std::string key = std::to_string(rng() % 100000) + std::string(rng() % 40, 'x');
+            Samples samples(rng() % 4);
+            for (std::pair<long, double> &sample : samples)
+                sample = {(long) rng() - (1L << 31) - (long) (rng() % 3) * (1L << 40), rng() * 0.001};
+            map[key] = samples;
+            reference[key] = samples;
+        }
+        bool checksums = round % 2;
+        std::stringstream stream;
+        map.write_to(stream, checksums, round % 3 ? 512 : 1);
+        std::string bytes = stream.str();
+
+        Map<std::string, Samples> back{{"stale", {}}};
+        back.read_from(stream);
+        CHECK(back.size() == reference.size());
+        std::map<std::string, Samples>::iterator expected = reference.begin();
+        for (const auto &entry : back) {
+            CHECK(expected != reference.end() && entry.first == expected->first && entry.second == expected->second);
+            ++expected;
+        }
+
+        if (count) {
+            Map<std::string, Samples> kept{{"kept", {}}};
+            std::stringstream truncated(bytes.substr(0, bytes.size() - 1));
+            CHECK(throws([&] { kept.read_from(truncated); }) && kept.size() == 1);
+            if (checksums) {
+                std::string corrupted = bytes;
+                corrupted[bytes.size() - 6] ^= 0x20;
+                std::stringstream in(corrupted);
+                CHECK(throws([&] { kept.read_from(in); }) && kept.size() == 1);
+            }
+        }
+    }
+
+    // A stream in another key order is refused
+    {
+        Map<int, int> ascending{{1, 1}, {2, 2}, {3, 3}};
+        std::stringstream stream;
+        ascending.write_to(stream, false);
+        std::string bytes = stream.str();
+        Map<int, int, std::greater<int>> descending;
+        std::stringstream in(bytes), again(bytes);
+        CHECK(throws([&] { descending.read_from(in); }) && descending.empty());
+        Map<int, int> back;
+        back.read_from(again);
+        CHECK(back == ascending);
+    }
+
+    // A custom Codec and enum keys, embedded in a longer stream
+    {
+        Map<int, Point> points{{-5, {1, "a"}}, {9, {-2, "bb"}}};
+        Map<Color, int> colors{{Color::RED, 1}, {Color::GREEN, 2}};
+        std::stringstream stream;
+        points.write_to(stream);
+        colors.write_to(stream);
+        stream << "tail";
+        Map<int, Point> pointsBack;
+        Map<Color, int> colorsBack;
+        pointsBack.read_from(stream);
+        colorsBack.read_from(stream);
+        std::string tail;
+        stream >> tail;
+        CHECK(pointsBack == points && colorsBack == colors && tail == "tail");
+    }
+
+    {
+        std::stringstream garbage("garbage!!");
+        Map<int, int> map;
+        CHECK(throws([&] { map.read_from(garbage); }) && map.empty());
+    }
+
+    // Order statistics hold after the bottom-up build of a read
+    {
+        Map<long, long, std::less<long>, std::allocator<std::pair<const long, long>>, true> counted, back;
+        for (long i = 0; i < 1000; ++i)
+            counted[i * 3] = i;
+        std::stringstream stream;
+        counted.write_to(stream);
+        back.read_from(stream);
+        CHECK(back.rank(300) == 100 && back.select(5)->first == 15);
+    }
+    return report("stream");
+}
@@ -1,23 +1,137 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <iostream>
 #include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+#include <experimental/type_traits>
 
 #ifndef AVL_TREE
 #define AVL_TREE
 
-#define IS_BALANCED(node) ((node->balance < 2) && (node->balance > -2))
-#define BALANCE_TYPE(node) (node->balance > 0 ? LEFT_HEAVY : (node->balance < 0 ? RIGHT_HEAVY : BALANCED))
+#define BALANCE_TYPE(node) (node->balance() > 0 ? LEFT_HEAVY : (node->balance() < 0 ? RIGHT_HEAVY : BALANCED))
 
 #include "BST.hpp"
+#include "WorkPool.hpp"
 
-template<typename Data_T>
-class AVL : public BST<Data_T> {
+// Per-node order statistics: the number of nodes in the subtree rooted at the node. When the augmentation is off the
+// base is empty and takes no space in the node.
+template<bool Enabled_T>
+class SubtreeSize {
+public:
+    size_t subtreeSize = 1;
+};
+
+template<>
+class SubtreeSize<false> {
+};
+
+// Per-node aggregate for a monoid policy Aggregate_T, which has to provide
+//     typedef ... value_type;
+//     static value_type identity();
+//     static value_type combine(const value_type &, const value_type &);   // associative, identity() is neutral
+//     static value_type of(const Data_T &);                                // what a single entry contributes
+// Every node holds the combination, in key order, of all the entries in its subtree. Aggregate_T = void turns the
+// augmentation off and leaves an empty base.
+template<typename Aggregate_T>
+class SubtreeAggregate {
+public:
+    typedef typename Aggregate_T::value_type value_type;
+
+    value_type aggregate = Aggregate_T::identity();
+};
+
+template<>
+class SubtreeAggregate<void> {
+public:
+    typedef void value_type;
+};
+
+// Per-node snapshot generation (see AVL::Snapshot): the id of the latest snapshot taken before the node was made, or
+// 0. Only nodes older than the newest live snapshot can be shared with one. Empty when snapshots are off.
+template<bool Enabled_T>
+class NodeGeneration {
+public:
+    uint64_t generation = 0;
+};
+
+template<>
+class NodeGeneration<false> {
+};
+
+template<typename Data_T, typename Compare_T = std::less<Data_T>, typename Alloc_T = std::allocator<Data_T>,
+        bool OrderStatistics_T = false, typename Aggregate_T = void, bool Snapshots_T = false>
+class AVL : public BST<Data_T, Compare_T, Alloc_T> {
 public:
     /***** Function Members *****/
     AVL() : AVL(true) {}
 
-    AVL(const AVL<Data_T> &);
+    // With Snapshots_T the copy borrows the tree's nodes, O(1), and either tree copies a node it shares before changing
+    // it, as with a snapshot (see share). Otherwise every node is copied.
+    AVL(const AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &);
+
+    // Copies in parallel (see cloneFrom), always eagerly
+    AVL(const AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &, const ParallelMode &mode);
+
+    AVL(AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &&) noexcept;
+
+    AVL(bool updateIfExists, const Alloc_T &alloc = Alloc_T()) : AVL(updateIfExists, Compare_T(), alloc) {}
+
+    AVL(bool updateIfExists, const Compare_T &comp, const Alloc_T &alloc = Alloc_T());
+
+    ~AVL() {
+        this->clear();
+        this->detachSnapshots();
+    }
+
+    // The node allocator stays with this tree: only the contents are copied (or borrowed, as by the copy constructor)
+    AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &operator=(const AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &tree) {
+        if constexpr (Snapshots_T) {
+            if (&tree == this)
+                return *this;
+            this->clear();
+            this->detachSnapshots();
+            this->updateIfExists = tree.updateIfExists;
+            CompareHolder<Compare_T>::operator=(tree);
+            this->share(tree);
+        } else {
+            this->BST<Data_T, Compare_T, Alloc_T>::operator=(tree);
+        }
+        return *this;
+    }
+
+    // Stolen nodes come with the allocator they were made by, and with the snapshots and copies sharing them
+    AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &operator=(AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &&tree) {
+        if (&tree == this)
+            return *this;
+        bool steals = std::allocator_traits<Alloc_T>::propagate_on_container_move_assignment::value ||
+                      this->alloc == tree.alloc;
+        this->BST<Data_T, Compare_T, Alloc_T>::operator=(std::move(tree));
+        this->nodeAlloc = NodeAlloc_T(this->alloc);
+        this->detachSnapshots();
+        if (steals) {
+            this->snapshotState = std::move(tree.snapshotState);
+            this->borrowedBelow = tree.borrowedBelow;
+            tree.borrowedBelow = 0;
+        }
+        return *this;
+    }
+
+    // Searches first, like BST::insert, and then links the new node through findOrEmplace, which leaves the nodes
+    // snapshots share alone
+    void insert(const Data_T &item) {
+        this->findOrEmplace(item, item);
+    }
+
+    void insert(Data_T &&item) {
+        this->findOrEmplace(item, std::move(item));
+    }
 
-    AVL(bool updateIfExists);
+    using BST<Data_T, Compare_T, Alloc_T>::deleteNode;
 
 //    AVL(std::function<Data_T()> default_initializer);
 
@@ -32,429 +146,1822 @@ public:
         LEFT_HEAVY, RIGHT_HEAVY, BALANCED
     } balance_type;
 
+    typedef typename SubtreeAggregate<Aggregate_T>::value_type aggregate_type;
+
 protected:
-    class AVLNode : public BST<Data_T>::BinNode {
+    // On top of the two child links an AVLNode only stores one word: the parent pointer, with the balance factor
+    // (left height - right height, always -1, 0 or +1 between operations) packed into its two low bits. Which side of
+    // its parent a node hangs on is derived from the parent's links. With Snapshots_T the word is accessed atomically
+    // (relaxed): a tree keeps the parent links of the nodes it shares with its copies up to date while the copies
+    // read their balance factors.
+    class AVLNode : public BST<Data_T, Compare_T, Alloc_T>::BinNode, public SubtreeSize<OrderStatistics_T>,
+                    public SubtreeAggregate<Aggregate_T>, public NodeGeneration<Snapshots_T> {
+        uintptr_t parentAndBalance;
+
+        uintptr_t word() const {
+            if constexpr (Snapshots_T)
+                return __atomic_load_n(&parentAndBalance, __ATOMIC_RELAXED);
+            else
+                return parentAndBalance;
+        }
+
+        void setWord(uintptr_t word) {
+            if constexpr (Snapshots_T)
+                __atomic_store_n(&parentAndBalance, word, __ATOMIC_RELAXED);
+            else
+                parentAndBalance = word;
+        }
+
+    public:
+        static const uintptr_t BALANCE_MASK = 3;
+
+        AVLNode(const Data_T &data) : BST<Data_T, Compare_T, Alloc_T>::BinNode(data), parentAndBalance(1) {}
+
+        AVLNode(const typename BST<Data_T, Compare_T, Alloc_T>::BinNode &node)
+                : BST<Data_T, Compare_T, Alloc_T>::BinNode(node), parentAndBalance(1) {}
+
+        template<typename... Args>
+        AVLNode(std::in_place_t, Args &&...args)
+                : BST<Data_T, Compare_T, Alloc_T>::BinNode(std::in_place, std::forward<Args>(args)...), parentAndBalance(1) {}
+
+        AVLNode *parent() const {
+            return (AVLNode *) (this->word() & ~BALANCE_MASK);
+        }
+
+        void setParent(AVLNode *parent) {
+            this->setWord((uintptr_t) parent | (this->word() & BALANCE_MASK));
+        }
+
+        int balance() const {
+            return (int) (this->word() & BALANCE_MASK) - 1;
+        }
+
+        void setBalance(int balance) {
+            this->setWord((this->word() & ~BALANCE_MASK) | (uintptr_t) (balance + 1));
+        }
+
+        child_type childType() const {
+            AVLNode *parent = this->parent();
+            return !parent ? ROOT_NODE : (parent->left == this ? LEFT_NODE : RIGHT_NODE);
+        }
+    };
+
+    static_assert(alignof(AVLNode) > AVLNode::BALANCE_MASK, "AVLNode alignment leaves no room for the balance bits");
+
+    typedef typename std::allocator_traits<Alloc_T>::template rebind_alloc<AVLNode> NodeAlloc_T;
+
+    // Allocators that can report their live allocations and drop all of their memory at once (see NodePool.hpp)
+    template<typename A>
+    using releasable_t = decltype(std::declval<A &>().release(), std::declval<const A &>().in_use());
+
+    NodeAlloc_T nodeAlloc;
+
+    // What a tree shares with its snapshots and copies: which of them are alive, and the nodes the tree has let go of
+    // that some of them may still reach. A node made at generation b and retired at generation g is freed once no
+    // snapshot with an id in (b, g] is alive (a whole subtree, once none with an id <= g is). The writer frees what it
+    // can as it retires nodes; a snapshot going away frees right away from its own thread when the node allocator
+    // allows it (or the tree is gone), and otherwise leaves the work to the writer.
+    class SnapshotState {
     public:
-        int height, balance;
-        AVLNode *parent;
-        child_type childType;
+        // Newest live snapshot, 0 when there is none: nodes of an older generation may be shared
+        std::atomic<uint64_t> newest{0};
+        // Latest snapshot taken, the generation of the nodes made since; only the tree uses it
+        uint64_t generation = 0;
+        // For a copy, the state of the tree it was copied from and the id it holds there, which keeps the borrowed
+        // nodes alive as long as this state is (see AVL::share), and how many copies deep that chain goes
+        std::shared_ptr<SnapshotState> source;
+        uint64_t sourceId = 0;
+        unsigned depth = 0;
+
+        explicit SnapshotState(const NodeAlloc_T &alloc) : alloc(alloc) {}
+
+        SnapshotState(const SnapshotState &) = delete;
+
+        SnapshotState &operator=(const SnapshotState &) = delete;
+
+        ~SnapshotState();
+
+        void open(uint64_t id);
+
+        // Registers a copy of the tree under a new id, which also becomes the generation of the tree's new nodes. The
+        // id is taken under the lock, so copies made from several threads at once keep the live ids in order.
+        uint64_t share();
 
-//        AVLNode() : BST::BinNode(), height(0), balance(0) {}
+        void close(uint64_t id);
 
-        AVLNode(const Data_T &data) : BST<Data_T>::BinNode(data), height(0), balance(0) {}
+        // Nodes below `borrowed` in a retired subtree belong to another tree, and are left to it
+        void retire(AVLNode *node, bool subtree, uint64_t borrowed);
 
-        AVLNode(const typename BST<Data_T>::BinNode &node) : BST<Data_T>::BinNode(node), height(0), balance(0) {}
+        void detach();
 
-        void print();
+    private:
+        struct Retired {
+            AVLNode *node;
+            uint64_t born, generation, borrowed;
+            bool subtree;
+        };
+
+        std::mutex lock;
+        std::vector<uint64_t> live;       // ascending
+        std::vector<Retired> retired;     // by generation
+        NodeAlloc_T alloc;
+        bool attached = true;
+        uint64_t pending = 0;             // oldest id closed since the last collect, 0 for none
+
+        void collect(uint64_t since);
+
+        void release(const Retired &entry);
     };
 
-    int calcHeight(AVLNode *node);
+    // Created by the first snapshot or copy, and kept alive by the snapshots and copies after the tree is gone
+    std::shared_ptr<SnapshotState> snapshotState;
+
+    // Nodes of a generation below this one are borrowed from the tree this one was copied from: the tree never
+    // changes, frees or follows the parent link of one, and reaches them from the root instead (0 when there are none)
+    uint64_t borrowedBelow = 0;
 
-    int calcBalance(AVLNode *node);
+    // Past this many copies of copies, a copy is made eagerly (see AVL::share)
+    static constexpr unsigned copyDepth = 16;
 
-    AVLNode *findUnbalanced(AVLNode *rootNode);
+    void postInsert(const typename BST<Data_T, Compare_T, Alloc_T>::BinNode *, const typename BST<Data_T, Compare_T, Alloc_T>::BinNode *);
 
-    void postInsert(const typename BST<Data_T>::BinNode *, const typename BST<Data_T>::BinNode *);
+    void deleteNode(typename BST<Data_T, Compare_T, Alloc_T>::BinNode *node, typename BST<Data_T, Compare_T, Alloc_T>::BinNode *parentNode,
+                    typename BST<Data_T, Compare_T, Alloc_T>::delete_mode mode);
 
-    void postDelete(const Data_T &data, const typename BST<Data_T>::BinNode *parentNode);
+    template<typename... Args>
+    AVLNode *makeNode(Args &&...args);
 
     AVLNode *initNode(const Data_T &data);
 
-    AVLNode *initNode(const typename BST<Data_T>::BinNode &data);
+    AVLNode *initNode(Data_T &&data);
+
+    AVLNode *initNode(const typename BST<Data_T, Compare_T, Alloc_T>::BinNode &data);
+
+    void destroyNode(typename BST<Data_T, Compare_T, Alloc_T>::BinNode *node);
+
+    void deleteSubTree(typename BST<Data_T, Compare_T, Alloc_T>::BinNode *&node);
+
+    void cloneFrom(const BST<Data_T, Compare_T, Alloc_T> *tree);
 
-    void cloneFrom(const BST<Data_T> *tree);
+    AVLNode *cloneFrom(const typename BST<Data_T, Compare_T, Alloc_T>::BinNode *node);
 
-    AVLNode *cloneFrom(const typename BST<Data_T>::BinNode *node);
+    // Forks the copies of the subtrees above the grain. Nodes are only allocated from several threads when the node
+    // allocator is always-equal (one process-wide heap, as with std::allocator); otherwise the copy is serial.
+    void cloneFrom(const AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &tree, const ParallelMode &mode);
 
 private:
     /***** Private Function Members *****/
 
-    void balance(AVLNode *node);
+    void rebalanceDelete(AVLNode *node, bool leftShrunk);
+
+    AVLNode *thawHeavySide(AVLNode *node, int balance);
+
+    AVLNode *balance(AVLNode *node, int balance);
 
     void rotate(AVLNode *rotateNode, rotation_type rotationType);
 
+    void replaceChild(AVLNode *node, AVLNode *replacement);
 
-public:
-    class Iterator : public BST<Data_T>::Iterator {
-    public:
-        Iterator(typename AVL<Data_T>::BinNode *node, const AVL<Data_T> *tree) :
-                BST<Data_T>::Iterator(node, tree) {}
+    template<typename Iter_T>
+    AVLNode *buildSorted(Iter_T &it, size_t count);
 
-        // Copy constr
-        Iterator(const Iterator &it) : BST<Data_T>::Iterator(it) {}
+    template<typename Iter_T>
+    AVLNode *buildSorted(Iter_T first, size_t count, const ParallelMode &mode);
 
-        Iterator(const typename BST<Data_T>::Iterator &it) : BST<Data_T>::Iterator(it) {}
+    AVLNode *cloneTree(const typename BST<Data_T, Compare_T, Alloc_T>::BinNode *node, int height, const ParallelMode &mode);
 
-        Data_T &prev() {
-            bool found = 0;
-            if (!this->st.top()) {
-                this->st.push(((AVL<Data_T> *) this->tree)->largestNode);
-                found = true;
-            } else if (this->st.top()->left) {
-                this->st.push(BST<Data_T>::largest(this->st.top()->left));
-                found = true;
-            } else {
-                AVL::AVLNode *node = (AVL::AVLNode *) this->st.top();
-                this->st.pop();
-                while (
-                        node->childType == LEFT_NODE ||
-                        node == this->st.top()
-                        ) {
-                    node = node->parent;
-                    this->st.pop();
-//                    if (node != this->st.top())
-//                        throw std::runtime_error("Iterator incorrectly constructed, cannot get previous");
-                }
-                if (node->childType == RIGHT_NODE) {
-                    found = true;
-                    this->st.push(node->parent);
-                }
-            }
+    static constexpr bool concurrentAllocation = std::allocator_traits<NodeAlloc_T>::is_always_equal::value;
+
+    static bool forks(const ParallelMode &mode, int height);
+
+    template<typename First_T, typename Second_T>
+    static void forkJoin(const ParallelMode &mode, int height, First_T &&first, Second_T &&second);
+
+    static size_t sizeOf(const typename BST<Data_T, Compare_T, Alloc_T>::BinNode *node);
+
+    static void resize(AVLNode *node);
+
+    static void resizePath(AVLNode *node, long delta);
+
+    static constexpr bool aggregating = !std::is_void<Aggregate_T>::value;
+
+    static aggregate_type aggregateOf(const typename BST<Data_T, Compare_T, Alloc_T>::BinNode *node);
 
-            if (!found)
-                throw std::out_of_range("Tree Iterator reached first, cannot get previous");
-            return this->st.top()->getData();
+    static void reaggregate(AVLNode *node);
+
+    static void reaggregatePath(AVLNode *node);
+
+    static int heightOf(size_t count);
+
+    bool retraceGrowth(AVLNode *child);
+
+    static int subtreeHeight(const typename BST<Data_T, Compare_T, Alloc_T>::BinNode *node);
+
+    static AVLNode *detach(typename BST<Data_T, Compare_T, Alloc_T>::BinNode *node);
+
+    static void recount(AVLNode *node);
+
+    static void recountPath(AVLNode *node);
+
+    void setRoot(AVLNode *root, size_t count);
+
+    size_t dropSubTree(typename BST<Data_T, Compare_T, Alloc_T>::BinNode *node);
+
+    // Nodes and whole subtrees the set operations discard, chained through their parent links. They are only freed
+    // once the result is in place, so the (possibly parallel) recursion never touches the allocator.
+    class DropList {
+    public:
+        AVLNode *head = nullptr, *tail = nullptr;
+
+        void push(AVLNode *node) {
+            if (!node) return;
+            node->setParent(nullptr);
+            if (tail) tail->setParent(node);
+            else head = node;
+            tail = node;
+        }
+
+        void splice(DropList &other) {
+            if (!other.head) return;
+            if (tail) tail->setParent(other.head);
+            else head = other.head;
+            tail = other.tail;
         }
     };
 
-    class ReverseIterator : public AVL<Data_T>::Iterator {
+    // -- snapshots:
+    static inline std::atomic<uint64_t> snapshotIds{0};
+
+    void share(const AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &tree);
+
+    bool borrowed(const AVLNode *node) const;
+
+    bool sharing() const;
+
+    bool frozen(const AVLNode *node) const;
+
+    void attach(AVLNode *child, AVLNode *parent);
+
+    void retire(AVLNode *node, bool subtree);
+
+    AVLNode *thaw(AVLNode *node);
+
+    AVLNode *thawFromRoot(AVLNode *node);
+
+    AVLNode *thawBelow(AVLNode *node, AVLNode *parent);
+
+    void thawPair(AVLNode *&first, AVLNode *&second);
+
+    void thawAll();
+
+    AVLNode *thawSubTree(AVLNode *node);
+
+    void retireSubTree(typename BST<Data_T, Compare_T, Alloc_T>::BinNode *node);
+
+    void detachSnapshots();
+
+    typedef AVLNode *(AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::*SetOperation_T)(
+            AVLNode *, int, AVLNode *, int, int &, DropList &, const ParallelMode &);
+
+    void combine(AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &tree, SetOperation_T operation,
+                 const ParallelMode &mode);
+
+    size_t countLower(AVLNode *lower, AVLNode *upper, size_t count) const;
+
+    AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &movable(AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &tree, AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &spare);
+
+    AVLNode *joinTrees(AVLNode *left, int leftHeight, AVLNode *pivot, AVLNode *right, int rightHeight, int &height);
+
+    AVLNode *splitLast(AVLNode *node, int height, AVLNode *&last, int &restHeight);
+
+    template<typename DataSearch_T>
+    AVLNode *splitTree(AVLNode *node, int height, const DataSearch_T &item, AVLNode *&lower, int &lowerHeight,
+                       AVLNode *&upper, int &upperHeight);
+
+    AVLNode *unionTrees(AVLNode *mine, int myHeight, AVLNode *theirs, int theirHeight, int &height,
+                        DropList &dropped, const ParallelMode &mode);
+
+    AVLNode *intersectTrees(AVLNode *mine, int myHeight, AVLNode *theirs, int theirHeight, int &height,
+                            DropList &dropped, const ParallelMode &mode);
+
+    AVLNode *differenceTrees(AVLNode *mine, int myHeight, AVLNode *theirs, int theirHeight, int &height,
+                             DropList &dropped, const ParallelMode &mode);
+
+    template<typename Iter_T, typename Batch_T>
+    void applyTrees(AVLNode *&node, int &height, Iter_T first, size_t count, Batch_T &batch, DropList &dropped,
+                    size_t &added);
+
+
+public:
+    /****** Iterators ******/
+    // Iterators only hold the current node (null past either end) and step through the parent links, so they are
+    // trivially copyable and never allocate. A step that would climb from a node borrowed by a copy searches from the
+    // root instead, O(log n).
+    class Iterator {
+        friend AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>;
+    protected:
+        AVLNode *node;
+        const AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> *tree;
+
     public:
-        ReverseIterator(typename AVL<Data_T>::BinNode *node, const AVL<Data_T> *tree) : AVL<Data_T>::Iterator(node,
-                                                                                                              tree) {}
+        Iterator(AVLNode *node, const AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> *tree) : node(node), tree(tree) {}
 
-        // Copy constr
-        ReverseIterator(const Iterator &it) : AVL<Data_T>::Iterator(it) {}
+        bool hasNext() const {
+            return node;
+        }
 
-        ReverseIterator(const typename BST<Data_T>::Iterator &it) : AVL<Data_T>::Iterator(it) {}
+        Data_T &get() const {
+            return this->node->getData();
+        }
 
         Data_T &next() {
-            bool found = 0;
-            if (!this->st.top()) {
-//                this->st.push(((AVL<Data_T> *) this->tree)->largestNode);
-                found = false;
-            } else if (this->st.top()->left) {
-                this->st.push(BST<Data_T>::largest(this->st.top()->left));
-                found = true;
-            } else {
-                AVL::AVLNode *node = (AVL::AVLNode *) this->st.top();
-                this->st.pop();
-                while (
-                        node->childType == LEFT_NODE ||
-                        node == this->st.top()
-                        ) {
-                    node = node->parent;
-                    this->st.pop();
-//                    if (node != this->st.top())
-//                        throw std::runtime_error("Iterator incorrectly constructed, cannot get previous");
-                }
-                if (node->childType == RIGHT_NODE) {
-                    found = true;
-                    this->st.push(node->parent);
-                }
-            }
+            if (!hasNext()) throw std::out_of_range("Tree Iterator reached end, cannot get next");
+            AVLNode *current = node;
+            node = tree->successor(node);
+            return current->getData();
+        }
+
+        Data_T &prev() {
+            AVLNode *previous = node ? tree->predecessor(node) : (AVLNode *) tree->largestNode;
+            if (!previous) throw std::out_of_range("Tree Iterator reached first, cannot get previous");
+            node = previous;
+            return node->getData();
+        }
+
+        bool operator==(const Iterator &other) const {
+            return this->node == other.node;
+        }
+
+        bool operator!=(const Iterator &other) const {
+            return this->node != other.node;
+        }
 
-            if (!found)
-                throw std::out_of_range("Tree Iterator reached first, cannot get previous");
-            return this->st.top()->getData();
+        // Position in the tree (the entry count for end()); O(log n), needs OrderStatistics_T
+        size_t index() const {
+            return tree->indexOf(node);
+        }
+
+        // Moves by `offset` entries in O(log n) instead of stepping one node at a time; needs OrderStatistics_T
+        void advance(long offset) {
+            long target = (long) this->index() + offset;
+            if (target < 0 || (size_t) target > tree->nodeCount())
+                throw std::out_of_range("Tree Iterator advanced out of range");
+            node = tree->select((size_t) target).node;
+        }
+    };
+
+    class ReverseIterator : public AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::Iterator {
+    public:
+        ReverseIterator(AVLNode *node, const AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> *tree) : AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::Iterator(node, tree) {}
+
+        Data_T &next() {
+            if (!this->hasNext()) throw std::out_of_range("Tree Iterator reached first, cannot get previous");
+            AVLNode *current = this->node;
+            this->node = this->tree->predecessor(this->node);
+            return current->getData();
         }
 
         Data_T &prev() {
-            if (!this->st.top())
-                this->st.push(((AVL<Data_T> *) this->tree)->smallestNode);
-            return this->BST<Data_T>::Iterator::next();
+            AVLNode *following = this->node ? this->tree->successor(this->node) : (AVLNode *) this->tree->smallestNode;
+            if (!following) throw std::out_of_range("Tree Iterator reached end, cannot get next");
+            this->node = following;
+            return this->node->getData();
         }
     };
 
-    virtual typename BST<Data_T>::Iterator begin() const {
-        return AVL<Data_T>::Iterator(((AVLNode *) this->smallestNode), this);
+    Iterator begin() const {
+        return Iterator(((AVLNode *) this->smallestNode), this);
     }
 
-    virtual typename BST<Data_T>::Iterator begin(const Data_T &data) const {
-        typename BST<Data_T>::BinNode *parent = nullptr;
+    Iterator begin(const Data_T &data) const {
+        typename BST<Data_T, Compare_T, Alloc_T>::BinNode *parent = nullptr;
         AVLNode *node = (AVLNode *) this->searchNode(this->myRoot, data, parent);
         if (!node) throw std::out_of_range("could not instantiate Iterator, data not found in tree");
-        return AVL<Data_T>::Iterator(node, this);
+        return Iterator(node, this);
     }
 
-    virtual typename BST<Data_T>::Iterator end() const {
-        return AVL<Data_T>::Iterator(nullptr, this);
+    Iterator end() const {
+        return Iterator(nullptr, this);
     }
 
-    virtual ReverseIterator rbegin() const {
+    ReverseIterator rbegin() const {
         return ReverseIterator(((AVLNode *) this->largestNode), this);
     }
 
-    virtual ReverseIterator rend() const {
+    ReverseIterator rend() const {
         return ReverseIterator(nullptr, this);
     }
 
-}; // end of class declaration
+    template<typename DataSearch_T>
+    Iterator find(const DataSearch_T &item) const;
+
+    // Finds the `count` items starting at `items` with their descents interleaved (see BST::searchNodes), calling
+    // `found(i, iterator)` for each, in no particular order
+    template<typename Iter_T, typename Found_T>
+    void findMany(Iter_T items, size_t count, Found_T found) const {
+        this->searchNodes(items, count, [&](size_t index, typename BST<Data_T, Compare_T, Alloc_T>::BinNode *node) {
+            found(index, Iterator((AVLNode *) node, this));
+        });
+    }
+
+    // First entry not ordered before `item`
+    template<typename DataSearch_T>
+    Iterator lowerBound(const DataSearch_T &item) const;
+
+    // First entry ordered after `item`
+    template<typename DataSearch_T>
+    Iterator upperBound(const DataSearch_T &item) const;
+
+    // Both bounds out of a single descent
+    template<typename DataSearch_T>
+    std::pair<Iterator, Iterator> equalRange(const DataSearch_T &item) const;
+
+    // Returns the entry matching `item`, or builds one in place from `args` where the search ended
+    template<typename DataSearch_T, typename... Args>
+    std::pair<Iterator, bool> findOrEmplace(const DataSearch_T &item, Args &&...args);
+
+    // Builds the entry in its node first, and only keeps it if no equivalent entry exists
+    template<typename... Args>
+    std::pair<Iterator, bool> emplace(Args &&...args);
+
+    void erase(const Iterator &it);
+
+    // -- order statistics (only with OrderStatistics_T), all O(log n):
+    // Number of entries ordered before `item`
+    template<typename DataSearch_T>
+    size_t rank(const DataSearch_T &item) const;
+
+    // The entry at position `index` in order; end() when index == nodeCount()
+    Iterator select(size_t index) const;
+
+    // -- subtree aggregates (only with an Aggregate_T):
+    // Combination of all entries, O(1)
+    aggregate_type aggregate() const;
+
+    // Combination of the entries in [lo, hi), in order, O(log n)
+    template<typename DataSearch_T>
+    aggregate_type aggregate(const DataSearch_T &lo, const DataSearch_T &hi) const;
+
+    // Recomputes the aggregates above an entry whose data was changed in place
+    void refresh(const Iterator &it);
+
+    // Removes [first, last) and returns the number of entries removed
+    size_t erase(const Iterator &first, const Iterator &last);
+
+    // Replaces the contents with the `count` items starting at `first`, which the caller guarantees are strictly
+    // ascending. Builds a perfectly balanced tree in O(n), without a single comparison or rotation.
+    template<typename Iter_T>
+    void assignSorted(Iter_T first, size_t count);
+
+    // Same, with the two halves of every piece above the grain built in parallel. Needs random access iterators and
+    // an always-equal node allocator (see cloneFrom); otherwise the build is serial.
+    template<typename Iter_T>
+    void assignSorted(Iter_T first, size_t count, const ParallelMode &mode);
+
+    // -- split and join, O(log n) restructuring:
+    // Moves every entry not ordered before `item` into the returned tree. Without OrderStatistics_T the entry counts
+    // of the two halves are found by walking the smaller one.
+    template<typename DataSearch_T>
+    AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> split(const DataSearch_T &item);
+
+    // Appends the entries of `tree`, which must all be ordered after this tree's, and leaves `tree` empty
+    void join(AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &tree);
+
+    // -- set operations, O(m log(n/m + 1)) comparisons for trees of m <= n entries. The entries of `tree` are
+    // consumed (moved in or freed), leaving it empty. With a ParallelMode the two sides of every split above the grain
+    // are combined in parallel.
+    // Entries of this tree win over equivalent ones of `tree`
+    void mergeUnion(AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &tree,
+                    const ParallelMode &mode = ParallelMode());
+
+    void intersection(AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &tree,
+                      const ParallelMode &mode = ParallelMode());
+
+    void difference(AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &tree,
+                    const ParallelMode &mode = ParallelMode());
+
+    // -- batches:
+    // Applies `count` changes, strictly ascending by the item `batch.key(change)` returns, in one pass of splits and
+    // joins: O(m log(n/m + 1)) comparisons for m changes, the rebalancing of every subtree done once for all of them.
+    // The entry equivalent to a change is handed to `batch.update(change, data)`, which changes it in place and
+    // returns whether it stays; without one, `batch.insert(change)` returns whether to add the entry built from
+    // `batch.make(change)`. If a callback or allocation throws, the changes made so far stay and the rest are not.
+    template<typename Iter_T, typename Batch_T>
+    void applySorted(Iter_T first, size_t count, Batch_T &batch);
+
+    // -- snapshots (only with Snapshots_T):
+    // A read-only view of the tree as it was when it was taken. Taking one is O(1): the tree and its snapshots share
+    // their nodes, and from then on the tree copies a shared node, and the path above it, before changing it, and
+    // retires the original until no snapshot can reach it. A snapshot can be read from any thread while the tree goes
+    // on changing, as the tree only writes the parent links of shared nodes, which snapshots do not use. Copies of a
+    // Snapshot share one view, which goes away with the last of them (the tree may go first).
+    //
+    // A copy of the tree works the same way: it holds a snapshot of the tree (kept in its own SnapshotState) and
+    // borrows its nodes. The tree copies what it shares with the copy before changing it, as above; the copy does the
+    // same, but as it cannot trust the parent links of borrowed nodes, it reaches them from the root.
+    class Snapshot {
+        friend AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>;
+    public:
+        // Keeps the nodes still to come back to, as parent links cannot be followed in a snapshot
+        class Iterator {
+            friend Snapshot;
+        public:
+            bool hasNext() const {
+                return !path.empty();
+            }
+
+            const Data_T &get() const {
+                return path.back()->getData();
+            }
+
+            const Data_T &next() {
+                if (!hasNext()) throw std::out_of_range("Snapshot Iterator reached end, cannot get next");
+                AVLNode *current = path.back();
+                path.pop_back();
+                this->descend((AVLNode *) current->right);
+                return current->getData();
+            }
+
+            bool operator==(const Iterator &other) const {
+                return this->current() == other.current();
+            }
+
+            bool operator!=(const Iterator &other) const {
+                return this->current() != other.current();
+            }
+
+        private:
+            std::vector<AVLNode *> path;
+
+            AVLNode *current() const {
+                return path.empty() ? nullptr : path.back();
+            }
+
+            void descend(AVLNode *node) {
+                for (; node; node = (AVLNode *) node->left)
+                    path.push_back(node);
+            }
+        };
+
+        Snapshot() = default;
+
+        size_t nodeCount() const {
+            return view ? view->count : 0;
+        }
+
+        bool empty() const {
+            return !this->nodeCount();
+        }
+
+        Iterator begin() const;
+
+        Iterator end() const {
+            return Iterator();
+        }
+
+        template<typename DataSearch_T>
+        Iterator find(const DataSearch_T &item) const;
+
+        template<typename DataSearch_T>
+        Iterator lowerBound(const DataSearch_T &item) const;
+
+        template<typename DataSearch_T>
+        Iterator upperBound(const DataSearch_T &item) const;
+
+    private:
+        struct View {
+            std::shared_ptr<SnapshotState> state;
+            uint64_t id;
+            AVLNode *root;
+            size_t count;
+            Compare_T comp;
+
+            View(const std::shared_ptr<SnapshotState> &state, uint64_t id, AVLNode *root, size_t count,
+                 const Compare_T &comp) : state(state), id(id), root(root), count(count), comp(comp) {}
+
+            ~View() {
+                state->close(id);
+            }
+        };
+
+        std::shared_ptr<const View> view;
+
+        explicit Snapshot(std::shared_ptr<const View> view) : view(std::move(view)) {}
+    };
+
+    // O(1). Like any other member, it must not run while the tree is being changed.
+    Snapshot snapshot();
+
+    // Gives `it` an entry of its own, which can be changed in place: one still shared with a snapshot is copied
+    // first, which moves `it` (and invalidates other iterators to that entry and the ones above it). Without Snapshots_T
+    // it does nothing.
+    static void unshare(Iterator &it);
+
+    // Both ends of a range, where unsharing one end separately could move the other
+    static void unshare(Iterator &first, Iterator &last);
+
+    static Data_T &writable(Iterator &it) {
+        unshare(it);
+        return it.get();
+    }
+
+    bool operator==(const AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &tree) const {
+        if (this->nodeCount() != tree.nodeCount()) return false;
+        Iterator it1(this->begin()), it2(tree.begin());
+        while (it1.hasNext()) {
+            if (!(it1.next() == it2.next())) return false;
+        }
+        return true;
+    }
+
+    bool operator!=(const AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &tree) const {
+        return !(*this == tree);
+    }
+
+    static constexpr size_t nodeSize() {
+        return sizeof(AVLNode);
+    }
+
+protected:
+    size_t indexOf(const AVLNode *node) const;
+
+    AVLNode *successor(AVLNode *node) const;
 
-#endif
+    AVLNode *predecessor(AVLNode *node) const;
+
+}; // end of class declaration
 
 //--- Definition of constructor
-template<typename Data_T>
-AVL<Data_T>::AVL(const AVL<Data_T> &tree) : BST<Data_T>(tree.updateIfExists) {
-    cloneFrom(&tree);
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::AVL(const AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &tree)
+        : BST<Data_T, Compare_T, Alloc_T>(tree.updateIfExists, tree.compare(),
+                               std::allocator_traits<Alloc_T>::select_on_container_copy_construction(tree.alloc)),
+          nodeAlloc(this->alloc) {
+    if constexpr (Snapshots_T)
+        this->share(tree);
+    else
+        this->cloneFrom(&tree);
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::AVL(const AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &tree, const ParallelMode &mode)
+        : BST<Data_T, Compare_T, Alloc_T>(tree.updateIfExists, tree.compare(),
+                               std::allocator_traits<Alloc_T>::select_on_container_copy_construction(tree.alloc)),
+          nodeAlloc(this->alloc) {
+    cloneFrom(tree, mode);
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::AVL(AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &&tree) noexcept
+        : BST<Data_T, Compare_T, Alloc_T>(std::move(tree)), nodeAlloc(tree.nodeAlloc),
+          snapshotState(std::move(tree.snapshotState)), borrowedBelow(tree.borrowedBelow) {
+    tree.borrowedBelow = 0;
 }
 
-template<typename Data_T>
-AVL<Data_T>::AVL(bool updateIfExists) : BST<Data_T>(updateIfExists) {}
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::AVL(bool updateIfExists, const Compare_T &comp, const Alloc_T &alloc)
+        : BST<Data_T, Compare_T, Alloc_T>(updateIfExists, comp, alloc), nodeAlloc(this->alloc) {}
 
 //template<typename Data_T>
-//AVL<Data_T>::AVL(std::function<Data_T()> default_initializer) : BST<Data_T>(default_initializer) {}
+//AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::AVL(std::function<Data_T()> default_initializer) : BST<Data_T, Compare_T, Alloc_T>(default_initializer) {}
 
 // Private methods
-template<typename Data_T>
-void AVL<Data_T>::AVLNode::print() {
-//    cout << this->data
-//         << " (height: " << this->height
-//         << ", balance: " << this->balance
-//         << ", " << (
-//                 this->childType == ROOT_NODE ? "ROOT" : (
-//                         this->childType == LEFT_NODE ? "LEFT" : "RIGHT"
-//                 ))
-//         << " child of: " << (!this->parent ? -999 : this->parent->data)
-//         << ")" << endl;
-}
-
-template<typename Data_T>
+// Walks up from the new leaf while the subtree it grew keeps getting taller. A single (or double) rotation restores the
+// height the rotated subtree had before the insert, so the walk stops there.
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
 void
-AVL<Data_T>::postInsert(const typename BST<Data_T>::BinNode *node, const typename BST<Data_T>::BinNode *parentNode) {
-    AVLNode *avlNode = ((AVLNode *) node);
-    avlNode->parent = ((AVLNode *) parentNode);
-
-    if (!parentNode)
-        avlNode->childType = ROOT_NODE;
-    else if (parentNode->left == node)
-        avlNode->childType = LEFT_NODE;
-    else if (parentNode->right == node)
-        avlNode->childType = RIGHT_NODE;
-
-    this->calcHeight((AVLNode *) this->myRoot);
-    if (avlNode->parent && avlNode->parent->parent)
-        this->balance(avlNode);
-}
-
-//void AVL::postDelete(BinNode *parentNode) {
-//    this->calcHeight((AVLNode*) this->myRoot);
-//    if (!parentNode) return;
-//
-//    AVLNode *parentAVLNode = (AVLNode*) parentNode;
-//    while (parentAVLNode && IS_BALANCED(parentAVLNode)) {
-//        switch (BALANCE_TYPE(parentAVLNode)) {
-//            case BALANCED:
-//                return;
-//            case RIGHT_HEAVY:
-//                parentAVLNode = (AVLNode*) parentAVLNode->right;
-//                break;
-//            case LEFT_HEAVY:
-//                parentAVLNode = (AVLNode*) parentAVLNode->left;
-//                break;
-//        }
-//    }
-//
-//    if (!parentAVLNode) return;
-//    switch (BALANCE_TYPE(parentAVLNode)) {
-//        case BALANCED:
-//        case LEFT_HEAVY:
-//            parentAVLNode = (AVLNode*) (parentAVLNode->left);
-//            break;
-//        case RIGHT_HEAVY:
-//            parentAVLNode = (AVLNode*) (parentAVLNode->right);
-//            break;
-//    }
-//    if (parentAVLNode->left)
-//        parentAVLNode = (AVLNode*) parentAVLNode->left;
-//    else if (parentAVLNode->right)
-//        parentAVLNode = (AVLNode*) parentAVLNode->right;
-//
-//    this->balance(parentAVLNode);
-//}
-
-template<typename Data_T>
-void AVL<Data_T>::postDelete(const Data_T &data, const typename BST<Data_T>::BinNode *parentNode) {
-    this->calcHeight((AVLNode *) this->myRoot);
-    if (!parentNode)
-        return;
-    AVLNode *unbalanced;
-    while ((unbalanced = this->findUnbalanced((AVLNode *) this->myRoot))) {
-        switch (BALANCE_TYPE(unbalanced)) {
-            case BALANCED:
-            case LEFT_HEAVY:
-                unbalanced = (AVLNode *) unbalanced->left;
-                break;
-            case RIGHT_HEAVY:
-                unbalanced = (AVLNode *) unbalanced->right;
-                break;
-        }
-        if (unbalanced->left)
-            unbalanced = (AVLNode *) unbalanced->left;
-        else if (unbalanced->right)
-            unbalanced = (AVLNode *) unbalanced->right;
-
-        this->balance(unbalanced);
-    }
-}
-
-template<typename Data_T>
-typename AVL<Data_T>::AVLNode *AVL<Data_T>::findUnbalanced(AVL<Data_T>::AVLNode *rootNode) {
-    if (!rootNode || !IS_BALANCED(rootNode))
-        return rootNode;
-    AVLNode *unbalanced;
-    unbalanced = findUnbalanced((AVLNode *) rootNode->left);
-    if (unbalanced)
-        return unbalanced;
-    unbalanced = findUnbalanced((AVLNode *) rootNode->right);
-    return unbalanced;
-}
-
-template<typename Data_T>
-typename AVL<Data_T>::AVLNode *AVL<Data_T>::initNode(const Data_T &data) {
-    AVLNode *node = new AVLNode(data);
-    node->left = nullptr;
-    node->right = nullptr;
-    node->parent = nullptr;
-    return node;
+AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::postInsert(const typename BST<Data_T, Compare_T, Alloc_T>::BinNode *node, const typename BST<Data_T, Compare_T, Alloc_T>::BinNode *parentNode) {
+    AVLNode *child = ((AVLNode *) node), *current = ((AVLNode *) parentNode);
+    child->setParent(current);
+    child->setBalance(0);
+    if constexpr (OrderStatistics_T)
+        resizePath(current, 1);
+    if constexpr (aggregating)
+        reaggregatePath(child);
+    this->retraceGrowth(child);
 }
 
-template<typename Data_T>
-typename AVL<Data_T>::AVLNode *AVL<Data_T>::initNode(const typename BST<Data_T>::BinNode &data) {
-    AVLNode *node = new AVLNode(data);
-    node->left = nullptr;
-    node->right = nullptr;
-    node->parent = nullptr;
-    return node;
+// Walks up from `child`, whose subtree has just grown one level, while the subtrees above keep getting taller.
+// Returns whether the whole tree grew. After an insert a rotation always restores the old height; when a join hangs
+// a whole subtree, one can also keep the grown height (the rotated node's child was balanced), and the walk goes on.
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+bool AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::retraceGrowth(AVLNode *child) {
+    AVLNode *current = child->parent();
+    while (current) {
+        int balance = current->balance() + (current->left == child ? 1 : -1);
+        if (balance == 0) {
+            current->setBalance(0);
+            return false;
+        }
+        if (balance == 2 || balance == -2) {
+            if ((child = this->balance(current, balance))->balance() == 0)
+                return false;
+        } else {
+            current->setBalance(balance);
+            child = current;
+        }
+        current = child->parent();
+    }
+    return true;
 }
 
-template<typename Data_T>
-void AVL<Data_T>::cloneFrom(const BST<Data_T> *tree) {
-    this->BST<Data_T>::cloneFrom(tree);
-    ((AVLNode *) this->myRoot)->childType = ROOT_NODE;
-    this->calcHeight((AVLNode *) this->myRoot);
+// Walks up from the parent of the removed position while subtrees keep getting shorter. The nodes a rotation moves are
+// on the side that did not shrink, off the path deleteNode thawed, so they are thawed here. (After an insert they all
+// lie on the thawed insertion path, and split, join and the set operations thaw both trees whole beforehand.)
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+void AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::rebalanceDelete(AVLNode *node, bool leftShrunk) {
+    while (node) {
+        int balance = node->balance() + (leftShrunk ? -1 : 1);
+        if (balance == 1 || balance == -1) {
+            node->setBalance(balance);
+            return;
+        }
+        if (balance == 0)
+            node->setBalance(0);
+        else if ((node = this->balance(this->thawHeavySide(node, balance), balance))->balance() != 0)
+            return;
+        AVLNode *parent = node->parent();
+        if (!parent)
+            return;
+        leftShrunk = parent->left == node;
+        node = parent;
+    }
 }
 
-template<typename Data_T>
-typename AVL<Data_T>::AVLNode *AVL<Data_T>::cloneFrom(const typename BST<Data_T>::BinNode *node) {
-    if (!node) return nullptr;
-    AVLNode *retNode = initNode(*node);
-
-    retNode->left = cloneFrom(node->left);
-    if (retNode->left) {
-        ((AVLNode *) retNode->left)->parent = retNode;
-        ((AVLNode *) retNode->left)->childType = LEFT_NODE;
+// Unlinks `node` using the parent links, so that rebalancing can start from the deepest node whose subtree actually
+// lost a level (the successor's old parent when the node has two children). The node and the successor that takes its
+// place are thawed first, which thaws every node whose links change below the retrace.
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+void AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::deleteNode(typename BST<Data_T, Compare_T, Alloc_T>::BinNode *binNode, typename BST<Data_T, Compare_T, Alloc_T>::BinNode *parentNode,
+                             typename BST<Data_T, Compare_T, Alloc_T>::delete_mode mode) {
+    AVLNode *node = this->thaw((AVLNode *) binNode), *rebalanceFrom = node->parent();
+    if (mode == BST<Data_T, Compare_T, Alloc_T>::TWO_CHILDREN)
+        this->thaw((AVLNode *) BST<Data_T, Compare_T, Alloc_T>::smallest(node->right));
+    bool leftShrunk = rebalanceFrom && rebalanceFrom->left == node;
+    if constexpr (OrderStatistics_T)
+        resizePath(mode == BST<Data_T, Compare_T, Alloc_T>::TWO_CHILDREN
+                   ? ((AVLNode *) BST<Data_T, Compare_T, Alloc_T>::smallest(node->right))->parent() : rebalanceFrom, -1);
+    switch (mode) {
+        case BST<Data_T, Compare_T, Alloc_T>::LEAF_NODE:
+            this->replaceChild(node, nullptr);
+            break;
+        case BST<Data_T, Compare_T, Alloc_T>::ONE_CHILD:
+            this->replaceChild(node, (AVLNode *) (node->left ? node->left : node->right));
+            break;
+        case BST<Data_T, Compare_T, Alloc_T>::TWO_CHILDREN: {
+            AVLNode *successor = (AVLNode *) BST<Data_T, Compare_T, Alloc_T>::smallest(node->right);
+            if (successor->parent() != node) {
+                rebalanceFrom = successor->parent();
+                leftShrunk = true;
+                this->replaceChild(successor, (AVLNode *) successor->right);
+                BST<Data_T, Compare_T, Alloc_T>::setLink(successor->right, node->right);
+                this->attach((AVLNode *) successor->right, successor);
+            } else {
+                rebalanceFrom = successor;
+                leftShrunk = false;
+            }
+            BST<Data_T, Compare_T, Alloc_T>::setLink(successor->left, node->left);
+            this->attach((AVLNode *) successor->left, successor);
+            successor->setBalance(node->balance());
+            if constexpr (OrderStatistics_T)
+                successor->subtreeSize = node->subtreeSize;
+            this->replaceChild(node, successor);
+            break;
+        }
     }
 
-    retNode->right = cloneFrom(node->right);
-    if (retNode->right) {
-        ((AVLNode *) retNode->right)->parent = retNode;
-        ((AVLNode *) retNode->right)->childType = RIGHT_NODE;
+    if constexpr (aggregating)
+        reaggregatePath(rebalanceFrom);
+
+    if (node == this->smallestNode)
+        this->smallestNode = BST<Data_T, Compare_T, Alloc_T>::smallest(this->myRoot);
+    if (node == this->largestNode)
+        this->largestNode = BST<Data_T, Compare_T, Alloc_T>::largest(this->myRoot);
+    --this->nodes;
+    this->rebalanceDelete(rebalanceFrom, leftShrunk);
+    this->destroyNode(node);
+}
+
+// Puts `replacement` (possibly null) in the place `node` occupies under its parent, or at the root. Detached trees
+// being split or joined have parentless roots of their own, which leave myRoot alone.
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+void AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::replaceChild(AVLNode *node, AVLNode *replacement) {
+    AVLNode *parent = node->parent();
+    this->attach(replacement, parent);
+    if (!parent) {
+        if (this->myRoot == node)
+            BST<Data_T, Compare_T, Alloc_T>::setLink(this->myRoot, replacement);
+    } else if (parent->left == node)
+        BST<Data_T, Compare_T, Alloc_T>::setLink(parent->left, replacement);
+    else
+        BST<Data_T, Compare_T, Alloc_T>::setLink(parent->right, replacement);
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+template<typename... Args>
+typename AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::AVLNode *AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::makeNode(Args &&...args) {
+    AVLNode *node = std::allocator_traits<NodeAlloc_T>::allocate(this->nodeAlloc, 1);
+    try {
+        std::allocator_traits<NodeAlloc_T>::construct(this->nodeAlloc, node, std::in_place, std::forward<Args>(args)...);
+    } catch (...) {
+        std::allocator_traits<NodeAlloc_T>::deallocate(this->nodeAlloc, node, 1);
+        throw;
     }
-    return retNode;
+    if constexpr (Snapshots_T)
+        node->generation = this->snapshotState ? this->snapshotState->generation : 0;
+    return node;
 }
 
-static int max(int a, int b) {
-    return a > b ? a : b;
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+typename AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::AVLNode *AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::initNode(const Data_T &data) {
+    return this->makeNode(data);
 }
 
-template<typename Data_T>
-int AVL<Data_T>::calcBalance(AVLNode *node) {
-    if (node->left && node->right)
-        node->balance =
-                ((AVLNode *) node->left)->height -
-                ((AVLNode *) node->right)->height;
-    else if (!node->left && !node->right)
-        node->balance = 0;
-    else if (!node->left)
-        node->balance = -1 - ((AVLNode *) node->right)->height;
-    else
-        node->balance = ((AVLNode *) node->left)->height + 1;
-    return node->balance;
-}
-
-template<typename Data_T>
-int AVL<Data_T>::calcHeight(AVLNode *node) {
-    if (!node) return -1;
-    ((AVLNode *) node)->parent = nullptr;
-    ((AVLNode *) node)->childType = ROOT_NODE;
-
-    int leftHeight = calcHeight((AVLNode *) node->left);
-    int rightHeight = calcHeight((AVLNode *) node->right);
-
-    if (node->left) {
-        ((AVLNode *) node->left)->parent = node;
-        ((AVLNode *) node->left)->childType = LEFT_NODE;
-    }
-    if (node->right) {
-        ((AVLNode *) node->right)->parent = node;
-        ((AVLNode *) node->right)->childType = RIGHT_NODE;
-    }
-
-    node->height = 1 + max(leftHeight, rightHeight);
-    calcBalance(node);
-    return node->height;
-}
-
-template<typename Data_T>
-void AVL<Data_T>::balance(AVLNode *node) {
-    rotation_type rotationType;
-
-    AVLNode *balanceNode = node, *parent, *grandParent, *rotateNode;
-    while (
-            balanceNode &&
-            (parent = balanceNode->parent) &&
-            (grandParent = balanceNode->parent->parent)
-            ) {
-        if (!IS_BALANCED(grandParent)) {
-            if (parent->childType == LEFT_NODE) {
-                if (balanceNode->childType == LEFT_NODE) {
-                    rotationType = RIGHT_ROTATE;
-                    rotateNode = parent;
-                } else if (balanceNode->childType == RIGHT_NODE) {
-                    rotationType = LEFT_RIGHT_ROTATE;
-                    rotateNode = balanceNode;
-                }
-            } else if (parent->childType == RIGHT_NODE) {
-                if (balanceNode->childType == LEFT_NODE) {
-                    rotationType = RIGHT_LEFT_ROTATE;
-                    rotateNode = balanceNode;
-                } else if (balanceNode->childType == RIGHT_NODE) {
-                    rotationType = LEFT_ROTATE;
-                    rotateNode = parent;
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+typename AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::AVLNode *AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::initNode(Data_T &&data) {
+    return this->makeNode(std::move(data));
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+typename AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::AVLNode *AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::initNode(const typename BST<Data_T, Compare_T, Alloc_T>::BinNode &data) {
+    AVLNode *node = std::allocator_traits<NodeAlloc_T>::allocate(this->nodeAlloc, 1);
+    std::allocator_traits<NodeAlloc_T>::construct(this->nodeAlloc, node, data);
+    if constexpr (Snapshots_T)
+        node->generation = this->snapshotState ? this->snapshotState->generation : 0;
+    return node;
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+void AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::destroyNode(typename BST<Data_T, Compare_T, Alloc_T>::BinNode *node) {
+    AVLNode *avlNode = (AVLNode *) node;
+    std::allocator_traits<NodeAlloc_T>::destroy(this->nodeAlloc, avlNode);
+    std::allocator_traits<NodeAlloc_T>::deallocate(this->nodeAlloc, avlNode, 1);
+}
+
+// When the whole tree is being dropped and it is the only user of a releasable pool, the payloads are destroyed (if
+// they need it) and the pool's chunks are returned wholesale instead of freeing every node. While snapshots or copies
+// are alive, the subtrees they share are retired instead, and borrowed subtrees are left to their own tree.
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+void AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::deleteSubTree(typename BST<Data_T, Compare_T, Alloc_T>::BinNode *&node) {
+    if constexpr (Snapshots_T) {
+        if (this->sharing()) {
+            this->retireSubTree(node);
+            node = nullptr;
+            return;
+        }
+    }
+    if constexpr (std::experimental::is_detected<releasable_t, NodeAlloc_T>::value) {
+        if (node && node == this->myRoot && this->nodeAlloc.in_use() == this->nodes) {
+            if (!std::is_trivially_destructible<Data_T>::value) {
+                typename BST<Data_T, Compare_T, Alloc_T>::BinNode *current = node, *next;
+                while (current) {
+                    if (current->left) {
+                        next = current->left;
+                        current->left = next->right;
+                        next->right = current;
+                    } else {
+                        next = current->right;
+                        std::allocator_traits<NodeAlloc_T>::destroy(this->nodeAlloc, (AVLNode *) current);
+                    }
+                    current = next;
                 }
             }
-//            cout << "Rotating [" << rotateNode->data << "]" << endl;
-            this->rotate(rotateNode, rotationType);
-            this->calcHeight((AVLNode *) this->myRoot);
+            this->nodeAlloc.release();
+            node = nullptr;
             return;
-        } else
-            balanceNode = balanceNode->parent;
+        }
     }
+    this->BST<Data_T, Compare_T, Alloc_T>::deleteSubTree(node);
 }
 
-template<typename Data_T>
-void AVL<Data_T>::rotate(AVLNode *rotateNode, rotation_type rotationType) {
-//    AVLNode *grandParent = rotateNode->parent->parent;
-    if (!rotateNode || !rotateNode->parent || rotateNode->childType == ROOT_NODE)
-        return;
-    bool isRoot;
-    AVLNode *parentOfRotated = nullptr, *rotated;
-    rotated = rotateNode->parent;
-    isRoot = rotated->childType == ROOT_NODE;
-    parentOfRotated = rotated->parent;
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+void AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::cloneFrom(const BST<Data_T, Compare_T, Alloc_T> *tree) {
+    this->BST<Data_T, Compare_T, Alloc_T>::cloneFrom(tree);
+    if (this->myRoot)
+        ((AVLNode *) this->myRoot)->setParent(nullptr);
+}
 
-    switch (rotationType) {
-        case LEFT_ROTATE:
-            rotateNode->parent->right = rotateNode->left;
-            rotateNode->left = rotateNode->parent;
-            break;
-        case RIGHT_ROTATE:
-            rotateNode->parent->left = rotateNode->right;
-            rotateNode->right = rotateNode->parent;
-            break;
-        case LEFT_RIGHT_ROTATE: {
-            this->rotate(rotateNode, LEFT_ROTATE);
-            this->rotate(rotateNode, RIGHT_ROTATE);
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+typename AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::AVLNode *AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::cloneFrom(const typename BST<Data_T, Compare_T, Alloc_T>::BinNode *node) {
+    if (!node) return nullptr;
+    AVLNode *retNode = initNode(*node);
+    retNode->setBalance(((const AVLNode *) node)->balance());
+    if constexpr (OrderStatistics_T)
+        retNode->subtreeSize = ((const AVLNode *) node)->subtreeSize;
+    if constexpr (aggregating)
+        retNode->aggregate = ((const AVLNode *) node)->aggregate;
+
+    retNode->left = cloneFrom(node->left);
+    if (retNode->left)
+        ((AVLNode *) retNode->left)->setParent(retNode);
+
+    retNode->right = cloneFrom(node->right);
+    if (retNode->right)
+        ((AVLNode *) retNode->right)->setParent(retNode);
+    return retNode;
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+void AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::cloneFrom(const AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &tree, const ParallelMode &mode) {
+    if (!concurrentAllocation || !mode.parallel()) {
+        this->cloneFrom(&tree);
+        return;
+    }
+    this->clear();
+    this->myRoot = this->cloneTree(tree.myRoot, subtreeHeight(tree.myRoot), mode);
+    this->nodes = tree.nodes;
+    this->smallestNode = BST<Data_T, Compare_T, Alloc_T>::smallest(this->myRoot);
+    this->largestNode = BST<Data_T, Compare_T, Alloc_T>::largest(this->myRoot);
+}
+
+// Child heights follow from the parent's height and balance factor, so the grain check costs nothing per node. If a
+// copy throws, both halves have finished by the time the exception gets here, and whatever was built is freed.
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+typename AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::AVLNode *AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::cloneTree(const typename BST<Data_T, Compare_T, Alloc_T>::BinNode *node, int height, const ParallelMode &mode) {
+    if (!forks(mode, height))
+        return this->cloneFrom(node);
+    AVLNode *copy = initNode(*node);
+    typename BST<Data_T, Compare_T, Alloc_T>::BinNode *left = nullptr, *right = nullptr;
+    copy->setBalance(((const AVLNode *) node)->balance());
+    if constexpr (OrderStatistics_T)
+        copy->subtreeSize = ((const AVLNode *) node)->subtreeSize;
+    if constexpr (aggregating)
+        copy->aggregate = ((const AVLNode *) node)->aggregate;
+    int leftHeight = height - (copy->balance() < 0 ? 2 : 1), rightHeight = height - (copy->balance() > 0 ? 2 : 1);
+    try {
+        forkJoin(mode, height, [&] { left = this->cloneTree(node->left, leftHeight, mode); },
+                 [&] { right = this->cloneTree(node->right, rightHeight, mode); });
+    } catch (...) {
+        this->deleteSubTree(left);
+        this->deleteSubTree(right);
+        this->destroyNode(copy);
+        throw;
+    }
+    copy->left = left;
+    copy->right = right;
+    if (left) ((AVLNode *) left)->setParent(copy);
+    if (right) ((AVLNode *) right)->setParent(copy);
+    return copy;
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+bool AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::forks(const ParallelMode &mode, int height) {
+    return mode.parallel() && height > heightOf(mode.grain);
+}
+
+// Runs both halves of a divide and conquer step, on the pool when `mode` has one and the piece (of the given height)
+// is above the grain
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+template<typename First_T, typename Second_T>
+void AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::forkJoin(const ParallelMode &mode, int height, First_T &&first, Second_T &&second) {
+    if (forks(mode, height)) {
+        mode.pool->invoke(first, second);
+    } else {
+        first();
+        second();
+    }
+}
+
+// Single descent lookups: the iterator is built straight from the node the search ended on
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+template<typename DataSearch_T>
+typename AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::Iterator
+AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::find(const DataSearch_T &item) const {
+    typename BST<Data_T, Compare_T, Alloc_T>::BinNode *parent;
+    return Iterator((AVLNode *) this->searchNode(this->myRoot, item, parent), this);
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+template<typename DataSearch_T, typename... Args>
+std::pair<typename AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::Iterator, bool>
+AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::findOrEmplace(const DataSearch_T &item, Args &&...args) {
+    typename BST<Data_T, Compare_T, Alloc_T>::BinNode *parent;
+    bool asLeftChild;
+    AVLNode *node = (AVLNode *) this->searchNode(this->myRoot, item, parent, asLeftChild);
+    if (node)
+        return {Iterator(node, this), false};
+    node = this->makeNode(std::forward<Args>(args)...);
+    this->insertNode(this->thaw((AVLNode *) parent), asLeftChild, node);
+    return {Iterator(node, this), true};
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+template<typename... Args>
+std::pair<typename AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::Iterator, bool>
+AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::emplace(Args &&...args) {
+    AVLNode *node = this->makeNode(std::forward<Args>(args)...);
+    typename BST<Data_T, Compare_T, Alloc_T>::BinNode *parent;
+    bool asLeftChild;
+    AVLNode *existing = (AVLNode *) this->searchNode(this->myRoot, node->getData(), parent, asLeftChild);
+    if (existing) {
+        this->destroyNode(node);
+        return {Iterator(existing, this), false};
+    }
+    this->insertNode(this->thaw((AVLNode *) parent), asLeftChild, node);
+    return {Iterator(node, this), true};
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+template<typename Iter_T>
+void AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::assignSorted(Iter_T first, size_t count) {
+    this->clear();
+    this->myRoot = this->buildSorted(first, count);
+    this->nodes = count;
+    this->smallestNode = BST<Data_T, Compare_T, Alloc_T>::smallest(this->myRoot);
+    this->largestNode = BST<Data_T, Compare_T, Alloc_T>::largest(this->myRoot);
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+template<typename Iter_T>
+void AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::assignSorted(Iter_T first, size_t count, const ParallelMode &mode) {
+    if constexpr (concurrentAllocation && std::is_base_of<std::random_access_iterator_tag,
+            typename std::iterator_traits<Iter_T>::iterator_category>::value) {
+        this->clear();
+        this->myRoot = this->buildSorted(first, count, mode);
+        this->nodes = count;
+        this->smallestNode = BST<Data_T, Compare_T, Alloc_T>::smallest(this->myRoot);
+        this->largestNode = BST<Data_T, Compare_T, Alloc_T>::largest(this->myRoot);
+    } else {
+        this->assignSorted(first, count);
+    }
+}
+
+// Builds the subtree for the next `count` items in order: left half, then the middle item, then the right half.
+// Splitting as evenly as possible makes a subtree of n nodes exactly heightOf(n) high, which gives the balance
+// factors directly. If an item's constructor throws, everything built so far is freed.
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+template<typename Iter_T>
+typename AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::AVLNode *AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::buildSorted(Iter_T &it, size_t count) {
+    if (!count) return nullptr;
+    size_t leftCount = (count - 1) / 2, rightCount = count - 1 - leftCount;
+    typename BST<Data_T, Compare_T, Alloc_T>::BinNode *left = this->buildSorted(it, leftCount), *node;
+    try {
+        node = this->makeNode(*it);
+    } catch (...) {
+        this->deleteSubTree(left);
+        throw;
+    }
+    ++it;
+    node->left = left;
+    if (left) ((AVLNode *) left)->setParent((AVLNode *) node);
+    try {
+        node->right = this->buildSorted(it, rightCount);
+    } catch (...) {
+        this->deleteSubTree(node);
+        throw;
+    }
+    if (node->right) ((AVLNode *) node->right)->setParent((AVLNode *) node);
+    ((AVLNode *) node)->setBalance(heightOf(leftCount) - heightOf(rightCount));
+    if constexpr (OrderStatistics_T)
+        ((AVLNode *) node)->subtreeSize = count;
+    if constexpr (aggregating)
+        reaggregate((AVLNode *) node);
+    return (AVLNode *) node;
+}
+
+// Random access version of the above: the middle item is built first, then both halves, in parallel above the grain
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+template<typename Iter_T>
+typename AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::AVLNode *AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::buildSorted(Iter_T first, size_t count, const ParallelMode &mode) {
+    if (!forks(mode, heightOf(count)))
+        return this->buildSorted(first, count);
+    size_t leftCount = (count - 1) / 2, rightCount = count - 1 - leftCount;
+    AVLNode *node = this->makeNode(*(first + leftCount));
+    typename BST<Data_T, Compare_T, Alloc_T>::BinNode *left = nullptr, *right = nullptr;
+    try {
+        forkJoin(mode, heightOf(count), [&] { left = this->buildSorted(first, leftCount, mode); },
+                 [&] { right = this->buildSorted(first + (leftCount + 1), rightCount, mode); });
+    } catch (...) {
+        this->deleteSubTree(left);
+        this->deleteSubTree(right);
+        this->destroyNode(node);
+        throw;
+    }
+    node->left = left;
+    node->right = right;
+    if (left) ((AVLNode *) left)->setParent(node);
+    if (right) ((AVLNode *) right)->setParent(node);
+    node->setBalance(heightOf(leftCount) - heightOf(rightCount));
+    if constexpr (OrderStatistics_T)
+        node->subtreeSize = count;
+    if constexpr (aggregating)
+        reaggregate(node);
+    return node;
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+int AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::heightOf(size_t count) {
+    int height = 0;
+    for (; count; count >>= 1)
+        ++height;
+    return height;
+}
+
+// -- split and join:
+// Heights are not stored, only balance factors, so they are read off by following the taller child down: O(log n)
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+int AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::subtreeHeight(const typename BST<Data_T, Compare_T, Alloc_T>::BinNode *node) {
+    int height = 0;
+    for (; node; ++height)
+        node = ((const AVLNode *) node)->balance() < 0 ? node->right : node->left;
+    return height;
+}
+
+// Cuts `node` loose from its parent, making it the root of a tree of its own
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+typename AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::AVLNode *AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::detach(typename BST<Data_T, Compare_T, Alloc_T>::BinNode *node) {
+    if (node)
+        ((AVLNode *) node)->setParent(nullptr);
+    return (AVLNode *) node;
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+void AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::recount(AVLNode *node) {
+    if constexpr (OrderStatistics_T)
+        resize(node);
+    if constexpr (aggregating)
+        reaggregate(node);
+}
+
+// Recomputes the subtree sizes and aggregates (whichever are kept) from `node` to the root
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+void AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::recountPath(AVLNode *node) {
+    if constexpr (OrderStatistics_T || aggregating) {
+        for (; node; node = node->parent())
+            recount(node);
+    }
+}
+
+// Installs a tree put together by the joins. Their rotations may have pointed myRoot anywhere meanwhile.
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+void AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::setRoot(AVLNode *root, size_t count) {
+    this->myRoot = detach(root);
+    this->nodes = count;
+    this->smallestNode = BST<Data_T, Compare_T, Alloc_T>::smallest(this->myRoot);
+    this->largestNode = BST<Data_T, Compare_T, Alloc_T>::largest(this->myRoot);
+}
+
+// Frees a detached subtree and returns how many nodes it had
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+size_t AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::dropSubTree(typename BST<Data_T, Compare_T, Alloc_T>::BinNode *node) {
+    size_t count = 0;
+    typename BST<Data_T, Compare_T, Alloc_T>::BinNode *next;
+    while (node) {
+        if (node->left) {
+            next = node->left;
+            node->left = next->right;
+            next->right = node;
+        } else {
+            next = node->right;
+            this->destroyNode(node);
+            ++count;
+        }
+        node = next;
+    }
+    return count;
+}
+
+// Entry count of the lower of two trees holding `count` entries between them: read off the subtree sizes when they
+// are kept, otherwise found by stepping through both trees together until the smaller one runs out
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+size_t AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::countLower(AVLNode *lower, AVLNode *upper, size_t count) const {
+    if constexpr (OrderStatistics_T) {
+        return sizeOf(lower);
+    } else {
+        lower = (AVLNode *) BST<Data_T, Compare_T, Alloc_T>::smallest(lower);
+        upper = (AVLNode *) BST<Data_T, Compare_T, Alloc_T>::smallest(upper);
+        size_t steps = 0;
+        for (; lower && upper; ++steps) {
+            lower = successor(lower);
+            upper = successor(upper);
+        }
+        return !lower ? steps : count - steps;
+    }
+}
+
+// Nodes can only move between trees whose allocators can free each other's memory. Otherwise the entries of `tree`
+// are first copied into `spare`, which shares this tree's allocator, and `tree` is emptied.
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::movable(AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &tree, AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &spare) {
+    if (this->alloc == tree.alloc)
+        return tree;
+    spare.cloneFrom(&tree);
+    tree.clear();
+    return spare;
+}
+
+// Joins two detached trees and a detached `pivot` node ordered between them, and returns the root of the result.
+// When the heights differ by more than one, the pivot takes over the first subtree on the taller tree's inner spine
+// that is at most one level taller than the shorter tree, and the growth is retraced from there as after an insert,
+// so the cost is O(|leftHeight - rightHeight| + 1). Without a pivot, the last entry of `left` is taken out to be one.
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+typename AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::AVLNode *AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::joinTrees(AVLNode *left, int leftHeight, AVLNode *pivot, AVLNode *right, int rightHeight,
+                                         int &height) {
+    if (!pivot) {
+        if (!left) {
+            height = rightHeight;
+            return right;
+        }
+        left = this->splitLast(left, leftHeight, pivot, leftHeight);
+    }
+    if (leftHeight > rightHeight + 1 || rightHeight > leftHeight + 1) {
+        bool alongRight = leftHeight > rightHeight;
+        AVLNode *top = alongRight ? left : right, *parent = nullptr, *node = top;
+        int nodeHeight = alongRight ? leftHeight : rightHeight, shorterHeight = alongRight ? rightHeight : leftHeight;
+        while (nodeHeight > shorterHeight + 1) {
+            parent = node;
+            if (alongRight) {
+                nodeHeight -= node->balance() > 0 ? 2 : 1;
+                node = (AVLNode *) node->right;
+            } else {
+                nodeHeight -= node->balance() < 0 ? 2 : 1;
+                node = (AVLNode *) node->left;
+            }
+        }
+        pivot->left = alongRight ? node : left;
+        pivot->right = alongRight ? right : node;
+        pivot->setBalance(alongRight ? nodeHeight - rightHeight : leftHeight - nodeHeight);
+        if (alongRight)
+            parent->right = pivot;
+        else
+            parent->left = pivot;
+        pivot->setParent(parent);
+        if (pivot->left) ((AVLNode *) pivot->left)->setParent(pivot);
+        if (pivot->right) ((AVLNode *) pivot->right)->setParent(pivot);
+        recountPath(pivot);
+        height = (alongRight ? leftHeight : rightHeight) + (this->retraceGrowth(pivot) ? 1 : 0);
+        while (top->parent())
+            top = top->parent();
+        return top;
+    }
+    pivot->left = left;
+    pivot->right = right;
+    pivot->setParent(nullptr);
+    pivot->setBalance(leftHeight - rightHeight);
+    if (left) left->setParent(pivot);
+    if (right) right->setParent(pivot);
+    recount(pivot);
+    height = (leftHeight > rightHeight ? leftHeight : rightHeight) + 1;
+    return pivot;
+}
+
+// Takes the last node out of a detached tree (into `last`) and returns the rest
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+typename AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::AVLNode *AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::splitLast(AVLNode *node, int height, AVLNode *&last, int &restHeight) {
+    int leftHeight = height - (node->balance() < 0 ? 2 : 1), rightHeight = height - (node->balance() > 0 ? 2 : 1);
+    AVLNode *left = detach(node->left), *right = detach(node->right);
+    node->left = node->right = nullptr;
+    if (!right) {
+        last = node;
+        restHeight = leftHeight;
+        return left;
+    }
+    right = this->splitLast(right, rightHeight, last, rightHeight);
+    return this->joinTrees(left, leftHeight, node, right, rightHeight, restHeight);
+}
+
+// Splits a detached tree around `item`: entries ordered before it end up in `lower`, entries after it in `upper`, and
+// the node equivalent to it, if any, is returned on its own. Each level joins the subtree it does not descend into
+// back onto one side, and those joins' costs telescope to O(height).
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+template<typename DataSearch_T>
+typename AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::AVLNode *AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::splitTree(AVLNode *node, int height, const DataSearch_T &item, AVLNode *&lower,
+                                         int &lowerHeight, AVLNode *&upper, int &upperHeight) {
+    if (!node) {
+        lower = upper = nullptr;
+        lowerHeight = upperHeight = 0;
+        return nullptr;
+    }
+    int leftHeight = height - (node->balance() < 0 ? 2 : 1), rightHeight = height - (node->balance() > 0 ? 2 : 1);
+    AVLNode *left = detach(node->left), *right = detach(node->right), *same;
+    node->left = node->right = nullptr;
+    const Compare_T &comp = this->compare();
+    if (comp(item, node->getData())) {
+        same = this->splitTree(left, leftHeight, item, lower, lowerHeight, left, leftHeight);
+        upper = this->joinTrees(left, leftHeight, node, right, rightHeight, upperHeight);
+    } else if (comp(node->getData(), item)) {
+        same = this->splitTree(right, rightHeight, item, right, rightHeight, upper, upperHeight);
+        lower = this->joinTrees(left, leftHeight, node, right, rightHeight, lowerHeight);
+    } else {
+        lower = left;
+        lowerHeight = leftHeight;
+        upper = right;
+        upperHeight = rightHeight;
+        same = node;
+    }
+    return same;
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+template<typename DataSearch_T>
+AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::split(const DataSearch_T &item) {
+    AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> upper(this->updateIfExists, this->compare(), this->alloc);
+    if (!this->myRoot)
+        return upper;
+    this->thawAll();
+    size_t count = this->nodes;
+    AVLNode *root = (AVLNode *) this->myRoot, *lowerRoot, *upperRoot;
+    int lowerHeight, upperHeight;
+    this->setRoot(nullptr, 0);
+    AVLNode *same = this->splitTree(root, subtreeHeight(root), item, lowerRoot, lowerHeight, upperRoot, upperHeight);
+    if (same)
+        upperRoot = this->joinTrees(nullptr, 0, same, upperRoot, upperHeight, upperHeight);
+    size_t lowerCount = this->countLower(lowerRoot, upperRoot, count);
+    this->setRoot(lowerRoot, lowerCount);
+    upper.setRoot(upperRoot, count - lowerCount);
+    return upper;
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+void AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::join(AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &tree) {
+    if (&tree == this || !tree.myRoot)
+        return;
+    if (this->myRoot && !this->compare()(this->largestNode->getData(), tree.smallestNode->getData()))
+        throw std::out_of_range("joined tree has entries not ordered after this tree's");
+    AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> spare(this->updateIfExists, this->compare(), this->alloc);
+    AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &source = this->movable(tree, spare);
+    this->thawAll();
+    source.thawAll();
+    size_t count = this->nodes + source.nodes;
+    AVLNode *left = (AVLNode *) this->myRoot, *right = (AVLNode *) source.myRoot;
+    int leftHeight = subtreeHeight(left), rightHeight = subtreeHeight(right), height;
+    this->setRoot(nullptr, 0);
+    source.setRoot(nullptr, 0);
+    this->setRoot(this->joinTrees(left, leftHeight, nullptr, right, rightHeight, height), count);
+}
+
+// -- set operations: split `mine` around the root of `theirs`, recurse on both sides (independently, so possibly in
+// parallel), and join the results back (Blelloch, Ferizovic and Sun, "Just Join for Parallel Ordered Sets")
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+typename AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::AVLNode *AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::unionTrees(AVLNode *mine, int myHeight, AVLNode *theirs, int theirHeight, int &height,
+                                                    DropList &dropped, const ParallelMode &mode) {
+    if (!mine || !theirs) {
+        height = mine ? myHeight : theirHeight;
+        return mine ? mine : theirs;
+    }
+    int leftHeight = theirHeight - (theirs->balance() < 0 ? 2 : 1), rightHeight = theirHeight - (theirs->balance() > 0 ? 2 : 1);
+    AVLNode *left = detach(theirs->left), *right = detach(theirs->right), *lower, *upper;
+    theirs->left = theirs->right = nullptr;
+    int lowerHeight, upperHeight;
+    AVLNode *same = this->splitTree(mine, myHeight, theirs->getData(), lower, lowerHeight, upper, upperHeight);
+    if (same) {
+        dropped.push(theirs);
+        theirs = same;
+    }
+    DropList upperDropped;
+    forkJoin(mode, myHeight > theirHeight ? myHeight : theirHeight,
+             [&] { lower = this->unionTrees(lower, lowerHeight, left, leftHeight, lowerHeight, dropped, mode); },
+             [&] { upper = this->unionTrees(upper, upperHeight, right, rightHeight, upperHeight, upperDropped, mode); });
+    dropped.splice(upperDropped);
+    return this->joinTrees(lower, lowerHeight, theirs, upper, upperHeight, height);
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+typename AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::AVLNode *AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::intersectTrees(AVLNode *mine, int myHeight, AVLNode *theirs, int theirHeight, int &height,
+                                                        DropList &dropped, const ParallelMode &mode) {
+    if (!mine || !theirs) {
+        dropped.push(mine);
+        dropped.push(theirs);
+        height = 0;
+        return nullptr;
+    }
+    int leftHeight = theirHeight - (theirs->balance() < 0 ? 2 : 1), rightHeight = theirHeight - (theirs->balance() > 0 ? 2 : 1);
+    AVLNode *left = detach(theirs->left), *right = detach(theirs->right), *lower, *upper;
+    theirs->left = theirs->right = nullptr;
+    int lowerHeight, upperHeight;
+    AVLNode *same = this->splitTree(mine, myHeight, theirs->getData(), lower, lowerHeight, upper, upperHeight);
+    dropped.push(theirs);
+    DropList upperDropped;
+    forkJoin(mode, myHeight > theirHeight ? myHeight : theirHeight,
+             [&] { lower = this->intersectTrees(lower, lowerHeight, left, leftHeight, lowerHeight, dropped, mode); },
+             [&] { upper = this->intersectTrees(upper, upperHeight, right, rightHeight, upperHeight, upperDropped, mode); });
+    dropped.splice(upperDropped);
+    return this->joinTrees(lower, lowerHeight, same, upper, upperHeight, height);
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+typename AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::AVLNode *AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::differenceTrees(AVLNode *mine, int myHeight, AVLNode *theirs, int theirHeight, int &height,
+                                                         DropList &dropped, const ParallelMode &mode) {
+    if (!mine || !theirs) {
+        dropped.push(theirs);
+        height = mine ? myHeight : 0;
+        return mine;
+    }
+    int leftHeight = theirHeight - (theirs->balance() < 0 ? 2 : 1), rightHeight = theirHeight - (theirs->balance() > 0 ? 2 : 1);
+    AVLNode *left = detach(theirs->left), *right = detach(theirs->right), *lower, *upper;
+    theirs->left = theirs->right = nullptr;
+    int lowerHeight, upperHeight;
+    AVLNode *same = this->splitTree(mine, myHeight, theirs->getData(), lower, lowerHeight, upper, upperHeight);
+    dropped.push(theirs);
+    dropped.push(same);
+    DropList upperDropped;
+    forkJoin(mode, myHeight > theirHeight ? myHeight : theirHeight,
+             [&] { lower = this->differenceTrees(lower, lowerHeight, left, leftHeight, lowerHeight, dropped, mode); },
+             [&] { upper = this->differenceTrees(upper, upperHeight, right, rightHeight, upperHeight, upperDropped, mode); });
+    dropped.splice(upperDropped);
+    return this->joinTrees(lower, lowerHeight, nullptr, upper, upperHeight, height);
+}
+
+// Runs one of the set operations on the two whole trees, then frees what it discarded
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+void AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::combine(AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &tree, SetOperation_T operation,
+                                                                 const ParallelMode &mode) {
+    AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> spare(this->updateIfExists, this->compare(), this->alloc);
+    AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &source = this->movable(tree, spare);
+    this->thawAll();
+    source.thawAll();
+    size_t count = this->nodes + source.nodes;
+    AVLNode *mine = (AVLNode *) this->myRoot, *theirs = (AVLNode *) source.myRoot;
+    DropList dropped;
+    int height;
+    this->setRoot(nullptr, 0);
+    source.setRoot(nullptr, 0);
+    AVLNode *root = (this->*operation)(mine, subtreeHeight(mine), theirs, subtreeHeight(theirs), height, dropped, mode);
+    for (AVLNode *node = dropped.head, *next; node; node = next) {
+        next = node->parent();
+        count -= this->dropSubTree(node);
+    }
+    this->setRoot(root, count);
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+void AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::mergeUnion(AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &tree, const ParallelMode &mode) {
+    if (&tree != this)
+        this->combine(tree, &AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::unionTrees, mode);
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+void AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::intersection(AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &tree, const ParallelMode &mode) {
+    if (&tree != this)
+        this->combine(tree, &AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::intersectTrees, mode);
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+void AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::difference(AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &tree, const ParallelMode &mode) {
+    if (&tree == this)
+        this->clear();
+    else
+        this->combine(tree, &AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::differenceTrees, mode);
+}
+
+// -- batches: split the detached tree at `node` around the middle change, apply the changes below and above it to the
+// two sides, and join them around whatever the middle change leaves. Should anything throw, `node` gets the pieces
+// joined back together, so the tree stays whole.
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+template<typename Iter_T, typename Batch_T>
+void AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::applyTrees(AVLNode *&node, int &height, Iter_T first, size_t count, Batch_T &batch,
+                                                                    DropList &dropped, size_t &added) {
+    if (!count)
+        return;
+    size_t lowerCount = count / 2;
+    Iter_T middle = first + lowerCount;
+    AVLNode *lower, *upper;
+    int lowerHeight, upperHeight;
+    AVLNode *pivot = this->splitTree(node, height, batch.key(*middle), lower, lowerHeight, upper, upperHeight);
+    try {
+        this->applyTrees(lower, lowerHeight, first, lowerCount, batch, dropped, added);
+        if (pivot) {
+            if (!batch.update(*middle, pivot->getData())) {
+                dropped.push(pivot);
+                pivot = nullptr;
+            }
+        } else if (batch.insert(*middle)) {
+            pivot = this->makeNode(batch.make(*middle));
+            ++added;
+        }
+        this->applyTrees(upper, upperHeight, middle + 1, count - lowerCount - 1, batch, dropped, added);
+    } catch (...) {
+        node = this->joinTrees(lower, lowerHeight, pivot, upper, upperHeight, height);
+        throw;
+    }
+    node = this->joinTrees(lower, lowerHeight, pivot, upper, upperHeight, height);
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+template<typename Iter_T, typename Batch_T>
+void AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::applySorted(Iter_T first, size_t count, Batch_T &batch) {
+    if (!count)
+        return;
+    this->thawAll();
+    AVLNode *root = (AVLNode *) this->myRoot;
+    int height = subtreeHeight(root);
+    size_t nodes = this->nodes, added = 0;
+    DropList dropped;
+    auto settle = [&] {
+        for (AVLNode *node = dropped.head, *next; node; node = next) {
+            next = node->parent();
+            nodes -= this->dropSubTree(node);
+        }
+        this->setRoot(root, nodes + added);
+    };
+    this->setRoot(nullptr, 0);
+    try {
+        this->applyTrees(root, height, first, count, batch, dropped, added);
+    } catch (...) {
+        settle();
+        throw;
+    }
+    settle();
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+template<typename DataSearch_T>
+typename AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::Iterator AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::lowerBound(const DataSearch_T &item) const {
+    const Compare_T &comp = this->compare();
+    typename BST<Data_T, Compare_T, Alloc_T>::BinNode *node = this->myRoot, *bound = nullptr;
+    while (node) {
+        if (comp(node->getData(), item)) {
+            node = node->right;
+        } else {
+            bound = node;
+            node = node->left;
+        }
+    }
+    return Iterator((AVLNode *) bound, this);
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+template<typename DataSearch_T>
+typename AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::Iterator AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::upperBound(const DataSearch_T &item) const {
+    const Compare_T &comp = this->compare();
+    typename BST<Data_T, Compare_T, Alloc_T>::BinNode *node = this->myRoot, *bound = nullptr;
+    while (node) {
+        if (comp(item, node->getData())) {
+            bound = node;
+            node = node->left;
+        } else {
+            node = node->right;
+        }
+    }
+    return Iterator((AVLNode *) bound, this);
+}
+
+// Entries are unique, so the upper bound is either the lower bound itself or its successor
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+template<typename DataSearch_T>
+std::pair<typename AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::Iterator, typename AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::Iterator>
+AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::equalRange(const DataSearch_T &item) const {
+    Iterator lower = this->lowerBound(item);
+    if (!lower.node || this->compare()(item, lower.node->getData()))
+        return {lower, lower};
+    return {lower, Iterator(successor(lower.node), this)};
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+void AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::erase(const Iterator &it) {
+    if (!it.node)
+        throw std::out_of_range("cannot erase end of tree");
+    typename BST<Data_T, Compare_T, Alloc_T>::delete_mode mode = BST<Data_T, Compare_T, Alloc_T>::LEAF_NODE;
+    if (it.node->left && it.node->right)
+        mode = BST<Data_T, Compare_T, Alloc_T>::TWO_CHILDREN;
+    else if (it.node->left || it.node->right)
+        mode = BST<Data_T, Compare_T, Alloc_T>::ONE_CHILD;
+    this->deleteNode(it.node, it.node->parent(), mode);
+}
+
+// Unlinks the range straight from the iterators: no searches, and since each delete starts its retrace at the removed
+// node's parent, rebalancing costs amortized O(1) per node. A whole-tree range is simply cleared. Both ends, and each
+// node's successor before the node goes, are thawed up front so that no thaw moves a node the loop still holds.
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+size_t AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::erase(const Iterator &first, const Iterator &last) {
+    if (first.node && last.node && this->compare()(last.node->getData(), first.node->getData()))
+        throw std::out_of_range("iterator range is not valid for this tree");
+    if (first.node == this->smallestNode && !last.node) {
+        size_t count = this->nodes;
+        this->clear();
+        return count;
+    }
+    size_t count = 0;
+    AVLNode *node = first.node, *stop = last.node, *following;
+    this->thawPair(node, stop);
+    for (; node != stop; node = following, ++count) {
+        following = this->thaw(successor(node));
+        this->erase(Iterator(node, this));
+    }
+    return count;
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+template<typename DataSearch_T>
+size_t AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::rank(const DataSearch_T &item) const {
+    static_assert(OrderStatistics_T, "rank() needs a tree with OrderStatistics_T enabled");
+    const Compare_T &comp = this->compare();
+    typename BST<Data_T, Compare_T, Alloc_T>::BinNode *node = this->myRoot;
+    size_t before = 0;
+    while (node) {
+        if (comp(node->getData(), item)) {
+            before += sizeOf(node->left) + 1;
+            node = node->right;
+        } else {
+            node = node->left;
+        }
+    }
+    return before;
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+typename AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::aggregate_type AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::aggregate() const {
+    static_assert(aggregating, "aggregate() needs a tree with an Aggregate_T policy");
+    return aggregateOf(this->myRoot);
+}
+
+// Finds the highest node inside [lo, hi), then adds up the parts of its left subtree not below `lo` and the parts of
+// its right subtree below `hi`, taking whole subtree aggregates wherever a boundary path turns away from them
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+template<typename DataSearch_T>
+typename AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::aggregate_type AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::aggregate(const DataSearch_T &lo, const DataSearch_T &hi) const {
+    static_assert(aggregating, "aggregate() needs a tree with an Aggregate_T policy");
+    const Compare_T &comp = this->compare();
+    typename BST<Data_T, Compare_T, Alloc_T>::BinNode *split = this->myRoot, *node;
+    while (split) {
+        if (comp(split->getData(), lo))
+            split = split->right;
+        else if (!comp(split->getData(), hi))
+            split = split->left;
+        else
+            break;
+    }
+    if (!split)
+        return Aggregate_T::identity();
+
+    aggregate_type below = Aggregate_T::identity(), above = Aggregate_T::identity();
+    for (node = split->left; node;) {
+        if (comp(node->getData(), lo)) {
+            node = node->right;
+        } else {
+            below = Aggregate_T::combine(
+                    Aggregate_T::combine(Aggregate_T::of(node->getData()), aggregateOf(node->right)), below);
+            node = node->left;
+        }
+    }
+    for (node = split->right; node;) {
+        if (comp(node->getData(), hi)) {
+            above = Aggregate_T::combine(
+                    above, Aggregate_T::combine(aggregateOf(node->left), Aggregate_T::of(node->getData())));
+            node = node->right;
+        } else {
+            node = node->left;
+        }
+    }
+    return Aggregate_T::combine(Aggregate_T::combine(below, Aggregate_T::of(split->getData())), above);
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+void AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::refresh(const Iterator &it) {
+    static_assert(aggregating, "refresh() needs a tree with an Aggregate_T policy");
+    if (!it.node)
+        throw std::out_of_range("cannot refresh end of tree");
+    reaggregatePath(this->thaw(it.node));
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+typename AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::Iterator AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::select(size_t index) const {
+    static_assert(OrderStatistics_T, "select() needs a tree with OrderStatistics_T enabled");
+    if (index > this->nodes)
+        throw std::out_of_range("specified index is past the end of the tree");
+    typename BST<Data_T, Compare_T, Alloc_T>::BinNode *node = this->myRoot;
+    while (node) {
+        size_t leftSize = sizeOf(node->left);
+        if (index < leftSize) {
+            node = node->left;
+        } else if (index > leftSize) {
+            index -= leftSize + 1;
+            node = node->right;
+        } else {
+            break;
+        }
+    }
+    return Iterator((AVLNode *) node, this);
+}
+
+// Counts the nodes before `node` on the way up: its left subtree, plus every ancestor (and that ancestor's left
+// subtree) it hangs to the right of. A borrowed node's rank is searched for from the root instead.
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+size_t AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::indexOf(const AVLNode *node) const {
+    static_assert(OrderStatistics_T, "iterator positions need a tree with OrderStatistics_T enabled");
+    if (!node)
+        return this->nodes;
+    if (this->borrowed(node))
+        return this->rank(const_cast<AVLNode *>(node)->getData());
+    size_t index = sizeOf(node->left);
+    for (const AVLNode *parent = node->parent(); parent; node = parent, parent = parent->parent()) {
+        if (parent->right == node)
+            index += sizeOf(parent->left) + 1;
+    }
+    return index;
+}
+
+// Climbs the parent links, which are all the tree's own above a node that is not borrowed. Above a borrowed node the
+// successor is the last node the search for it from the root leaves to its left.
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+typename AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::AVLNode *AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::successor(AVLNode *node) const {
+    if (node->right)
+        return (AVLNode *) BST<Data_T, Compare_T, Alloc_T>::smallest(node->right);
+    if (this->borrowed(node)) {
+        const Compare_T &comp = this->compare();
+        typename BST<Data_T, Compare_T, Alloc_T>::BinNode *current = this->myRoot, *bound = nullptr;
+        while (current) {
+            if (comp(node->getData(), current->getData())) {
+                bound = current;
+                current = current->left;
+            } else {
+                current = current->right;
+            }
+        }
+        return (AVLNode *) bound;
+    }
+    AVLNode *parent = node->parent();
+    while (parent && parent->right == node) {
+        node = parent;
+        parent = parent->parent();
+    }
+    return parent;
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+typename AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::AVLNode *AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::predecessor(AVLNode *node) const {
+    if (node->left)
+        return (AVLNode *) BST<Data_T, Compare_T, Alloc_T>::largest(node->left);
+    if (this->borrowed(node)) {
+        const Compare_T &comp = this->compare();
+        typename BST<Data_T, Compare_T, Alloc_T>::BinNode *current = this->myRoot, *bound = nullptr;
+        while (current) {
+            if (comp(current->getData(), node->getData())) {
+                bound = current;
+                current = current->right;
+            } else {
+                current = current->left;
+            }
+        }
+        return (AVLNode *) bound;
+    }
+    AVLNode *parent = node->parent();
+    while (parent && parent->left == node) {
+        node = parent;
+        parent = parent->parent();
+    }
+    return parent;
+}
+
+// Restores the AVL property at `node`, whose balance factor has reached `balance` (+2 or -2), and returns the new root
+// of its subtree. The new root's balance factor is 0 unless the subtree kept its height (possible only after a delete).
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+typename AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::AVLNode *AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::balance(AVLNode *node, int balance) {
+    if (balance > 0) {
+        AVLNode *child = (AVLNode *) node->left;
+        if (child->balance() >= 0) {
+            this->rotate(child, RIGHT_ROTATE);
+            bool keptHeight = child->balance() == 0;
+            node->setBalance(keptHeight ? 1 : 0);
+            child->setBalance(keptHeight ? -1 : 0);
+            return child;
+        }
+        AVLNode *grandChild = (AVLNode *) child->right;
+        this->rotate(grandChild, LEFT_RIGHT_ROTATE);
+        node->setBalance(grandChild->balance() > 0 ? -1 : 0);
+        child->setBalance(grandChild->balance() < 0 ? 1 : 0);
+        grandChild->setBalance(0);
+        return grandChild;
+    } else {
+        AVLNode *child = (AVLNode *) node->right;
+        if (child->balance() <= 0) {
+            this->rotate(child, LEFT_ROTATE);
+            bool keptHeight = child->balance() == 0;
+            node->setBalance(keptHeight ? -1 : 0);
+            child->setBalance(keptHeight ? 1 : 0);
+            return child;
+        }
+        AVLNode *grandChild = (AVLNode *) child->left;
+        this->rotate(grandChild, RIGHT_LEFT_ROTATE);
+        node->setBalance(grandChild->balance() < 0 ? 1 : 0);
+        child->setBalance(grandChild->balance() > 0 ? -1 : 0);
+        grandChild->setBalance(0);
+        return grandChild;
+    }
+}
+
+// Moves `rotateNode` one level up, above its parent (two levels for the double rotations). Only links are changed;
+// balance factors are the caller's business.
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+void AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::rotate(AVLNode *rotateNode, rotation_type rotationType) {
+    if (!rotateNode || !rotateNode->parent())
+        return;
+    AVLNode *rotated = rotateNode->parent(), *movedChild = nullptr;
+
+    switch (rotationType) {
+        case LEFT_ROTATE:
+            movedChild = (AVLNode *) rotateNode->left;
+            BST<Data_T, Compare_T, Alloc_T>::setLink(rotated->right, movedChild);
+            BST<Data_T, Compare_T, Alloc_T>::setLink(rotateNode->left, rotated);
+            break;
+        case RIGHT_ROTATE:
+            movedChild = (AVLNode *) rotateNode->right;
+            BST<Data_T, Compare_T, Alloc_T>::setLink(rotated->left, movedChild);
+            BST<Data_T, Compare_T, Alloc_T>::setLink(rotateNode->right, rotated);
+            break;
+        case LEFT_RIGHT_ROTATE: {
+            this->rotate(rotateNode, LEFT_ROTATE);
+            this->rotate(rotateNode, RIGHT_ROTATE);
             return;
         }
         case RIGHT_LEFT_ROTATE: {
@@ -464,15 +1971,478 @@ void AVL<Data_T>::rotate(AVLNode *rotateNode, rotation_type rotationType) {
         }
     }
 
-    if (isRoot || !parentOfRotated) // Is parent Root
-        this->myRoot = rotateNode;
-    else {
-        if (rotated->childType == LEFT_NODE) {
-            parentOfRotated->left = rotateNode;
-            rotateNode->parent = parentOfRotated;
-        } else if (rotated->childType == RIGHT_NODE) {
-            parentOfRotated->right = rotateNode;
-            rotateNode->parent = parentOfRotated;
+    this->attach(movedChild, rotated);
+    this->replaceChild(rotated, rotateNode);
+    rotated->setParent(rotateNode);
+    if constexpr (OrderStatistics_T) {
+        resize(rotated);
+        resize(rotateNode);
+    }
+    if constexpr (aggregating) {
+        reaggregate(rotated);
+        reaggregate(rotateNode);
+    }
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+size_t AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::sizeOf(const typename BST<Data_T, Compare_T, Alloc_T>::BinNode *node) {
+    return node ? ((const AVLNode *) node)->subtreeSize : 0;
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+void AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::resize(AVLNode *node) {
+    node->subtreeSize = 1 + sizeOf(node->left) + sizeOf(node->right);
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+typename AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::aggregate_type AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::aggregateOf(const typename BST<Data_T, Compare_T, Alloc_T>::BinNode *node) {
+    return node ? ((const AVLNode *) node)->aggregate : Aggregate_T::identity();
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+void AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::reaggregate(AVLNode *node) {
+    node->aggregate = Aggregate_T::combine(
+            Aggregate_T::combine(aggregateOf(node->left), Aggregate_T::of(node->getData())), aggregateOf(node->right));
+}
+
+// Recomputes every aggregate from `node` (whose children are up to date) to the root
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+void AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::reaggregatePath(AVLNode *node) {
+    for (; node; node = node->parent())
+        reaggregate(node);
+}
+
+// Applies an insert (+1) or delete (-1) to the subtree sizes from `node` up to the root, before any rotation runs
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+void AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::resizePath(AVLNode *node, long delta) {
+    for (; node; node = node->parent())
+        node->subtreeSize += delta;
+}
+
+// -- snapshots
+// The id is registered before it becomes the generation of new nodes, so a failed snapshot leaves the tree as it was
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+typename AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::Snapshot AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::snapshot() {
+    static_assert(Snapshots_T, "snapshot() needs a tree with Snapshots_T enabled");
+    if (!this->snapshotState)
+        this->snapshotState = std::make_shared<SnapshotState>(this->nodeAlloc);
+    uint64_t id = snapshotIds.fetch_add(1, std::memory_order_relaxed) + 1;
+    Snapshot snapshot(std::make_shared<const typename Snapshot::View>(this->snapshotState, id, (AVLNode *) this->myRoot,
+                                                                      this->nodes, this->compare()));
+    this->snapshotState->open(id);
+    this->snapshotState->generation = id;
+    return snapshot;
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+void AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::unshare(Iterator &it) {
+    if constexpr (Snapshots_T)
+        it.node = const_cast<AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> *>(it.tree)->thaw(it.node);
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+void AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::unshare(Iterator &first, Iterator &last) {
+    if constexpr (Snapshots_T)
+        const_cast<AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> *>(first.tree)->thawPair(first.node, last.node);
+}
+
+// Borrows every node of `tree` in O(1). The copy registers with the tree's SnapshotState under an id of its own, like a
+// snapshot, and holds on to that state as its source: the tree then copies what it shares before changing it, and
+// keeps what it retires until the copy's state is gone. Registering only takes the snapshot lock (the state itself is
+// installed with an atomic exchange), so a tree can be copied from several threads at once like any other read. A
+// copy of a copy keeps its source's own source alive as well; past copyDepth the copy is made eagerly instead, which
+// ends the chain.
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+void AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::share(const AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T> &tree) {
+    if constexpr (Snapshots_T) {
+        if (!tree.myRoot)
+            return;
+        std::shared_ptr<SnapshotState> source = std::atomic_load(&tree.snapshotState);
+        if (!source) {
+            std::shared_ptr<SnapshotState> made = std::make_shared<SnapshotState>(tree.nodeAlloc);
+            if (std::atomic_compare_exchange_strong(const_cast<std::shared_ptr<SnapshotState> *>(&tree.snapshotState),
+                                                    &source, made))
+                source = std::move(made);
+        }
+        if (source->depth >= copyDepth) {
+            this->cloneFrom(&tree);
+            return;
         }
+        this->snapshotState = std::make_shared<SnapshotState>(this->nodeAlloc);
+        uint64_t id = source->share();
+        this->snapshotState->depth = source->depth + 1;
+        this->snapshotState->source = std::move(source);
+        this->snapshotState->sourceId = id;
+        this->snapshotState->generation = id;
+        this->borrowedBelow = id;
+        this->myRoot = tree.myRoot;
+        this->nodes = tree.nodes;
+        this->smallestNode = tree.smallestNode;
+        this->largestNode = tree.largestNode;
     }
-}
\ No newline at end of file
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+bool AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::borrowed(const AVLNode *node) const {
+    if constexpr (Snapshots_T)
+        return node->generation < this->borrowedBelow;
+    else
+        return false;
+}
+
+// Whether any node may be shared, with a snapshot or with the tree this one was copied from
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+bool AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::sharing() const {
+    if constexpr (Snapshots_T)
+        return this->borrowedBelow || (this->snapshotState && this->snapshotState->newest.load(std::memory_order_acquire));
+    else
+        return false;
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+bool AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::frozen(const AVLNode *node) const {
+    if constexpr (Snapshots_T)
+        return this->borrowed(node) ||
+               (this->snapshotState && node->generation < this->snapshotState->newest.load(std::memory_order_acquire));
+    else
+        return false;
+}
+
+// Points `child` (if any) at its new parent, unless it is borrowed: that parent link belongs to the tree it came from
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+void AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::attach(AVLNode *child, AVLNode *parent) {
+    if (child && !this->borrowed(child))
+        child->setParent(parent);
+}
+
+// Hands a node (or subtree) the tree no longer links to its snapshots and copies, unless it is borrowed, in which case
+// the tree it came from still owns it
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+void AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::retire(AVLNode *node, bool subtree) {
+    if (!this->borrowed(node))
+        this->snapshotState->retire(node, subtree, this->borrowedBelow);
+}
+
+// Makes `node` and its path to the root safe to change, and returns what is now `node`. The whole path is checked, as
+// nodes a join or set operation brought in from another tree can be unshared below shared ones (or the reverse).
+// Borrowed nodes only ever lie below the tree's own, so the path above a node that is not borrowed can be climbed.
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+typename AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::AVLNode *AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::thaw(AVLNode *node) {
+    if constexpr (Snapshots_T) {
+        if (!node || !this->sharing())
+            return node;
+        if (this->borrowed(node))
+            return this->thawFromRoot(node);
+        this->thaw(node->parent());
+        return this->thawBelow(node, node->parent());
+    } else {
+        return node;
+    }
+}
+
+// Thaws the path to a borrowed node from the root down, finding it by its entry, which is unique in the tree
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+typename AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::AVLNode *AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::thawFromRoot(AVLNode *node) {
+    const Compare_T &comp = this->compare();
+    AVLNode *parent = nullptr, *current = (AVLNode *) this->myRoot;
+    while (true) {
+        current = this->thawBelow(current, parent);
+        parent = current;
+        if (comp(node->getData(), current->getData()))
+            current = (AVLNode *) current->left;
+        else if (comp(current->getData(), node->getData()))
+            current = (AVLNode *) current->right;
+        else
+            return current;
+    }
+}
+
+// Copies a node a snapshot or copy may share, once its parent is safe to change (so that the copy can be linked in),
+// and returns the copy. The copy takes over the original's place, children, balance factor and augmentations; the
+// original is retired as is.
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+typename AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::AVLNode *AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::thawBelow(AVLNode *node, AVLNode *parent) {
+    if constexpr (Snapshots_T) {
+        if (!node || !this->frozen(node))
+            return node;
+        AVLNode *copy = this->initNode(*node);
+        copy->left = node->left;
+        copy->right = node->right;
+        copy->setParent(parent);
+        copy->setBalance(node->balance());
+        if constexpr (OrderStatistics_T)
+            copy->subtreeSize = node->subtreeSize;
+        if constexpr (aggregating)
+            copy->aggregate = node->aggregate;
+        this->attach((AVLNode *) copy->left, copy);
+        this->attach((AVLNode *) copy->right, copy);
+        if (!parent)
+            this->myRoot = copy;
+        else if (parent->left == node)
+            parent->left = copy;
+        else
+            parent->right = copy;
+        if (this->smallestNode == node)
+            this->smallestNode = copy;
+        if (this->largestNode == node)
+            this->largestNode = copy;
+        this->retire(node, false);
+        return copy;
+    } else {
+        return node;
+    }
+}
+
+// The child on the heavy side of `node`, and for a double rotation its inner child, as balance() will rotate them
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+typename AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::AVLNode *AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::thawHeavySide(AVLNode *node, int balance) {
+    if constexpr (Snapshots_T) {
+        AVLNode *child = this->thawBelow((AVLNode *) (balance > 0 ? node->left : node->right), node);
+        if (balance > 0 ? child->balance() < 0 : child->balance() > 0)
+            this->thawBelow((AVLNode *) (balance > 0 ? child->right : child->left), child);
+    }
+    return node;
+}
+
+// Thaws two nodes, either of which may lie on the other's path to the root and be copied along with it; the one
+// above is then found again by climbing from the one below. With borrowed nodes about, whose parent links cannot be
+// climbed, `second` is found again by its entry instead.
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+void AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::thawPair(AVLNode *&first, AVLNode *&second) {
+    if constexpr (Snapshots_T) {
+        if (this->borrowedBelow) {
+            first = this->thaw(first);
+            if (second) {
+                typename BST<Data_T, Compare_T, Alloc_T>::BinNode *parent;
+                second = this->thaw((AVLNode *) this->searchNode(this->myRoot, second->getData(), parent));
+            }
+            return;
+        }
+        AVLNode **lower = &first, **upper = &second, *above;
+        int levels = 0;
+        for (above = first; above && above != second; above = above->parent(), ++levels);
+        if (!above) {
+            std::swap(lower, upper);
+            for (levels = 0, above = second; above && above != first; above = above->parent(), ++levels);
+        }
+        if (!above) {
+            first = this->thaw(first);
+            second = this->thaw(second);
+            return;
+        }
+        for (*upper = *lower = this->thaw(*lower); levels; --levels)
+            *upper = (*upper)->parent();
+    }
+}
+
+// Before split, join and the set operations, which relink nodes all over the tree: the unshared top of the tree is
+// kept, and every subtree a snapshot or copy may share is copied wholesale (and retired as a unit, unless borrowed).
+// Nothing is borrowed afterwards, so the nodes brought in from another tree are all taken as this tree's own.
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+void AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::thawAll() {
+    if constexpr (Snapshots_T) {
+        if (this->myRoot && this->sharing()) {
+            this->myRoot = this->thawSubTree((AVLNode *) this->myRoot);
+            ((AVLNode *) this->myRoot)->setParent(nullptr);
+            this->smallestNode = BST<Data_T, Compare_T, Alloc_T>::smallest(this->myRoot);
+            this->largestNode = BST<Data_T, Compare_T, Alloc_T>::largest(this->myRoot);
+        }
+        this->borrowedBelow = 0;
+    }
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+typename AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::AVLNode *AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::thawSubTree(AVLNode *node) {
+    if (!node)
+        return nullptr;
+    if (this->frozen(node)) {
+        AVLNode *copy = this->cloneFrom(node);
+        this->retire(node, true);
+        return copy;
+    }
+    if ((node->left = this->thawSubTree((AVLNode *) node->left)))
+        ((AVLNode *) node->left)->setParent(node);
+    if ((node->right = this->thawSubTree((AVLNode *) node->right)))
+        ((AVLNode *) node->right)->setParent(node);
+    return node;
+}
+
+// Frees the nodes nothing else shares, retires the subtrees snapshots and copies share whole, and leaves borrowed
+// subtrees to their own tree
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+void AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::retireSubTree(typename BST<Data_T, Compare_T, Alloc_T>::BinNode *node) {
+    if (!node)
+        return;
+    if (this->frozen((AVLNode *) node)) {
+        this->retire((AVLNode *) node, true);
+        return;
+    }
+    this->retireSubTree(node->left);
+    this->retireSubTree(node->right);
+    this->destroyNode(node);
+}
+
+// Leaves what is still retired to the snapshots and copies, which free it as they go
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+void AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::detachSnapshots() {
+    if constexpr (Snapshots_T) {
+        if (this->snapshotState) {
+            this->snapshotState->detach();
+            this->snapshotState.reset();
+        }
+        this->borrowedBelow = 0;
+    }
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+typename AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::Snapshot::Iterator AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::Snapshot::begin() const {
+    Iterator it;
+    if (view)
+        it.descend(view->root);
+    return it;
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+template<typename DataSearch_T>
+typename AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::Snapshot::Iterator AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::Snapshot::find(const DataSearch_T &item) const {
+    Iterator it = this->lowerBound(item);
+    if (it.hasNext() && view->comp(item, it.get()))
+        it.path.clear();
+    return it;
+}
+
+// The path holds every node the descent passed on its left side, that is every node ordered after the bound
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+template<typename DataSearch_T>
+typename AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::Snapshot::Iterator AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::Snapshot::lowerBound(const DataSearch_T &item) const {
+    Iterator it;
+    for (AVLNode *node = view ? view->root : nullptr; node;) {
+        if (view->comp(node->getData(), item)) {
+            node = (AVLNode *) node->right;
+        } else {
+            it.path.push_back(node);
+            node = (AVLNode *) node->left;
+        }
+    }
+    return it;
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+template<typename DataSearch_T>
+typename AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::Snapshot::Iterator AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::Snapshot::upperBound(const DataSearch_T &item) const {
+    Iterator it;
+    for (AVLNode *node = view ? view->root : nullptr; node;) {
+        if (view->comp(item, node->getData())) {
+            it.path.push_back(node);
+            node = (AVLNode *) node->left;
+        } else {
+            node = (AVLNode *) node->right;
+        }
+    }
+    return it;
+}
+
+// Snapshot ids only grow, so the live ones are kept in order and the newest is the last
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+void AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::SnapshotState::open(uint64_t id) {
+    std::lock_guard<std::mutex> guard(lock);
+    live.push_back(id);
+    newest.store(id, std::memory_order_release);
+    if (pending)
+        this->collect(pending);
+}
+
+// Called by the copy, which only reads the tree: what is pending is left to the writer
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+uint64_t AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::SnapshotState::share() {
+    std::lock_guard<std::mutex> guard(lock);
+    uint64_t id = snapshotIds.fetch_add(1, std::memory_order_relaxed) + 1;
+    live.push_back(id);
+    newest.store(id, std::memory_order_release);
+    generation = id;
+    return id;
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+void AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::SnapshotState::close(uint64_t id) {
+    std::lock_guard<std::mutex> guard(lock);
+    for (auto it = live.begin(); it != live.end(); ++it) {
+        if (*it == id) {
+            live.erase(it);
+            break;
+        }
+    }
+    newest.store(live.empty() ? 0 : live.back(), std::memory_order_release);
+    if (concurrentAllocation || !attached)
+        this->collect(id);
+    else if (!pending || id < pending)
+        pending = id;
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+void AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::SnapshotState::retire(AVLNode *node, bool subtree, uint64_t borrowed) {
+    std::lock_guard<std::mutex> guard(lock);
+    retired.push_back({node, subtree ? 0 : node->generation, generation, borrowed, subtree});
+    if (pending)
+        this->collect(pending);
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+void AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::SnapshotState::detach() {
+    std::lock_guard<std::mutex> guard(lock);
+    attached = false;
+    this->collect(pending ? pending : UINT64_MAX);
+}
+
+// The nodes borrowed from the source go before the source's hold on them does
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::SnapshotState::~SnapshotState() {
+    for (Retired &entry : retired)
+        this->release(entry);
+    if (source)
+        source->close(sourceId);
+}
+
+// With the lock held: frees what no live snapshot or copy can reach any more. Everything retired before the oldest of
+// them goes first; past that, only entries no older than `since` (the oldest id closed since the last pass) can have
+// been let go of, so the rest is not looked at again.
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+void AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::SnapshotState::collect(uint64_t since) {
+    uint64_t oldest = live.empty() ? UINT64_MAX : live.front();
+    size_t freed = 0;
+    for (; freed < retired.size() && retired[freed].generation < oldest; ++freed)
+        this->release(retired[freed]);
+    retired.erase(retired.begin(), retired.begin() + freed);
+    auto kept = std::lower_bound(retired.begin(), retired.end(), since,
+                                 [](const Retired &entry, uint64_t id) { return entry.generation < id; });
+    for (auto it = kept; it != retired.end(); ++it) {
+        auto reaching = std::upper_bound(live.begin(), live.end(), it->born);
+        if (reaching == live.end() || *reaching > it->generation)
+            this->release(*it);
+        else
+            *kept++ = *it;
+    }
+    retired.erase(kept, retired.end());
+    pending = 0;
+}
+
+// A retired subtree is unrolled into a list by right rotations as it is freed, so no stack is needed. Its borrowed
+// parts (all of a borrowed node's subtree is borrowed) are cut off and left alone.
+template<typename Data_T, typename Compare_T, typename Alloc_T, bool OrderStatistics_T, typename Aggregate_T, bool Snapshots_T>
+void AVL<Data_T, Compare_T, Alloc_T, OrderStatistics_T, Aggregate_T, Snapshots_T>::SnapshotState::release(const Retired &entry) {
+    auto owned = [&entry](typename BST<Data_T, Compare_T, Alloc_T>::BinNode *node) {
+        return node && ((AVLNode *) node)->generation >= entry.borrowed ? (AVLNode *) node : nullptr;
+    };
+    for (AVLNode *node = entry.node, *next; node; node = next) {
+        if (entry.subtree && (next = owned(node->left))) {
+            node->left = next->right;
+            next->right = node;
+        } else {
+            next = entry.subtree ? owned(node->right) : nullptr;
+            std::allocator_traits<NodeAlloc_T>::destroy(alloc, node);
+            std::allocator_traits<NodeAlloc_T>::deallocate(alloc, node, 1);
+        }
+    }
+}
+
+#endif // AVL_TREE
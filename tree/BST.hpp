@@ -1,36 +1,80 @@
 #include <iostream>
 #include <functional>
-#include <queue>
+#include <memory>
 #include <stack>
+#include <type_traits>
+#include <utility>
 
 #ifndef BINARY_SEARCH_TREE
 #define BINARY_SEARCH_TREE
 
-template<typename Data_T>
-class BST {
+// Holds a tree's comparator. Stateless comparators such as std::less are kept as an empty base, so they add nothing
+// to the size of the tree, and every call to them is resolved (and inlined) at compile time.
+template<typename Compare_T, bool = std::is_empty<Compare_T>::value && !std::is_final<Compare_T>::value>
+class CompareHolder : private Compare_T {
+public:
+    CompareHolder(const Compare_T &comp) : Compare_T(comp) {}
+
+    const Compare_T &compare() const {
+        return *this;
+    }
+};
+
+template<typename Compare_T>
+class CompareHolder<Compare_T, false> {
+public:
+    CompareHolder(const Compare_T &comp) : comp(comp) {}
+
+    const Compare_T &compare() const {
+        return comp;
+    }
+
+private:
+    Compare_T comp;
+};
+
+template<typename Data_T, typename Compare_T = std::less<Data_T>, typename Alloc_T = std::allocator<Data_T>>
+class BST : protected CompareHolder<Compare_T> {
 public:
     /***** Function Members *****/
     BST() : BST(true) {}
 
-    BST(bool updateIfExists);
+    BST(bool updateIfExists, const Alloc_T &alloc = Alloc_T()) : BST(updateIfExists, Compare_T(), alloc) {}
+
+    BST(bool updateIfExists, const Compare_T &comp, const Alloc_T &alloc = Alloc_T());
 
 //    BST(const std::function<Data_T()> &default_initializer);
 
-    BST(const BST<Data_T> &copyFrom);
+    BST(const BST<Data_T, Compare_T, Alloc_T> &copyFrom);
 
-    BST(const BST<Data_T> *copyFrom);
+    BST(const BST<Data_T, Compare_T, Alloc_T> *copyFrom);
+
+    // Takes over the nodes of `moveFrom` in O(1), leaving it empty
+    BST(BST<Data_T, Compare_T, Alloc_T> &&moveFrom) noexcept;
+
+    virtual ~BST() {
+        this->clear();
+    }
 
     bool empty() const;
 
-    Data_T *search(const Data_T &item) const;
+    Alloc_T get_allocator() const {
+        return this->alloc;
+    }
+
+    Compare_T value_comp() const {
+        return this->compare();
+    }
 
+    // Lookups accept anything the comparator can order against Data_T (heterogeneous lookup)
     template<typename DataSearch_T>
-    Data_T *
-    search(const DataSearch_T &item, const std::function<short int(const DataSearch_T &, Data_T &)> &comp) const;
+    Data_T *search(const DataSearch_T &item) const;
 
     void insert(const Data_T &item);
 
-    int nodeCount() const;
+    void insert(Data_T &&item);
+
+    size_t nodeCount() const;
 
     void preOrder() const;
 
@@ -38,13 +82,11 @@ public:
 
     void postOrder() const;
 
-    void deleteNode(const Data_T &value);
+    template<typename DataSearch_T>
+    void deleteNode(const DataSearch_T &item);
 
     void clear();
 
-    template<typename DataSearch_T>
-    void deleteNode(const DataSearch_T &item, const std::function<short int(const DataSearch_T &, Data_T &)> &comp);
-
     /***** Others *****/
     typedef enum {
         PRE_ORDER, IN_ORDER, POST_ORDER
@@ -53,18 +95,34 @@ public:
         LEAF_NODE, ONE_CHILD, TWO_CHILDREN
     } delete_mode;
 
-    BST<Data_T> &operator=(const BST<Data_T> &tree) {
+    BST<Data_T, Compare_T, Alloc_T> &operator=(const BST<Data_T, Compare_T, Alloc_T> &tree) {
         this->clear();
         this->updateIfExists = tree.updateIfExists;
+        CompareHolder<Compare_T>::operator=(tree);
         cloneFrom(&tree);
         return *this;
     }
 
-    bool operator==(const BST<Data_T> &tree) {
-        if (!tree.myRoot) return !this->myRoot;
-        if (!this->myRoot) return false;
+    // Steals the nodes when the allocator propagates or compares equal, otherwise has to copy them one by one
+    BST<Data_T, Compare_T, Alloc_T> &operator=(BST<Data_T, Compare_T, Alloc_T> &&tree) {
+        if (this == &tree) return *this;
+        this->clear();
+        this->updateIfExists = tree.updateIfExists;
+        CompareHolder<Compare_T>::operator=(tree);
+        if (std::allocator_traits<Alloc_T>::propagate_on_container_move_assignment::value || this->alloc == tree.alloc) {
+            if (std::allocator_traits<Alloc_T>::propagate_on_container_move_assignment::value)
+                this->alloc = tree.alloc;
+            this->takeNodes(tree);
+        } else {
+            cloneFrom(&tree);
+            tree.clear();
+        }
+        return *this;
+    }
+
+    bool operator==(const BST<Data_T, Compare_T, Alloc_T> &tree) {
         if (this->nodeCount() != tree.nodeCount()) return false;
-        if (this->nodeCount() == tree.nodeCount() && this->empty()) return true;
+        if (this->empty()) return true;
 
         Iterator it1(this->begin()), it2(tree.begin());
         while (it1.hasNext() && it2.hasNext()) {
@@ -73,20 +131,11 @@ public:
         return !it1.hasNext() && !it2.hasNext();
     }
 
-    bool operator!=(const BST<Data_T> &tree) {
-        if (!tree.myRoot) return !!this->myRoot;
-        if (this->myRoot) return false;
-        if (this->nodeCount() != tree.nodeCount()) return true;
-        if (this->nodeCount() == tree.nodeCount() && this->empty()) return false;
-
-        Iterator it1(this->begin()), it2(tree.begin());
-        while (it1.hasNext() && it2.hasNext()) {
-            if (it1.next() == it2.next()) return false;
-        }
-        return it1.hasNext() || it2.hasNext();
+    bool operator!=(const BST<Data_T, Compare_T, Alloc_T> &tree) {
+        return !(*this == tree);
     }
 
-//    bool operator<(const BST<Data_T> &tree) {
+//    bool operator<(const BST<Data_T, Compare_T, Alloc_T> &tree) {
 //        Iterator it1(this->begin()), it2(tree.begin());
 //        while (it1.hasNext() && it2.hasNext()) {
 //            if (!(it1.next().dataLt(it2.next()))) return false;
@@ -97,57 +146,81 @@ public:
 protected:
     bool updateIfExists;
     std::function<Data_T()> default_init;
+    Alloc_T alloc;
 
     /***** Node class *****/
+    // Nodes are plain (non-polymorphic) structs: anything node-type specific, such as allocating, copying or
+    // freeing them, goes through the virtual members of the tree that owns them.
     class BinNode {
-    protected:
-        Data_T data;
-
-        virtual void cloneFrom(const BinNode *tree);
-
     public:
         BinNode *left;
         BinNode *right;
 
+    protected:
+        Data_T data;
+
+    public:
         // Explicit Value -- data part contains item; both links are null.
         BinNode(const Data_T &item)
-                : data(item), left(nullptr), right(nullptr) {}
+                : left(nullptr), right(nullptr), data(item) {}
 
-        BinNode(const BinNode &node) : data(node.data), left(nullptr), right(nullptr) {}
+        BinNode(const BinNode &node) : left(nullptr), right(nullptr), data(node.data) {}
 
-        virtual ~BinNode() {
-//            delete this->data;
-        }
+        // Builds the data in place from any of Data_T's constructor arguments
+        template<typename... Args>
+        BinNode(std::in_place_t, Args &&...args)
+                : left(nullptr), right(nullptr), data(std::forward<Args>(args)...) {}
 
-        virtual void print();
+        void print();
 
         Data_T &getData() {
             return this->data;
         }
 
-//        bool operator==(const typename BST<Data_T>::BinNode &other) {
+//        bool operator==(const typename BST<Data_T, Compare_T, Alloc_T>::BinNode &other) {
 //            if (!(this->getData() == other.getData())) return false;
 //            if ()
 //        }
 
-        static void deleteSubTree(BinNode *&node);
-
 //        static void subTreeEquals(const BinNode *&node1, const BinNode *&node2);
 
     };// end of class BinNode declaration
 
     /***** Data Members *****/
     BinNode *myRoot = nullptr, *smallestNode = nullptr, *largestNode = nullptr;
+    size_t nodes = 0;
 
     /***** Protected Function Members *****/
-    BinNode *searchNode(BinNode *startNode, const Data_T &data, BinNode *&parentNode) const;
-
-    BinNode *searchNode(const BinNode *startNode, const Data_T &data, BinNode *&parentNode) const;
+    template<typename DataSearch_T>
+    BinNode *searchNode(BinNode *startNode, const DataSearch_T &data, BinNode *&parentNode) const;
 
     template<typename DataSearch_T>
-    BinNode *searchNode(BinNode *startNode, const DataSearch_T &data,
-                        const std::function<short int(const DataSearch_T &, Data_T &)> &comp,
-                        BinNode *&parentNode) const;
+    BinNode *searchNode(BinNode *startNode, const DataSearch_T &data, BinNode *&parentNode, bool &asLeftChild) const;
+
+    // Looks up `count` items at once, interleaving their descents: every round moves each of up to SEARCH_LANES
+    // searches down one level and prefetches the node it will compare against next, so the cache misses of
+    // independent searches overlap instead of following one another. `found(i, node)` is called for each item with
+    // its node (null if absent), in no particular order.
+    static constexpr size_t SEARCH_LANES = 16;
+
+    template<typename Iter_T, typename Found_T>
+    void searchNodes(Iter_T items, size_t count, Found_T found) const;
+
+    static void prefetch(const void *address) {
+#if defined(__GNUC__) || defined(__clang__)
+        __builtin_prefetch(address);
+#endif
+    }
+
+    // Points `link` (a child link or myRoot) at `node`. ConcurrentMap walks the links without its lock while a writer
+    // changes them, so stores to the links of a live tree are atomic, and release the node they point at.
+    static void setLink(BinNode *&link, BinNode *node) {
+        __atomic_store_n(&link, node, __ATOMIC_RELEASE);
+    }
+
+    BinNode *insertNode(BinNode *parentNode, bool asLeftChild, BinNode *node);
+
+    void takeNodes(BST<Data_T, Compare_T, Alloc_T> &tree);
 
     virtual void postInsert(const BinNode *node, const BinNode *parentNode);
 
@@ -155,8 +228,14 @@ protected:
 
     virtual BinNode *initNode(const Data_T &data);
 
+    virtual BinNode *initNode(Data_T &&data);
+
     virtual BinNode *initNode(const BinNode &data);
 
+    virtual void destroyNode(BinNode *node);
+
+    virtual void deleteSubTree(BinNode *&node);
+
     static BinNode *smallest(BinNode *rootNode, BinNode *&parentNode, int &status);
 
     static BinNode *largest(BinNode *rootNode, BinNode *&parentNode, int &status);
@@ -165,26 +244,24 @@ protected:
 
     static BinNode *largest(BinNode *rootNode);
 
-    virtual void cloneFrom(const BST<Data_T> *tree);
+    virtual void cloneFrom(const BST<Data_T, Compare_T, Alloc_T> *tree);
 
     virtual BinNode *cloneFrom(const BinNode *node);
 
+    virtual void deleteNode(BinNode *node, BinNode *parentNode, delete_mode mode);
+
 private:
     /***** Private Function Members *****/
-    int nodeCount(BinNode *node) const;
-
     void traverse(BinNode *node, traversal_order order) const;
 
-    void deleteNode(BinNode *node, BinNode *parentNode, delete_mode mode);
-
 public:
     /****** Iterators ******/
     class Iterator {
     protected:
-        std::stack<BST<Data_T>::BinNode *> st, rev_st;
-        const BST<Data_T> *tree;
+        std::stack<BST<Data_T, Compare_T, Alloc_T>::BinNode *> st, rev_st;
+        const BST<Data_T, Compare_T, Alloc_T> *tree;
 
-        void init(BST<Data_T>::BinNode *node) {
+        void init(BST<Data_T, Compare_T, Alloc_T>::BinNode *node) {
             while (node) {
                 st.push(node);
                 node = node->left;
@@ -192,7 +269,7 @@ public:
         }
 
     public:
-        Iterator(BST<Data_T>::BinNode *node, const BST<Data_T> *tree) : tree(tree) {
+        Iterator(BST<Data_T, Compare_T, Alloc_T>::BinNode *node, const BST<Data_T, Compare_T, Alloc_T> *tree) : tree(tree) {
             st.push(nullptr);
             if (node) init(tree->myRoot);
 //            std::cout << "Iterator Got root: " << tree->myRoot->getData().first << std::endl;
@@ -215,7 +292,7 @@ public:
 
         virtual Data_T &next() {
             if (!hasNext()) throw std::out_of_range("Tree Iterator reached end, cannot get next");
-            BST<Data_T>::BinNode *popped = st.top();
+            BST<Data_T, Compare_T, Alloc_T>::BinNode *popped = st.top();
             st.pop();
             if (popped->right) {
                 rev_st.push(popped);
@@ -243,56 +320,75 @@ public:
         }
     };
 
-    friend BST<Data_T>::Iterator;
+    friend BST<Data_T, Compare_T, Alloc_T>::Iterator;
 
-    virtual BST<Data_T>::Iterator begin() const {
-        return BST<Data_T>::Iterator(smallestNode, this);
+    BST<Data_T, Compare_T, Alloc_T>::Iterator begin() const {
+        return BST<Data_T, Compare_T, Alloc_T>::Iterator(smallestNode, this);
     }
 
-    virtual BST<Data_T>::Iterator begin(const Data_T &data) const {
+    BST<Data_T, Compare_T, Alloc_T>::Iterator begin(const Data_T &data) const {
         BinNode *parent = nullptr, *node = this->searchNode(myRoot, data, parent);
         if (!node) throw std::out_of_range("could not instantiate Iterator, data not found in tree");
-        return BST<Data_T>::Iterator(node, this);
+        return BST<Data_T, Compare_T, Alloc_T>::Iterator(node, this);
     }
 
-    virtual BST<Data_T>::Iterator end() const {
-        return BST<Data_T>::Iterator(nullptr, this);
+    BST<Data_T, Compare_T, Alloc_T>::Iterator end() const {
+        return BST<Data_T, Compare_T, Alloc_T>::Iterator(nullptr, this);
     }
 
 }; // end of class declaration
 
-#endif
-
 
 //--- Definition of constructors
-template<typename Data_T>
-BST<Data_T>::BST(bool updateIfExists)
-        : updateIfExists(updateIfExists), myRoot(0) {}
+template<typename Data_T, typename Compare_T, typename Alloc_T>
+BST<Data_T, Compare_T, Alloc_T>::BST(bool updateIfExists, const Compare_T &comp, const Alloc_T &alloc)
+        : CompareHolder<Compare_T>(comp), updateIfExists(updateIfExists), alloc(alloc), myRoot(0) {}
 
 //template<typename Data_T>
-//BST<Data_T>::BST(const std::function<Data_T()> &default_init)
-//        : BST<Data_T>(true), default_init(default_init) {}
+//BST<Data_T, Compare_T, Alloc_T>::BST(const std::function<Data_T()> &default_init)
+//        : BST<Data_T, Compare_T, Alloc_T>(true), default_init(default_init) {}
 
-template<typename Data_T>
-BST<Data_T>::BST(const BST<Data_T> &copyFrom): updateIfExists(copyFrom.updateIfExists) {
+template<typename Data_T, typename Compare_T, typename Alloc_T>
+BST<Data_T, Compare_T, Alloc_T>::BST(const BST<Data_T, Compare_T, Alloc_T> &copyFrom)
+        : CompareHolder<Compare_T>(copyFrom), updateIfExists(copyFrom.updateIfExists),
+          alloc(std::allocator_traits<Alloc_T>::select_on_container_copy_construction(copyFrom.alloc)) {
     cloneFrom(&copyFrom);
 }
 
-template<typename Data_T>
-BST<Data_T>::BST(const BST<Data_T> *copyFrom): updateIfExists(copyFrom->updateIfExists) {
+template<typename Data_T, typename Compare_T, typename Alloc_T>
+BST<Data_T, Compare_T, Alloc_T>::BST(const BST<Data_T, Compare_T, Alloc_T> *copyFrom)
+        : CompareHolder<Compare_T>(*copyFrom), updateIfExists(copyFrom->updateIfExists),
+          alloc(std::allocator_traits<Alloc_T>::select_on_container_copy_construction(copyFrom->alloc)) {
     cloneFrom(copyFrom);
 }
 
-template<typename Data_T>
-void BST<Data_T>::cloneFrom(const BST<Data_T> *tree) {
+template<typename Data_T, typename Compare_T, typename Alloc_T>
+BST<Data_T, Compare_T, Alloc_T>::BST(BST<Data_T, Compare_T, Alloc_T> &&moveFrom) noexcept
+        : CompareHolder<Compare_T>(moveFrom), updateIfExists(moveFrom.updateIfExists), alloc(moveFrom.alloc) {
+    this->takeNodes(moveFrom);
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T>
+void BST<Data_T, Compare_T, Alloc_T>::takeNodes(BST<Data_T, Compare_T, Alloc_T> &tree) {
+    this->myRoot = tree.myRoot;
+    this->smallestNode = tree.smallestNode;
+    this->largestNode = tree.largestNode;
+    this->nodes = tree.nodes;
+    tree.myRoot = tree.smallestNode = tree.largestNode = nullptr;
+    tree.nodes = 0;
+}
+
+template<typename Data_T, typename Compare_T, typename Alloc_T>
+void BST<Data_T, Compare_T, Alloc_T>::cloneFrom(const BST<Data_T, Compare_T, Alloc_T> *tree) {
     this->clear();
     this->myRoot = cloneFrom(tree->myRoot);
+    this->nodes = tree->nodes;
     this->smallestNode = this->smallest(myRoot);
     this->largestNode = this->largest(myRoot);
 }
 
-template<typename Data_T>
-typename BST<Data_T>::BinNode *BST<Data_T>::cloneFrom(const BinNode *node) {
+template<typename Data_T, typename Compare_T, typename Alloc_T>
+typename BST<Data_T, Compare_T, Alloc_T>::BinNode *BST<Data_T, Compare_T, Alloc_T>::cloneFrom(const BinNode *node) {
     if (!node) return nullptr;
     BinNode *retNode = initNode(*node);
     retNode->left = cloneFrom(node->left);
@@ -300,126 +396,97 @@ typename BST<Data_T>::BinNode *BST<Data_T>::cloneFrom(const BinNode *node) {
     return retNode;
 }
 
-template<typename Data_T>
-bool BST<Data_T>::empty() const { return !myRoot; }
-
-template<typename Data_T>
-/*public*/ Data_T *BST<Data_T>::search(const Data_T &item) const {
-    BinNode *locptr = myRoot;
-    while (locptr) {
-        if (item < locptr->getData())       // descend left
-            locptr = locptr->left;
-        else if (locptr->getData() < item)  // descend right
-            locptr = locptr->right;
-        else // if (locptr->getData() == item) // item found
-            return &(locptr->getData());
-    }
-    return nullptr;
-}
+template<typename Data_T, typename Compare_T, typename Alloc_T>
+bool BST<Data_T, Compare_T, Alloc_T>::empty() const { return !myRoot; }
 
-template<typename Data_T>
+template<typename Data_T, typename Compare_T, typename Alloc_T>
 template<typename DataSearch_T>
-/*public*/ Data_T *
-BST<Data_T>::search(const DataSearch_T &searchItem,
-                    const std::function<short int(const DataSearch_T &, Data_T &)> &comp) const {
-    BinNode *locptr = myRoot;
-    short int comp_val = 0;
-    while (locptr) {
-        comp_val = comp(searchItem, locptr->getData());
-        if (comp_val < 0)       // descend left
-            locptr = locptr->left;
-        else if (comp_val > 0)  // descend right
-            locptr = locptr->right;
-        else // if (comp_val == 0) // item found
-            return &(locptr->getData());
-    }
-    return nullptr;
+/*public*/ Data_T *BST<Data_T, Compare_T, Alloc_T>::search(const DataSearch_T &item) const {
+    BinNode *parent, *locptr = this->searchNode(myRoot, item, parent);
+    return locptr ? &(locptr->getData()) : nullptr;
 }
 
-template<typename Data_T>
-void BST<Data_T>::insert(const Data_T &item) {
+template<typename Data_T, typename Compare_T, typename Alloc_T>
+void BST<Data_T, Compare_T, Alloc_T>::insert(const Data_T &item) {
     BinNode *parent;        // pointer to parent of current node
-    BinNode *locptr = this->searchNode(myRoot, item, parent);   // search pointer
-
-    if (!locptr) {                       // construct node containing item
-        locptr = this->initNode(item);
-        if (!smallestNode) {
-            smallestNode = locptr;
-            largestNode = locptr;
-        } else {
-            if (locptr->getData() < smallestNode->getData())
-                smallestNode = locptr;
-            if (largestNode->getData() < locptr->getData())
-                largestNode = locptr;
-        }
+    bool asLeftChild;
+    BinNode *locptr = this->searchNode(myRoot, item, parent, asLeftChild);   // search pointer
 
-        if (!parent) {             // empty tree
-            myRoot = locptr;
-            this->postInsert(myRoot, nullptr);
-        } else if (item < parent->getData()) { // insert to left of parent
-            parent->left = locptr;
-            this->postInsert(parent->left, parent);
-        } else {                          // insert to right of parent
-            parent->right = locptr;
-            this->postInsert(parent->right, parent);
-        }
-    }
+    if (!locptr)                       // construct node containing item
+        this->insertNode(parent, asLeftChild, this->initNode(item));
 //    else if (this->updateIfExists)// Item exists in tree, and updateIfExists set to true
 //        locptr->getData() = item;
 }
 
+template<typename Data_T, typename Compare_T, typename Alloc_T>
+void BST<Data_T, Compare_T, Alloc_T>::insert(Data_T &&item) {
+    BinNode *parent;
+    bool asLeftChild;
+    if (!this->searchNode(myRoot, item, parent, asLeftChild))
+        this->insertNode(parent, asLeftChild, this->initNode(std::move(item)));
+}
+
+// Links a freshly built `node` below `parentNode` (a null parent means the tree is empty), on the side a previous
+// search ended on, so callers that already descended do not search again
+template<typename Data_T, typename Compare_T, typename Alloc_T>
+typename BST<Data_T, Compare_T, Alloc_T>::BinNode *BST<Data_T, Compare_T, Alloc_T>::insertNode(BinNode *parentNode, bool asLeftChild, BinNode *node) {
+    ++this->nodes;
+    if (!parentNode) {             // empty tree
+        smallestNode = largestNode = node;
+        setLink(myRoot, node);
+    } else if (asLeftChild) {      // insert to left of parent
+        setLink(parentNode->left, node);
+        if (parentNode == smallestNode)
+            smallestNode = node;
+    } else {                       // insert to right of parent
+        setLink(parentNode->right, node);
+        if (parentNode == largestNode)
+            largestNode = node;
+    }
+    this->postInsert(node, parentNode);
+    return node;
+}
+
 // Public methods to be called from user program
-template<typename Data_T>
-int BST<Data_T>::nodeCount() const {
-    return this->nodeCount(this->myRoot);
+template<typename Data_T, typename Compare_T, typename Alloc_T>
+size_t BST<Data_T, Compare_T, Alloc_T>::nodeCount() const {
+    return this->nodes;
 }
 
-template<typename Data_T>
-void BST<Data_T>::preOrder() const {
+template<typename Data_T, typename Compare_T, typename Alloc_T>
+void BST<Data_T, Compare_T, Alloc_T>::preOrder() const {
 //    cout << "PreOrder Traversal:" << endl;
     this->traverse(this->myRoot, PRE_ORDER);
 }
 
-template<typename Data_T>
-void BST<Data_T>::inOrder() const {
+template<typename Data_T, typename Compare_T, typename Alloc_T>
+void BST<Data_T, Compare_T, Alloc_T>::inOrder() const {
 //    cout << "InOrder Traversal:" << endl;
     this->traverse(this->myRoot, IN_ORDER);
 }
 
-template<typename Data_T>
-void BST<Data_T>::postOrder() const {
+template<typename Data_T, typename Compare_T, typename Alloc_T>
+void BST<Data_T, Compare_T, Alloc_T>::postOrder() const {
 //    cout << "PostOrder Traversal:" << endl;
     this->traverse(this->myRoot, POST_ORDER);
 }
 
-template<typename Data_T>
-void BST<Data_T>::deleteNode(const Data_T &value) {
-    BinNode *searchNode, *parentNode;
-    parentNode = nullptr;
-    delete_mode mode = LEAF_NODE;
-    searchNode = this->searchNode(this->myRoot, value, parentNode);
-    if (searchNode->left && searchNode->right)
-        mode = TWO_CHILDREN;
-    else if (searchNode->left || searchNode->right)
-        mode = ONE_CHILD;
-    this->deleteNode(searchNode, parentNode, mode);
+template<typename Data_T, typename Compare_T, typename Alloc_T>
+void BST<Data_T, Compare_T, Alloc_T>::clear() {
+    this->deleteSubTree(this->myRoot);
+    this->smallestNode = this->largestNode = nullptr;
+    this->nodes = 0;
 }
 
-template<typename Data_T>
-void BST<Data_T>::clear() {
-    BinNode::deleteSubTree(this->myRoot);
-}
-
-template<typename Data_T>
+template<typename Data_T, typename Compare_T, typename Alloc_T>
 template<typename DataSearch_T>
-void BST<Data_T>::deleteNode(
-        const DataSearch_T &item,
-        const std::function<short int(const DataSearch_T &, Data_T &)> &comp
-) {
+void BST<Data_T, Compare_T, Alloc_T>::deleteNode(const DataSearch_T &item) {
     BinNode *searchNode, *parentNode;
     parentNode = nullptr;
     delete_mode mode = LEAF_NODE;
-    searchNode = this->searchNode(this->myRoot, item, comp, parentNode);
+    searchNode = this->searchNode(this->myRoot, item, parentNode);
+    if (!searchNode)
+        throw std::out_of_range("specified item does not exist in tree");
     if (searchNode->left && searchNode->right)
         mode = TWO_CHILDREN;
     else if (searchNode->left || searchNode->right)
@@ -429,78 +496,79 @@ void BST<Data_T>::deleteNode(
 
 
 // Private methods
-template<typename Data_T>
-int BST<Data_T>::nodeCount(BST<Data_T>::BinNode *node) const {
-    if (!node)
-        return 0;
-    return 1 + this->nodeCount(node->left) + this->nodeCount(node->right);
-}
-
-template<typename Data_T>
-typename BST<Data_T>::BinNode *
-BST<Data_T>::searchNode(BST<Data_T>::BinNode *startNode, const Data_T &data, BST<Data_T>::BinNode *&parentNode) const {
-    parentNode = nullptr;
-    while (startNode) {
-        if (startNode->getData() == data)
-            return startNode;
-        else if (data < startNode->getData()) {
-            parentNode = startNode;
-            startNode = startNode->left;
-        } else {
-            parentNode = startNode;
-            startNode = startNode->right;
-        }
-    }
-    return nullptr;
+template<typename Data_T, typename Compare_T, typename Alloc_T>
+template<typename DataSearch_T>
+typename BST<Data_T, Compare_T, Alloc_T>::BinNode *BST<Data_T, Compare_T, Alloc_T>::searchNode(
+        BinNode *startNode, const DataSearch_T &searchData, BinNode *&parentNode
+) const {
+    bool asLeftChild;
+    return this->searchNode(startNode, searchData, parentNode, asLeftChild);
 }
 
-template<typename Data_T>
-typename BST<Data_T>::BinNode *
-BST<Data_T>::searchNode(const BST<Data_T>::BinNode *searchFrom, const Data_T &data,
-                        BST<Data_T>::BinNode *&parentNode) const {
-//    if (startNode == NULL || startNode == 0) return nullptr;
-    BinNode *startNode = searchFrom;
-    parentNode = nullptr;
-    while (startNode) {
-        if (startNode->getData() == data)
-            return startNode;
-        else if (data < startNode->getData()) {
-            parentNode = startNode;
-            startNode = startNode->left;
-        } else {
-            parentNode = startNode;
-            startNode = startNode->right;
+// A lane whose search is over (hit or miss) takes the next item at the root, or, once the items run out, the last
+// lane's search, so the lanes in use stay packed at the front
+template<typename Data_T, typename Compare_T, typename Alloc_T>
+template<typename Iter_T, typename Found_T>
+void BST<Data_T, Compare_T, Alloc_T>::searchNodes(Iter_T items, size_t count, Found_T found) const {
+    struct Lane {
+        size_t index;
+        BinNode *node;
+    } lanes[SEARCH_LANES];
+    const Compare_T &comp = this->compare();
+    size_t active = 0, next = 0;
+    for (; active < SEARCH_LANES && next < count; ++active, ++next)
+        lanes[active] = {next, this->myRoot};
+    while (active) {
+        for (size_t lane = 0; lane < active;) {
+            Lane &search = lanes[lane];
+            BinNode *node = search.node;
+            if (node && comp(node->getData(), items[search.index])) {
+                node = node->right;
+            } else if (node && comp(items[search.index], node->getData())) {
+                node = node->left;
+            } else {
+                found(search.index, node);
+                if (next < count) {
+                    search = {next++, this->myRoot};
+                    ++lane;
+                } else {
+                    search = lanes[--active];
+                }
+                continue;
+            }
+            if (node)
+                prefetch(node);
+            search.node = node;
+            ++lane;
         }
     }
-    return nullptr;
 }
 
-template<typename Data_T>
+// Descends with the tree's comparator only (no equality operator needed on Data_T). On a hit `parentNode` is the
+// match's parent; on a miss it is the node `searchData` would be linked under, on the side given by `asLeftChild`.
+template<typename Data_T, typename Compare_T, typename Alloc_T>
 template<typename DataSearch_T>
-typename BST<Data_T>::BinNode *BST<Data_T>::searchNode(
-        BinNode *startNode, const DataSearch_T &searchData,
-        const std::function<short int(const DataSearch_T &, Data_T &)> &comp,
-        BinNode *&parentNode
+typename BST<Data_T, Compare_T, Alloc_T>::BinNode *BST<Data_T, Compare_T, Alloc_T>::searchNode(
+        BinNode *startNode, const DataSearch_T &searchData, BinNode *&parentNode, bool &asLeftChild
 ) const {
+    const Compare_T &comp = this->compare();
     parentNode = nullptr;
-    short int comp_val = 0;
+    asLeftChild = false;
     while (startNode) {
-        comp_val = comp(searchData, startNode->getData());
-        if (comp_val == 0)
+        if (comp(startNode->getData(), searchData))
+            asLeftChild = false;
+        else if (comp(searchData, startNode->getData()))
+            asLeftChild = true;
+        else
             return startNode;
-        else if (comp_val < 0) {
-            parentNode = startNode;
-            startNode = startNode->left;
-        } else {
-            parentNode = startNode;
-            startNode = startNode->right;
-        }
+        parentNode = startNode;
+        startNode = asLeftChild ? startNode->left : startNode->right;
     }
     return nullptr;
 }
 
-template<typename Data_T>
-void BST<Data_T>::traverse(BST<Data_T>::BinNode *node, traversal_order order) const {
+template<typename Data_T, typename Compare_T, typename Alloc_T>
+void BST<Data_T, Compare_T, Alloc_T>::traverse(BST<Data_T, Compare_T, Alloc_T>::BinNode *node, traversal_order order) const {
     if (!node)
         return;
     BinNode *left = node->left;
@@ -524,9 +592,9 @@ void BST<Data_T>::traverse(BST<Data_T>::BinNode *node, traversal_order order) co
     }
 }
 
-template<typename Data_T>
+template<typename Data_T, typename Compare_T, typename Alloc_T>
 void
-BST<Data_T>::deleteNode(BST<Data_T>::BinNode *node, BST<Data_T>::BinNode *parentNode, BST<Data_T>::delete_mode mode) {
+BST<Data_T, Compare_T, Alloc_T>::deleteNode(BST<Data_T, Compare_T, Alloc_T>::BinNode *node, BST<Data_T, Compare_T, Alloc_T>::BinNode *parentNode, BST<Data_T, Compare_T, Alloc_T>::delete_mode mode) {
     bool isRoot = (node == this->myRoot);
     Data_T &data = node->getData();
 //    if (isRoot)
@@ -537,14 +605,14 @@ BST<Data_T>::deleteNode(BST<Data_T>::BinNode *node, BST<Data_T>::BinNode *parent
         case LEAF_NODE: {
 //            cout << "Deleting Leaf Node " << node->getData() << endl;
             if (isRoot)
-                this->myRoot = nullptr;
+                setLink(this->myRoot, nullptr);
             else {
                 if (parentNode->left == node) {
 //                    cout << "Deleting left child of parent: " << parentNode->getData() << endl;
-                    parentNode->left = nullptr;
+                    setLink(parentNode->left, nullptr);
                 } else if (parentNode->right == node) {
 //                    cout << "Deleting right child of parent: " << parentNode->getData() << endl;
-                    parentNode->right = nullptr;
+                    setLink(parentNode->right, nullptr);
                 }
             }
             break;
@@ -552,12 +620,12 @@ BST<Data_T>::deleteNode(BST<Data_T>::BinNode *node, BST<Data_T>::BinNode *parent
         case ONE_CHILD: {
             BinNode *child = node->left ? node->left : node->right;
             if (isRoot)
-                this->myRoot = child;
+                setLink(this->myRoot, child);
             else {
                 if (parentNode->left == node)
-                    parentNode->left = child;
+                    setLink(parentNode->left, child);
                 else if (parentNode->right == node)
-                    parentNode->right = child;
+                    setLink(parentNode->right, child);
             }
             break;
         }
@@ -566,19 +634,19 @@ BST<Data_T>::deleteNode(BST<Data_T>::BinNode *node, BST<Data_T>::BinNode *parent
             BinNode *parentOfSmallestNode, *smallestNode;
             smallestNode = smallest(node->right, parentOfSmallestNode, status);
             if (parentOfSmallestNode && (status == 1))
-                parentOfSmallestNode->left = smallestNode->right;
+                setLink(parentOfSmallestNode->left, smallestNode->right);
             else
-                node->right = smallestNode->right;
-            smallestNode->left = node->left;
-            smallestNode->right = node->right;
+                setLink(node->right, smallestNode->right);
+            setLink(smallestNode->left, node->left);
+            setLink(smallestNode->right, node->right);
 
             if (isRoot) {
-                this->myRoot = smallestNode;
+                setLink(this->myRoot, smallestNode);
             } else {
                 if (parentNode->left == node)
-                    parentNode->left = smallestNode;
+                    setLink(parentNode->left, smallestNode);
                 else if (parentNode->right == node)
-                    parentNode->right = smallestNode;
+                    setLink(parentNode->right, smallestNode);
             }
             break;
         }
@@ -587,12 +655,13 @@ BST<Data_T>::deleteNode(BST<Data_T>::BinNode *node, BST<Data_T>::BinNode *parent
         this->smallestNode = this->smallest(myRoot);
     if (node == this->largestNode)
         this->largestNode = this->largest(myRoot);
-    delete node;
+    --this->nodes;
     this->postDelete(data, parentNode);
+    this->destroyNode(node);
 }
 
-template<typename Data_T>
-typename BST<Data_T>::BinNode *BST<Data_T>::smallest(BinNode *rootNode, BinNode *&parentNode, int &status) {
+template<typename Data_T, typename Compare_T, typename Alloc_T>
+typename BST<Data_T, Compare_T, Alloc_T>::BinNode *BST<Data_T, Compare_T, Alloc_T>::smallest(BinNode *rootNode, BinNode *&parentNode, int &status) {
     while (rootNode && rootNode->left) {
         parentNode = rootNode;
         rootNode = rootNode->left;
@@ -601,8 +670,8 @@ typename BST<Data_T>::BinNode *BST<Data_T>::smallest(BinNode *rootNode, BinNode
     return rootNode;
 }
 
-template<typename Data_T>
-typename BST<Data_T>::BinNode *BST<Data_T>::largest(BinNode *rootNode, BinNode *&parentNode, int &status) {
+template<typename Data_T, typename Compare_T, typename Alloc_T>
+typename BST<Data_T, Compare_T, Alloc_T>::BinNode *BST<Data_T, Compare_T, Alloc_T>::largest(BinNode *rootNode, BinNode *&parentNode, int &status) {
     while (rootNode && rootNode->right) {
         parentNode = rootNode;
         rootNode = rootNode->right;
@@ -611,71 +680,88 @@ typename BST<Data_T>::BinNode *BST<Data_T>::largest(BinNode *rootNode, BinNode *
     return rootNode;
 }
 
-template<typename Data_T>
-typename BST<Data_T>::BinNode *BST<Data_T>::smallest(BinNode *rootNode) {
+template<typename Data_T, typename Compare_T, typename Alloc_T>
+typename BST<Data_T, Compare_T, Alloc_T>::BinNode *BST<Data_T, Compare_T, Alloc_T>::smallest(BinNode *rootNode) {
     while (rootNode && rootNode->left)
         rootNode = rootNode->left;
     return rootNode;
 }
 
-template<typename Data_T>
-typename BST<Data_T>::BinNode *BST<Data_T>::largest(BinNode *rootNode) {
+template<typename Data_T, typename Compare_T, typename Alloc_T>
+typename BST<Data_T, Compare_T, Alloc_T>::BinNode *BST<Data_T, Compare_T, Alloc_T>::largest(BinNode *rootNode) {
     while (rootNode && rootNode->right)
         rootNode = rootNode->right;
     return rootNode;
 }
 
-template<typename Data_T>
-void BST<Data_T>::postInsert(const BST<Data_T>::BinNode *node, const BST<Data_T>::BinNode *parentNode) {}
+template<typename Data_T, typename Compare_T, typename Alloc_T>
+void BST<Data_T, Compare_T, Alloc_T>::postInsert(const BST<Data_T, Compare_T, Alloc_T>::BinNode *node, const BST<Data_T, Compare_T, Alloc_T>::BinNode *parentNode) {}
 
-template<typename Data_T>
-void BST<Data_T>::postDelete(const Data_T &data, const BST<Data_T>::BinNode *parentNode) {}
+template<typename Data_T, typename Compare_T, typename Alloc_T>
+void BST<Data_T, Compare_T, Alloc_T>::postDelete(const Data_T &data, const BST<Data_T, Compare_T, Alloc_T>::BinNode *parentNode) {}
 
-template<typename Data_T>
-typename BST<Data_T>::BinNode *BST<Data_T>::initNode(const Data_T &data) {
-    return new BinNode(data);
+template<typename Data_T, typename Compare_T, typename Alloc_T>
+typename BST<Data_T, Compare_T, Alloc_T>::BinNode *BST<Data_T, Compare_T, Alloc_T>::initNode(const Data_T &data) {
+    typename std::allocator_traits<Alloc_T>::template rebind_alloc<BinNode> nodeAlloc(this->alloc);
+    BinNode *node = std::allocator_traits<decltype(nodeAlloc)>::allocate(nodeAlloc, 1);
+    std::allocator_traits<decltype(nodeAlloc)>::construct(nodeAlloc, node, data);
+    return node;
 }
 
-template<typename Data_T>
-typename BST<Data_T>::BinNode *BST<Data_T>::initNode(const BinNode &data) {
-    return new BinNode(data);
+template<typename Data_T, typename Compare_T, typename Alloc_T>
+typename BST<Data_T, Compare_T, Alloc_T>::BinNode *BST<Data_T, Compare_T, Alloc_T>::initNode(Data_T &&data) {
+    typename std::allocator_traits<Alloc_T>::template rebind_alloc<BinNode> nodeAlloc(this->alloc);
+    BinNode *node = std::allocator_traits<decltype(nodeAlloc)>::allocate(nodeAlloc, 1);
+    std::allocator_traits<decltype(nodeAlloc)>::construct(nodeAlloc, node, std::in_place, std::move(data));
+    return node;
 }
 
-// BinNode impl:
-template<typename Data_T>
-void BST<Data_T>::BinNode::print() {
-//    cout << this->getData() << endl;
+template<typename Data_T, typename Compare_T, typename Alloc_T>
+typename BST<Data_T, Compare_T, Alloc_T>::BinNode *BST<Data_T, Compare_T, Alloc_T>::initNode(const BinNode &data) {
+    typename std::allocator_traits<Alloc_T>::template rebind_alloc<BinNode> nodeAlloc(this->alloc);
+    BinNode *node = std::allocator_traits<decltype(nodeAlloc)>::allocate(nodeAlloc, 1);
+    std::allocator_traits<decltype(nodeAlloc)>::construct(nodeAlloc, node, data);
+    return node;
 }
 
-template<typename Data_T>
-void BST<Data_T>::BinNode::cloneFrom(const BinNode *node) {
-    this->data = node->data;
-    this->left->cloneFrom(node->left);
-    this->right->cloneFrom(node->right);
+template<typename Data_T, typename Compare_T, typename Alloc_T>
+void BST<Data_T, Compare_T, Alloc_T>::destroyNode(BinNode *node) {
+    typename std::allocator_traits<Alloc_T>::template rebind_alloc<BinNode> nodeAlloc(this->alloc);
+    std::allocator_traits<decltype(nodeAlloc)>::destroy(nodeAlloc, node);
+    std::allocator_traits<decltype(nodeAlloc)>::deallocate(nodeAlloc, node, 1);
 }
 
-template<typename Data_T>
-void BST<Data_T>::BinNode::deleteSubTree(BinNode *&node) {
-    if (!node) return;
-    std::queue < BinNode * > q;
-    q.push(node);
-    while (!q.empty()) {
-        if ((q.front())->left)
-            q.push(q.front()->left);
-        if ((q.front())->right)
-            q.push(q.front()->right);
-        delete (q.front());
-        q.pop();
+// Frees a subtree without any auxiliary storage: left children are rotated up until the current node has none, at
+// which point it can be destroyed and the walk continues with its right subtree
+template<typename Data_T, typename Compare_T, typename Alloc_T>
+void BST<Data_T, Compare_T, Alloc_T>::deleteSubTree(BinNode *&node) {
+    BinNode *current = node, *next;
+    while (current) {
+        if (current->left) {
+            next = current->left;
+            current->left = next->right;
+            next->right = current;
+        } else {
+            next = current->right;
+            this->destroyNode(current);
+        }
+        current = next;
     }
     node = nullptr;
 }
 
+// BinNode impl:
+template<typename Data_T, typename Compare_T, typename Alloc_T>
+void BST<Data_T, Compare_T, Alloc_T>::BinNode::print() {
+//    cout << this->getData() << endl;
+}
+
 //template<typename Data_T>
-//bool BST<Data_T>::BinNode::subTreeEquals(const BinNode *node1, const BinNode *node2) {
+//bool BST<Data_T, Compare_T, Alloc_T>::BinNode::subTreeEquals(const BinNode *node1, const BinNode *node2) {
 //    if (!node1) return !node2;
 //    if (!node2) return false;
-//    std::queue<typename BST<Data_T>::BinNode *> q1, q2;
-//    typename BST<Data_T>::BinNode *n1, *n2;
+//    std::queue<typename BST<Data_T, Compare_T, Alloc_T>::BinNode *> q1, q2;
+//    typename BST<Data_T, Compare_T, Alloc_T>::BinNode *n1, *n2;
 //
 //    q1.push(node1);
 //    q2.push(node2);
@@ -704,4 +790,6 @@ void BST<Data_T>::BinNode::deleteSubTree(BinNode *&node) {
 //            q.push(&(*q.front())->right);
 //        q.pop();
 //    }
-//}
\ No newline at end of file
+//}
+
+#endif // BINARY_SEARCH_TREE
@@ -0,0 +1,124 @@
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifndef MAP_IMAGE
+#define MAP_IMAGE
+
+// Fixed-size start of an image. The byte order mark and the type sizes let a reader refuse an image written for other
+// types or on another platform, rather than misread it.
+struct MapImageHeader {
+    char magic[8];
+    uint32_t version, byteOrder;
+    uint32_t keyBytes, mappedBytes, entryBytes, entryAlign;
+    uint64_t count, keysOffset, entriesOffset, imageBytes;
+};
+
+// On-disk image of an ordered map with trivially copyable keys and values, meant to be mapped into memory and used in
+// place (see MappedMap). After the header come the keys alone, in key order, then the entries (std::pair<Key_T,
+// Mapped_T>) in the same order. Both arrays start on a cache line boundary and are found by their offsets from the
+// start of the image, so it holds no pointer and reads the same wherever it is mapped. A lookup binary-searches the
+// dense key array and takes the entry at the same index.
+template<typename Key_T, typename Mapped_T>
+class MapImage {
+public:
+    typedef std::pair<Key_T, Mapped_T> Entry;
+
+    static constexpr size_t LINE_BYTES = 64;
+    // Entries gathered per write
+    static constexpr size_t CHUNK = 4096;
+    static constexpr uint32_t VERSION = 1, BYTE_ORDER_MARK = 0x01020304;
+
+    static_assert(std::is_trivially_copyable<Key_T>::value && std::is_trivially_copyable<Mapped_T>::value,
+                  "a map image needs trivially copyable keys and mapped values");
+    static_assert(alignof(Entry) <= LINE_BYTES, "a map image aligns its arrays to a cache line at most");
+
+    // Header of an image of `count` entries
+    static MapImageHeader layout(uint64_t count);
+
+    // Whether `header`, at the start of `bytes` bytes, describes an image of these types written on this platform
+    static bool fits(const MapImageHeader &header, uint64_t bytes);
+
+    // Writes the `count` entries from `first`, which must be in key order, to `path`. The image goes to a temporary
+    // file first and is renamed over `path` once complete, so a process that has the old image mapped keeps it whole.
+    // Throws std::system_error when a file cannot be written.
+    template<typename IT_T>
+    static void write(const std::string &path, IT_T first, uint64_t count);
+
+private:
+    static uint64_t alignUp(uint64_t offset) {
+        return (offset + LINE_BYTES - 1) / LINE_BYTES * LINE_BYTES;
+    }
+};
+
+template<typename Key_T, typename Mapped_T>
+MapImageHeader MapImage<Key_T, Mapped_T>::layout(uint64_t count) {
+    MapImageHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, "CS540MAP", sizeof(header.magic));
+    header.version = VERSION;
+    header.byteOrder = BYTE_ORDER_MARK;
+    header.keyBytes = sizeof(Key_T);
+    header.mappedBytes = sizeof(Mapped_T);
+    header.entryBytes = sizeof(Entry);
+    header.entryAlign = alignof(Entry);
+    header.count = count;
+    header.keysOffset = alignUp(sizeof(MapImageHeader));
+    header.entriesOffset = alignUp(header.keysOffset + count * sizeof(Key_T));
+    header.imageBytes = header.entriesOffset + count * sizeof(Entry);
+    return header;
+}
+
+template<typename Key_T, typename Mapped_T>
+bool MapImage<Key_T, Mapped_T>::fits(const MapImageHeader &header, uint64_t bytes) {
+    // Bounding the count first keeps the layout arithmetic from overflowing
+    if (bytes < sizeof(MapImageHeader) || header.count > bytes / sizeof(Entry))
+        return false;
+    MapImageHeader expected = layout(header.count);
+    return std::memcmp(&header, &expected, sizeof(MapImageHeader)) == 0 && header.imageBytes <= bytes;
+}
+
+template<typename Key_T, typename Mapped_T>
+template<typename IT_T>
+void MapImage<Key_T, Mapped_T>::write(const std::string &path, IT_T first, uint64_t count) {
+    std::string partial = path + ".partial";
+    std::ofstream out(partial, std::ios::binary | std::ios::trunc);
+    if (!out)
+        throw std::system_error(errno, std::generic_category(), "cannot create " + partial);
+    MapImageHeader header = layout(count);
+    out.write((const char *) &header, sizeof(header));
+    // One pass over the entries, which may be slow to walk: each chunk is gathered, then written to both arrays.
+    // Seeking past the end leaves the padding between the arrays zero-filled.
+    std::vector<Key_T> keys;
+    std::vector<Entry> entries;
+    keys.reserve(CHUNK);
+    entries.reserve(CHUNK);
+    for (uint64_t written = 0; written < count; written += keys.size()) {
+        keys.clear();
+        entries.clear();
+        for (; keys.size() < CHUNK && written + keys.size() < count; ++first) {
+            keys.push_back(first->first);
+            entries.push_back(*first);
+        }
+        out.seekp((std::streamoff) (header.keysOffset + written * sizeof(Key_T)));
+        out.write((const char *) keys.data(), (std::streamsize) (keys.size() * sizeof(Key_T)));
+        out.seekp((std::streamoff) (header.entriesOffset + written * sizeof(Entry)));
+        out.write((const char *) entries.data(), (std::streamsize) (entries.size() * sizeof(Entry)));
+    }
+    out.close();
+    if (!out || std::rename(partial.c_str(), path.c_str()) != 0) {
+        int error = errno;
+        std::remove(partial.c_str());
+        throw std::system_error(error, std::generic_category(), "cannot write " + path);
+    }
+}
+
+#endif // MAP_IMAGE
@@ -0,0 +1,405 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ios>
+#include <istream>
+#include <iterator>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifndef MAP_STREAM
+#define MAP_STREAM
+
+// Sequential access to the bytes of an encoding. Every integer is written least significant byte first, so a stream
+// reads the same on any platform.
+class ByteWriter {
+public:
+    explicit ByteWriter(std::string &bytes) : bytes(bytes) {}
+
+    void write(const void *data, size_t size) {
+        bytes.append((const char *) data, size);
+    }
+
+    void writeFixed(uint64_t value, size_t size) {
+        for (size_t i = 0; i < size; ++i, value >>= 8)
+            bytes.push_back((char) (value & 0xff));
+    }
+
+    // Seven bits per byte, the high bit set on all but the last: small values take a single byte
+    void writeVarint(uint64_t value) {
+        for (; value >= 0x80; value >>= 7)
+            bytes.push_back((char) (value | 0x80));
+        bytes.push_back((char) value);
+    }
+
+private:
+    std::string &bytes;
+};
+
+// Throws std::runtime_error on reading past the end, which only a damaged stream gets to
+class ByteReader {
+public:
+    ByteReader(const char *position, const char *end) : position(position), end(end) {}
+
+    void read(void *data, size_t size) {
+        std::memcpy(data, this->take(size), size);
+    }
+
+    uint64_t readFixed(size_t size) {
+        const unsigned char *bytes = (const unsigned char *) this->take(size);
+        uint64_t value = 0;
+        for (size_t i = size; i--;)
+            value = value << 8 | bytes[i];
+        return value;
+    }
+
+    uint64_t readVarint() {
+        uint64_t value = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7) {
+            unsigned char byte = *(const unsigned char *) this->take(1);
+            value |= (uint64_t) (byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                return value;
+        }
+        throw std::runtime_error("map stream has a malformed length or integer");
+    }
+
+    size_t remaining() const {
+        return (size_t) (end - position);
+    }
+
+private:
+    const char *position, *end;
+
+    const char *take(size_t size) {
+        if (size > this->remaining())
+            throw std::runtime_error("map stream entry runs past the end of its block");
+        const char *taken = position;
+        position += size;
+        return taken;
+    }
+};
+
+// How a type is written to a map stream. A specialization provides
+//     static void encode(ByteWriter &out, const T &value);
+//     static T decode(ByteReader &in);
+// Integers (as variable-length zigzag integers), floating point numbers, enums, std::string, std::pair and
+// std::vector of encodable types come with one; other key and mapped types need their own.
+template<typename T, typename Enable_T = void>
+struct Codec {
+    static_assert(!std::is_same<Enable_T, Enable_T>::value, "no Codec specialization for this type");
+};
+
+template<typename T>
+struct Codec<T, typename std::enable_if<std::is_integral<T>::value>::type> {
+    static void encode(ByteWriter &out, const T &value) {
+        if constexpr (std::is_signed<T>::value)
+            out.writeVarint(((uint64_t) (int64_t) value << 1) ^ (uint64_t) ((int64_t) value >> 63));
+        else
+            out.writeVarint((uint64_t) value);
+    }
+
+    static T decode(ByteReader &in) {
+        uint64_t value = in.readVarint();
+        if constexpr (std::is_signed<T>::value)
+            return (T) (int64_t) ((value >> 1) ^ (~(value & 1) + 1));
+        else
+            return (T) value;
+    }
+};
+
+template<typename T>
+struct Codec<T, typename std::enable_if<std::is_floating_point<T>::value>::type> {
+    typedef typename std::conditional<sizeof(T) == sizeof(uint32_t), uint32_t, uint64_t>::type Bits;
+    static_assert(sizeof(T) == sizeof(Bits), "only 32 and 64 bit floating point types are encodable");
+
+    static void encode(ByteWriter &out, const T &value) {
+        Bits bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        out.writeFixed(bits, sizeof(bits));
+    }
+
+    static T decode(ByteReader &in) {
+        Bits bits = (Bits) in.readFixed(sizeof(Bits));
+        T value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+};
+
+template<typename T>
+struct Codec<T, typename std::enable_if<std::is_enum<T>::value>::type> {
+    typedef typename std::underlying_type<T>::type Underlying;
+
+    static void encode(ByteWriter &out, const T &value) {
+        Codec<Underlying>::encode(out, (Underlying) value);
+    }
+
+    static T decode(ByteReader &in) {
+        return (T) Codec<Underlying>::decode(in);
+    }
+};
+
+template<typename Traits_T, typename Alloc_T>
+struct Codec<std::basic_string<char, Traits_T, Alloc_T>> {
+    static void encode(ByteWriter &out, const std::basic_string<char, Traits_T, Alloc_T> &value) {
+        out.writeVarint(value.size());
+        out.write(value.data(), value.size());
+    }
+
+    static std::basic_string<char, Traits_T, Alloc_T> decode(ByteReader &in) {
+        uint64_t size = in.readVarint();
+        if (size > in.remaining())
+            throw std::runtime_error("map stream entry runs past the end of its block");
+        std::basic_string<char, Traits_T, Alloc_T> value((size_t) size, '\0');
+        in.read(&value[0], value.size());
+        return value;
+    }
+};
+
+template<typename First_T, typename Second_T>
+struct Codec<std::pair<First_T, Second_T>> {
+    static void encode(ByteWriter &out, const std::pair<First_T, Second_T> &value) {
+        Codec<First_T>::encode(out, value.first);
+        Codec<Second_T>::encode(out, value.second);
+    }
+
+    // Braced, so the first member is decoded before the second
+    static std::pair<First_T, Second_T> decode(ByteReader &in) {
+        return std::pair<First_T, Second_T>{Codec<First_T>::decode(in), Codec<Second_T>::decode(in)};
+    }
+};
+
+template<typename T, typename Alloc_T>
+struct Codec<std::vector<T, Alloc_T>> {
+    static void encode(ByteWriter &out, const std::vector<T, Alloc_T> &value) {
+        out.writeVarint(value.size());
+        for (const T &item : value)
+            Codec<T>::encode(out, item);
+    }
+
+    static std::vector<T, Alloc_T> decode(ByteReader &in) {
+        uint64_t size = in.readVarint();
+        std::vector<T, Alloc_T> value;
+        // Every item takes at least a byte, which bounds what a damaged size can reserve
+        value.reserve((size_t) std::min<uint64_t>(size, in.remaining()));
+        for (; size; --size)
+            value.push_back(Codec<T>::decode(in));
+        return value;
+    }
+};
+
+// Stream of the entries of an ordered map:
+//     "CS540MST", version, flags, entry count (varints)
+//     blocks: payload size (4 bytes), payload, CRC-32 of the payload (4 bytes, when checksummed)
+// A payload holds whole entries, key then mapped value, each encoded by its Codec, in key order. A block is closed
+// once it reaches the block size (or holds a single larger entry), so writing or reading one never buffers more than
+// a block, whatever the size of the map. Nothing marks the end but the count: a map stream can be embedded in a
+// longer one.
+class MapStreamFormat {
+public:
+    static constexpr const char *MAGIC = "CS540MST";
+    static constexpr size_t MAGIC_BYTES = 8;
+    static constexpr uint64_t VERSION = 1, CHECKSUMS = 1;
+    static constexpr size_t BLOCK_BYTES = 64 * 1024;
+
+    // CRC-32 (IEEE 802.3, reflected), continuing from `crc`
+    static uint32_t crc32(const char *data, size_t size, uint32_t crc = 0);
+
+    // Writes the `count` entries from `first`, which must be in key order. Throws std::ios_base::failure when `out`
+    // fails.
+    template<typename Key_T, typename Mapped_T, typename IT_T>
+    static void write(std::ostream &out, IT_T first, uint64_t count, bool checksums, size_t blockBytes);
+
+    // Reads a map stream one block at a time. Throws std::ios_base::failure when `in` ends early, and
+    // std::runtime_error when what it reads is not a well-formed map stream.
+    template<typename Key_T, typename Mapped_T>
+    class Reader {
+    public:
+        typedef std::pair<Key_T, Mapped_T> Entry;
+
+        // Single-pass: each dereference decodes the next entry and ++ does nothing, so anything that can throw
+        // happens while an entry is being taken
+        class Iterator {
+        public:
+            typedef std::input_iterator_tag iterator_category;
+            typedef Entry value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef const Entry *pointer;
+            typedef Entry reference;
+
+            explicit Iterator(Reader *reader) : reader(reader) {}
+
+            Entry operator*() const {
+                return reader->next();
+            }
+
+            Iterator &operator++() {
+                return *this;
+            }
+
+        private:
+            Reader *reader;
+        };
+
+        // Reads the header
+        explicit Reader(std::istream &in);
+
+        uint64_t count() const {
+            return entryCount;
+        }
+
+        Iterator entries() {
+            return Iterator(this);
+        }
+
+        Entry next();
+
+        // Checks that the entries read ended with their block
+        void finish() const;
+
+    private:
+        std::istream &in;
+        bool checksums;
+        uint64_t entryCount;
+        std::vector<char> block;
+        ByteReader payload;
+
+        void readBytes(char *data, size_t size);
+
+        void loadBlock();
+    };
+
+private:
+    static void writeBlock(std::ostream &out, const std::string &payload, bool checksums);
+};
+
+inline uint32_t MapStreamFormat::crc32(const char *data, size_t size, uint32_t crc) {
+    static const std::vector<uint32_t> table = [] {
+        std::vector<uint32_t> entries(256);
+        for (uint32_t byte = 0; byte < 256; ++byte) {
+            uint32_t value = byte;
+            for (int bit = 0; bit < 8; ++bit)
+                value = value & 1 ? 0xedb88320u ^ (value >> 1) : value >> 1;
+            entries[byte] = value;
+        }
+        return entries;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i)
+        crc = table[(crc ^ (unsigned char) data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+inline void MapStreamFormat::writeBlock(std::ostream &out, const std::string &payload, bool checksums) {
+    std::string framing;
+    ByteWriter(framing).writeFixed(payload.size(), 4);
+    out.write(framing.data(), (std::streamsize) framing.size());
+    out.write(payload.data(), (std::streamsize) payload.size());
+    if (checksums) {
+        framing.clear();
+        ByteWriter(framing).writeFixed(crc32(payload.data(), payload.size()), 4);
+        out.write(framing.data(), (std::streamsize) framing.size());
+    }
+    if (!out)
+        throw std::ios_base::failure("cannot write map stream");
+}
+
+template<typename Key_T, typename Mapped_T, typename IT_T>
+void MapStreamFormat::write(std::ostream &out, IT_T first, uint64_t count, bool checksums, size_t blockBytes) {
+    std::string bytes;
+    ByteWriter header(bytes);
+    header.write(MAGIC, MAGIC_BYTES);
+    header.writeVarint(VERSION);
+    header.writeVarint(checksums ? CHECKSUMS : 0);
+    header.writeVarint(count);
+    out.write(bytes.data(), (std::streamsize) bytes.size());
+    bytes.clear();
+    ByteWriter payload(bytes);
+    for (; count; --count, ++first) {
+        Codec<Key_T>::encode(payload, first->first);
+        Codec<Mapped_T>::encode(payload, first->second);
+        if (bytes.size() >= blockBytes || count == 1) {
+            writeBlock(out, bytes, checksums);
+            bytes.clear();
+        }
+    }
+    if (!out)
+        throw std::ios_base::failure("cannot write map stream");
+}
+
+template<typename Key_T, typename Mapped_T>
+MapStreamFormat::Reader<Key_T, Mapped_T>::Reader(std::istream &in) : in(in), payload(nullptr, nullptr) {
+    char magic[MAGIC_BYTES];
+    this->readBytes(magic, MAGIC_BYTES);
+    if (std::memcmp(magic, MAGIC, MAGIC_BYTES) != 0)
+        throw std::runtime_error("not a map stream");
+    // The header's varints are read a byte at a time, as nothing says how long they are
+    auto varint = [this] {
+        uint64_t value = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7) {
+            char byte;
+            this->readBytes(&byte, 1);
+            value |= (uint64_t) (byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                return value;
+        }
+        throw std::runtime_error("map stream has a malformed header");
+    };
+    if (varint() != VERSION)
+        throw std::runtime_error("unsupported map stream version");
+    uint64_t flags = varint();
+    if (flags & ~CHECKSUMS)
+        throw std::runtime_error("map stream has unknown flags");
+    checksums = flags & CHECKSUMS;
+    entryCount = varint();
+}
+
+template<typename Key_T, typename Mapped_T>
+void MapStreamFormat::Reader<Key_T, Mapped_T>::readBytes(char *data, size_t size) {
+    if (!in.read(data, (std::streamsize) size))
+        throw std::ios_base::failure("map stream ends early");
+}
+
+// The buffer grows with what actually arrives, so a damaged size on a short stream fails as a short read rather
+// than as one huge allocation
+template<typename Key_T, typename Mapped_T>
+void MapStreamFormat::Reader<Key_T, Mapped_T>::loadBlock() {
+    char framing[4];
+    this->readBytes(framing, sizeof(framing));
+    size_t size = (size_t) ByteReader(framing, framing + sizeof(framing)).readFixed(sizeof(framing));
+    block.clear();
+    for (size_t loaded = 0; loaded < size;) {
+        size_t step = std::min(size - loaded, BLOCK_BYTES);
+        block.resize(loaded + step);
+        this->readBytes(block.data() + loaded, step);
+        loaded += step;
+    }
+    if (checksums) {
+        this->readBytes(framing, sizeof(framing));
+        if (ByteReader(framing, framing + sizeof(framing)).readFixed(sizeof(framing)) != crc32(block.data(), size))
+            throw std::runtime_error("map stream block fails its checksum");
+    }
+    payload = ByteReader(block.data(), block.data() + size);
+}
+
+template<typename Key_T, typename Mapped_T>
+typename MapStreamFormat::Reader<Key_T, Mapped_T>::Entry MapStreamFormat::Reader<Key_T, Mapped_T>::next() {
+    if (!payload.remaining())
+        this->loadBlock();
+    Key_T key = Codec<Key_T>::decode(payload);
+    return Entry(std::move(key), Codec<Mapped_T>::decode(payload));
+}
+
+template<typename Key_T, typename Mapped_T>
+void MapStreamFormat::Reader<Key_T, Mapped_T>::finish() const {
+    if (payload.remaining())
+        throw std::runtime_error("map stream block holds more entries than its count");
+}
+
+#endif // MAP_STREAM
@@ -0,0 +1,196 @@
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+
+#ifndef NODE_POOL
+#define NODE_POOL
+
+// Slab allocator for tree nodes. Single-object requests are carved out of contiguous chunks (one free list per slot
+// size), freed slots are recycled, and release() hands every chunk back at once regardless of how many nodes live
+// in them. Anything else (arrays, over-aligned types) goes straight to ::operator new.
+class NodePoolResource {
+public:
+    typedef struct {
+        size_t allocations, deallocations, inUse, bytesInUse, bytesReserved, chunks;
+    } Stats;
+
+    NodePoolResource(size_t firstChunkSlots = 64, size_t maxChunkSlots = 64 * 1024)
+            : firstChunkSlots(firstChunkSlots), maxChunkSlots(maxChunkSlots) {}
+
+    NodePoolResource(const NodePoolResource &) = delete;
+
+    NodePoolResource &operator=(const NodePoolResource &) = delete;
+
+    ~NodePoolResource() {
+        this->release();
+    }
+
+    void *allocate(size_t bytes, size_t alignment, size_t count);
+
+    void deallocate(void *ptr, size_t bytes, size_t alignment, size_t count);
+
+    void release();
+
+    size_t inUse() const {
+        return stats.inUse;
+    }
+
+    Stats getStats() const {
+        return stats;
+    }
+
+private:
+    struct FreeSlot {
+        FreeSlot *next;
+    };
+
+    struct SizeClass {
+        size_t slotSize, nextChunkSlots;
+        FreeSlot *freeList;
+        char *bump, *bumpEnd;
+    };
+
+    size_t firstChunkSlots, maxChunkSlots;
+    std::vector<SizeClass> classes;
+    std::vector<void *> chunks;
+    Stats stats = {0, 0, 0, 0, 0, 0};
+
+    static size_t slotSize(size_t bytes, size_t alignment) {
+        if (bytes < sizeof(FreeSlot)) bytes = sizeof(FreeSlot);
+        return (bytes + alignment - 1) / alignment * alignment;
+    }
+
+    static bool pooled(size_t alignment, size_t count) {
+        return count == 1 && alignment <= alignof(std::max_align_t);
+    }
+
+    SizeClass &sizeClass(size_t size);
+};
+
+// std-compatible allocator over a shared NodePoolResource. Rebound copies (e.g. the tree's node allocator) share the
+// resource, while a container copy gets a pool of its own so that release() never reaches another container's nodes.
+template<typename T>
+class PoolAllocator {
+    template<typename U> friend
+    class PoolAllocator;
+
+public:
+    typedef T value_type;
+    typedef std::false_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+    typedef std::false_type is_always_equal;
+
+    PoolAllocator() : pool(std::make_shared<NodePoolResource>()) {}
+
+    PoolAllocator(const std::shared_ptr<NodePoolResource> &pool) : pool(pool) {}
+
+    template<typename U>
+    PoolAllocator(const PoolAllocator<U> &other) : pool(other.pool) {}
+
+    T *allocate(size_t count) {
+        return static_cast<T *>(pool->allocate(sizeof(T), alignof(T), count));
+    }
+
+    void deallocate(T *ptr, size_t count) {
+        pool->deallocate(ptr, sizeof(T), alignof(T), count);
+    }
+
+    PoolAllocator select_on_container_copy_construction() const {
+        return PoolAllocator();
+    }
+
+    // Number of live allocations across the whole resource, whatever their type
+    size_t in_use() const {
+        return pool->inUse();
+    }
+
+    void release() {
+        pool->release();
+    }
+
+    NodePoolResource::Stats stats() const {
+        return pool->getStats();
+    }
+
+    template<typename U>
+    bool operator==(const PoolAllocator<U> &other) const {
+        return pool == other.pool;
+    }
+
+    template<typename U>
+    bool operator!=(const PoolAllocator<U> &other) const {
+        return pool != other.pool;
+    }
+
+private:
+    std::shared_ptr<NodePoolResource> pool;
+};
+
+inline void *NodePoolResource::allocate(size_t bytes, size_t alignment, size_t count) {
+    void *ptr;
+    if (!pooled(alignment, count)) {
+        ptr = ::operator new(bytes * count);
+        bytes *= count;
+    } else {
+        SizeClass &sc = this->sizeClass(slotSize(bytes, alignment));
+        bytes = sc.slotSize;
+        if (sc.freeList) {
+            ptr = sc.freeList;
+            sc.freeList = sc.freeList->next;
+        } else {
+            if (sc.bump == sc.bumpEnd) {
+                size_t chunkBytes = sc.slotSize * sc.nextChunkSlots;
+                sc.bump = static_cast<char *>(::operator new(chunkBytes));
+                sc.bumpEnd = sc.bump + chunkBytes;
+                chunks.push_back(sc.bump);
+                stats.bytesReserved += chunkBytes;
+                ++stats.chunks;
+                if (sc.nextChunkSlots < maxChunkSlots)
+                    sc.nextChunkSlots *= 2;
+            }
+            ptr = sc.bump;
+            sc.bump += sc.slotSize;
+        }
+    }
+    ++stats.allocations;
+    ++stats.inUse;
+    stats.bytesInUse += bytes;
+    return ptr;
+}
+
+inline void NodePoolResource::deallocate(void *ptr, size_t bytes, size_t alignment, size_t count) {
+    if (!pooled(alignment, count)) {
+        ::operator delete(ptr);
+        bytes *= count;
+    } else {
+        SizeClass &sc = this->sizeClass(slotSize(bytes, alignment));
+        bytes = sc.slotSize;
+        FreeSlot *slot = static_cast<FreeSlot *>(ptr);
+        slot->next = sc.freeList;
+        sc.freeList = slot;
+    }
+    ++stats.deallocations;
+    --stats.inUse;
+    stats.bytesInUse -= bytes;
+}
+
+// Frees every chunk in O(chunks); the caller guarantees nothing allocated from the pool is still in use
+inline void NodePoolResource::release() {
+    for (void *chunk : chunks)
+        ::operator delete(chunk);
+    chunks.clear();
+    classes.clear();
+    stats.inUse = stats.bytesInUse = stats.bytesReserved = stats.chunks = 0;
+}
+
+inline NodePoolResource::SizeClass &NodePoolResource::sizeClass(size_t size) {
+    for (SizeClass &sc : classes)
+        if (sc.slotSize == size)
+            return sc;
+    classes.push_back({size, firstChunkSlots, nullptr, nullptr, nullptr});
+    return classes.back();
+}
+
+#endif // NODE_POOL
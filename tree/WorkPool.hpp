@@ -0,0 +1,245 @@
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#ifndef WORK_POOL
+#define WORK_POOL
+
+// Fork-join thread pool for the divide and conquer tree algorithms (set operations, bulk builds, copies). Each worker
+// owns a deque: it pushes the tasks it forks at the back and pops them back from there, while idle workers steal from
+// the front of other deques, which hands them the oldest and therefore largest pieces of work. Threads outside the
+// pool fork into a shared queue that the workers steal from as well.
+class WorkPool {
+public:
+    // The threads calling invoke() do their share of the work, so by default one hardware thread is left to them
+    explicit WorkPool(unsigned threads = defaultThreads());
+
+    WorkPool(const WorkPool &) = delete;
+
+    WorkPool &operator=(const WorkPool &) = delete;
+
+    // Outstanding invoke() calls must have returned
+    ~WorkPool();
+
+    // Runs `first` on the calling thread and `second` wherever a thread is free, and returns once both are done.
+    // While waiting for a stolen `second`, the caller runs other queued tasks. If either throws, the first exception
+    // is rethrown after both have finished.
+    template<typename First_T, typename Second_T>
+    void invoke(First_T &&first, Second_T &&second);
+
+    unsigned size() const {
+        return (unsigned) workers.size();
+    }
+
+    // Process-wide pool with the default number of workers, started on first use
+    static WorkPool &shared();
+
+    static unsigned defaultThreads() {
+        unsigned hardware = std::thread::hardware_concurrency();
+        return hardware > 1 ? hardware - 1 : 0;
+    }
+
+private:
+    struct Task {
+        void (*run)(void *);
+        void *callable;
+        std::atomic<bool> done{false};
+        std::exception_ptr error;
+    };
+
+    struct Queue {
+        std::mutex lock;
+        std::deque<Task *> tasks;
+    };
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::atomic<size_t> queued{0};
+    std::mutex sleepLock;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    static inline thread_local WorkPool *currentPool = nullptr;
+    static inline thread_local size_t currentQueue = 0;
+
+    size_t ownQueue() const {
+        return currentPool == this ? currentQueue : workers.size();
+    }
+
+    void push(size_t queue, Task *task);
+
+    bool takeBack(size_t queue, Task *task);
+
+    Task *findTask(size_t queue);
+
+    void execute(Task *task);
+
+    void work(size_t index);
+};
+
+// Where a bulk tree algorithm may run: forked onto `pool` (serially when it is null), down to pieces of about `grain`
+// entries, below which a single thread finishes the piece
+class ParallelMode {
+public:
+    WorkPool *pool;
+    size_t grain;
+
+    ParallelMode(WorkPool *pool = nullptr, size_t grain = 16 * 1024) : pool(pool), grain(grain) {}
+
+    ParallelMode(WorkPool &pool, size_t grain = 16 * 1024) : pool(&pool), grain(grain) {}
+
+    bool parallel() const {
+        return pool && pool->size();
+    }
+};
+
+inline WorkPool::WorkPool(unsigned threads) {
+    for (unsigned i = 0; i <= threads; ++i)
+        queues.emplace_back(new Queue());
+    for (unsigned i = 0; i < threads; ++i)
+        workers.emplace_back(&WorkPool::work, this, i);
+}
+
+inline WorkPool::~WorkPool() {
+    {
+        std::lock_guard<std::mutex> guard(sleepLock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &worker : workers)
+        worker.join();
+}
+
+inline WorkPool &WorkPool::shared() {
+    static WorkPool pool;
+    return pool;
+}
+
+template<typename First_T, typename Second_T>
+void WorkPool::invoke(First_T &&first, Second_T &&second) {
+    Task task;
+    task.callable = (void *) std::addressof(second);
+    task.run = [](void *callable) {
+        (*static_cast<typename std::remove_reference<Second_T>::type *>(callable))();
+    };
+    size_t queue = this->ownQueue();
+    this->push(queue, &task);
+
+    std::exception_ptr error;
+    try {
+        first();
+    } catch (...) {
+        error = std::current_exception();
+    }
+
+    if (this->takeBack(queue, &task)) {
+        this->execute(&task);
+    } else {
+        for (unsigned idle = 0; !task.done.load(std::memory_order_acquire);) {
+            if (Task *other = this->findTask(queue)) {
+                this->execute(other);
+                idle = 0;
+            } else if (++idle < 64) {
+                std::this_thread::yield();
+            } else {
+                std::unique_lock<std::mutex> guard(sleepLock);
+                wake.wait(guard, [this, &task] {
+                    return task.done.load(std::memory_order_acquire) || queued.load(std::memory_order_acquire);
+                });
+            }
+        }
+    }
+    if (error)
+        std::rethrow_exception(error);
+    if (task.error)
+        std::rethrow_exception(task.error);
+}
+
+// The empty critical section orders the count update before a sleeping worker's predicate check, so no wakeup is lost
+inline void WorkPool::push(size_t queue, Task *task) {
+    {
+        std::lock_guard<std::mutex> guard(queues[queue]->lock);
+        queues[queue]->tasks.push_back(task);
+    }
+    queued.fetch_add(1, std::memory_order_release);
+    { std::lock_guard<std::mutex> guard(sleepLock); }
+    wake.notify_one();
+}
+
+// Takes `task` back off `queue` unless someone has stolen it. In the shared queue other callers' tasks may sit behind
+// it, so it is searched for from the back.
+inline bool WorkPool::takeBack(size_t queue, Task *task) {
+    std::lock_guard<std::mutex> guard(queues[queue]->lock);
+    std::deque<Task *> &tasks = queues[queue]->tasks;
+    for (auto it = tasks.rbegin(); it != tasks.rend(); ++it) {
+        if (*it == task) {
+            tasks.erase(std::next(it).base());
+            queued.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Newest task of `queue` first, then the oldest task of any other queue
+inline WorkPool::Task *WorkPool::findTask(size_t queue) {
+    if (!queued.load(std::memory_order_acquire))
+        return nullptr;
+    for (size_t i = 0; i < queues.size(); ++i) {
+        size_t victim = (queue + i) % queues.size();
+        std::lock_guard<std::mutex> guard(queues[victim]->lock);
+        std::deque<Task *> &tasks = queues[victim]->tasks;
+        if (tasks.empty())
+            continue;
+        Task *task;
+        if (i == 0) {
+            task = tasks.back();
+            tasks.pop_back();
+        } else {
+            task = tasks.front();
+            tasks.pop_front();
+        }
+        queued.fetch_sub(1, std::memory_order_relaxed);
+        return task;
+    }
+    return nullptr;
+}
+
+// Completion wakes everyone asleep: the forking thread may have run out of other work and be waiting for this task
+inline void WorkPool::execute(Task *task) {
+    try {
+        task->run(task->callable);
+    } catch (...) {
+        task->error = std::current_exception();
+    }
+    {
+        std::lock_guard<std::mutex> guard(sleepLock);
+        task->done.store(true, std::memory_order_release);
+    }
+    wake.notify_all();
+}
+
+inline void WorkPool::work(size_t index) {
+    currentPool = this;
+    currentQueue = index;
+    for (;;) {
+        if (Task *task = this->findTask(index)) {
+            this->execute(task);
+            continue;
+        }
+        std::unique_lock<std::mutex> guard(sleepLock);
+        wake.wait(guard, [this] { return stopping || queued.load(std::memory_order_acquire); });
+        if (stopping)
+            return;
+    }
+}
+
+#endif // WORK_POOL